@@ -0,0 +1,37 @@
+#version 450
+
+// Depth pre-pass, transform must match main.vert exactly for the EQUAL depth test
+#define MAX_JOINTS 256
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+} ubo;
+
+layout(std430, binding = 2) readonly buffer JointPalette {
+	mat4 joints[];
+} palette;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in uvec4 inJoints;
+layout(location = 4) in vec4 inWeights;
+
+invariant gl_Position;
+
+void main() {
+
+	mat4 skin = mat4( 1.0 );
+
+	if ( dot( inWeights, vec4( 1.0 ) ) > 0.0 ) {
+
+		uint base = gl_InstanceIndex * MAX_JOINTS;
+
+		skin = inWeights.x * palette.joints[base + inJoints.x] +
+			   inWeights.y * palette.joints[base + inJoints.y] +
+			   inWeights.z * palette.joints[base + inJoints.z] +
+			   inWeights.w * palette.joints[base + inJoints.w];
+	}
+
+	gl_Position = ubo.proj * ubo.view * ubo.model * skin * vec4( inPosition, 1.0 );
+}
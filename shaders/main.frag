@@ -1,15 +1,147 @@
 #version 450
 
+// Must match SHADOW_CASCADES and SHADOW_ATLAS_COLUMNS in cascaded_shadows.hpp
+#define SHADOW_CASCADES 4
+#define SHADOW_ATLAS_COLUMNS 2
+
+// Must match the cluster constants in light.hpp
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT ( CLUSTER_X * CLUSTER_Y * CLUSTER_Z )
+#define MAX_LIGHTS_PER_CLUSTER 64
+
+// Light left in fully shadowed areas
+#define SHADOW_AMBIENT 0.35
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	mat4 shadowViewProj[SHADOW_CASCADES];
+	vec4 cascadeSplits;
+	vec4 sunDirection;
+	vec4 clusterDepth;
+	vec2 screenSize;
+	uint lightCount;
+} ubo;
+
+struct Light {
+	vec4 positionRange;
+	vec4 color;
+	vec4 direction;
+	vec4 spotCone;
+};
+
+layout(std430, binding = 4) readonly buffer Lights {
+	Light lights[];
+} lightList;
+
+// Built by cluster_lights.comp
+layout(std430, binding = 5) readonly buffer LightGrid {
+	uint counts[CLUSTER_COUNT];
+	uint indices[];
+} grid;
+
 layout(location = 0) in vec3 inColor;
 layout(location = 1) in vec2 inUv0;
+layout(location = 2) in vec3 inWorldPos;
+layout(location = 3) in float inViewDepth;
+layout(location = 4) in vec3 inNormal;
 
 layout(location = 0) out vec4 fragColor;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Depth comparison sampler, each tap is already a bilinear 2x2 PCF
+layout(binding = 3) uniform sampler2DShadow shadowAtlas;
+
+float sampleShadow() {
+
+	int cascade = 0;
+
+	while ( cascade < SHADOW_CASCADES && inViewDepth > ubo.cascadeSplits[cascade] ) {
+
+		cascade++;
+	}
+
+	// Beyond shadow distance
+	if ( cascade == SHADOW_CASCADES ) {
+
+		return 1.0;
+	}
+
+	vec4 lightPos = ubo.shadowViewProj[cascade] * vec4( inWorldPos, 1.0 );
+	vec3 coord = lightPos.xyz / lightPos.w;
+
+	float tileSize = 1.0 / SHADOW_ATLAS_COLUMNS;
+	vec2 tileOrigin = vec2( cascade % SHADOW_ATLAS_COLUMNS, cascade / SHADOW_ATLAS_COLUMNS ) * tileSize;
+	vec2 texel = 1.0 / vec2( textureSize( shadowAtlas, 0 ) );
+
+	// Kernel must not reach into the neighbouring cascade's tile
+	vec2 uv = tileOrigin + clamp( ( coord.xy * 0.5 + 0.5 ) * tileSize, 2.0 * texel, tileSize - 2.0 * texel );
+
+	float lit = 0.0;
+
+	for ( int y = -1; y <= 1; y++ ) {
+
+		for ( int x = -1; x <= 1; x++ ) {
+
+			lit += texture( shadowAtlas, vec3( uv + vec2( x, y ) * texel, coord.z ) );
+		}
+	}
+
+	return lit / 9.0;
+}
+
+uint findCluster() {
+
+	uvec2 tile = uvec2( gl_FragCoord.xy / ubo.screenSize * vec2( CLUSTER_X, CLUSTER_Y ) );
+	int slice = int( log( inViewDepth / ubo.clusterDepth.x ) * ubo.clusterDepth.z );
+
+	tile = min( tile, uvec2( CLUSTER_X - 1, CLUSTER_Y - 1 ) );
+	slice = clamp( slice, 0, CLUSTER_Z - 1 );
+
+	return ( uint( slice ) * CLUSTER_Y + tile.y ) * CLUSTER_X + tile.x;
+}
+
+// Only the lights binned into this fragment's cluster are visited
+vec3 shadeClusterLights( vec3 normal ) {
+
+	uint cluster = findCluster();
+	uint count = grid.counts[cluster];
+	vec3 result = vec3( 0.0 );
+
+	for ( uint i = 0; i < count; i++ ) {
+
+		Light light = lightList.lights[grid.indices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+
+		vec3 toLight = light.positionRange.xyz - inWorldPos;
+		float distance = length( toLight );
+		vec3 direction = toLight / max( distance, 1e-4 );
+
+		// Windowed inverse square falloff, reaches zero at the light's range
+		float window = clamp( 1.0 - pow( distance / light.positionRange.w, 4.0 ), 0.0, 1.0 );
+		float attenuation = window * window / ( distance * distance + 1.0 );
+
+		if ( light.spotCone.x > -1.0 ) {
+
+			attenuation *= smoothstep( light.spotCone.x, light.spotCone.y, dot( -direction, light.direction.xyz ) );
+		}
+
+		result += light.color.rgb * max( dot( normal, direction ), 0.0 ) * attenuation;
+	}
+
+	return result;
+}
+
 void main() {
 
 	vec4 texColor = texture( texSampler, inUv0 );
+	vec3 normal = normalize( inNormal );
+
+	float sun = max( dot( normal, -ubo.sunDirection.xyz ), 0.0 ) * sampleShadow();
+	vec3 light = vec3( mix( SHADOW_AMBIENT, 1.0, sun ) ) + shadeClusterLights( normal );
 
-	fragColor = vec4( texColor.rgb * inColor, texColor.a );
-}
\ No newline at end of file
+	fragColor = vec4( texColor.rgb * inColor * light, texColor.a );
+}
@@ -1,21 +1,62 @@
 #version 450
 
+// Matches MAX_JOINTS, each instance owns this many palette entries
+#define MAX_JOINTS 256
+#define SHADOW_CASCADES 4
+
 layout(binding = 0) uniform UniformBufferObject {
 	mat4 model;
 	mat4 view;
 	mat4 proj;
+	mat4 shadowViewProj[SHADOW_CASCADES];
+	vec4 cascadeSplits;
 } ubo;
 
+layout(std430, binding = 2) readonly buffer JointPalette {
+	mat4 joints[];
+} palette;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inUv0;
+layout(location = 3) in uvec4 inJoints;
+layout(location = 4) in vec4 inWeights;
+layout(location = 5) in vec3 inNormal;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragUv0;
+layout(location = 2) out vec3 fragWorldPos;
+layout(location = 3) out float fragViewDepth;
+layout(location = 4) out vec3 fragNormal;
+
+// Depth pre-pass runs the same transform in depth.vert
+invariant gl_Position;
 
 void main() {
 
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4( inPosition, 1.0 );
+	// Vertices without influences stay in bind pose
+	mat4 skin = mat4( 1.0 );
+
+	if ( dot( inWeights, vec4( 1.0 ) ) > 0.0 ) {
+
+		uint base = gl_InstanceIndex * MAX_JOINTS;
+
+		skin = inWeights.x * palette.joints[base + inJoints.x] +
+			   inWeights.y * palette.joints[base + inJoints.y] +
+			   inWeights.z * palette.joints[base + inJoints.z] +
+			   inWeights.w * palette.joints[base + inJoints.w];
+	}
+
+	gl_Position = ubo.proj * ubo.view * ubo.model * skin * vec4( inPosition, 1.0 );
+
+	// Kept apart from gl_Position, its expression must stay identical to depth.vert
+	vec4 worldPos = ubo.model * skin * vec4( inPosition, 1.0 );
+
 	fragColor = inColor;
 	fragUv0 = inUv0;
-}
\ No newline at end of file
+	fragWorldPos = worldPos.xyz;
+	fragViewDepth = -( ubo.view * worldPos ).z;
+
+	// Model and palette matrices carry no non-uniform scale
+	fragNormal = mat3( ubo.model * skin ) * inNormal;
+}
@@ -0,0 +1,42 @@
+#version 450
+
+// Shadow caster pass, renders the model into one cascade's tile of the shadow atlas
+#define MAX_JOINTS 256
+#define SHADOW_CASCADES 4
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	mat4 shadowViewProj[SHADOW_CASCADES];
+	vec4 cascadeSplits;
+} ubo;
+
+layout(std430, binding = 2) readonly buffer JointPalette {
+	mat4 joints[];
+} palette;
+
+layout(push_constant) uniform ShadowPass {
+	uint cascade;
+} pass;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in uvec4 inJoints;
+layout(location = 4) in vec4 inWeights;
+
+void main() {
+
+	mat4 skin = mat4( 1.0 );
+
+	if ( dot( inWeights, vec4( 1.0 ) ) > 0.0 ) {
+
+		uint base = gl_InstanceIndex * MAX_JOINTS;
+
+		skin = inWeights.x * palette.joints[base + inJoints.x] +
+			   inWeights.y * palette.joints[base + inJoints.y] +
+			   inWeights.z * palette.joints[base + inJoints.z] +
+			   inWeights.w * palette.joints[base + inJoints.w];
+	}
+
+	gl_Position = ubo.shadowViewProj[pass.cascade] * ubo.model * skin * vec4( inPosition, 1.0 );
+}
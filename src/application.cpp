@@ -1,3 +1,6 @@
+#include <cstdio>
+#include <exception>
+#include <fstream>
 #include <iostream>
 
 #include "application.hpp"
@@ -6,10 +9,32 @@
 
 bool Application::init() {
 
+	// Replays render at the captured size with the captured states
+	if ( !options.replayPath.empty() ) {
+
+		capture = readCapture( options.replayPath );
+		running = !capture.frames.empty();
+	} else {
+
+		capture = Capture {
+			.timestep = options.fixedTimestep,
+			.width = 800,
+			.height = 600,
+			.msaaSamples = static_cast<uint32_t>( options.msaaSamples ),
+		};
+	}
+
 	return initSDL() && 
 		   initVulkan();
 }
 
+// Captured, replayed and fixed step runs draw every simulated frame. Interactive runs only draw the latest
+// one, so simulation never waits on the render thread
+bool Application::isDeterministic() const {
+
+	return !options.capturePath.empty() || !options.replayPath.empty() || options.fixedTimestep > 0.f;
+}
+
 bool Application::initSDL() {
 
 	if ( SDL_Init( SDL_INIT_VIDEO ) < 0 ) {
@@ -19,7 +44,9 @@ bool Application::initSDL() {
 	}
 	else {
 
-		window = SDL_CreateWindow( title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 800, 600, SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN );
+		Uint32 visibility = options.replayPath.empty() ? SDL_WINDOW_SHOWN : SDL_WINDOW_HIDDEN;
+
+		window = SDL_CreateWindow( title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, capture.width, capture.height, visibility | SDL_WINDOW_VULKAN );
 
 		if ( window == NULL ) {
 
@@ -33,9 +60,14 @@ bool Application::initSDL() {
 
 bool Application::initVulkan() {
 
-	vulkanEngine = VulkanEngine();
+	vulkanEngine.setMsaaSamples( static_cast<VkSampleCountFlagBits>( capture.msaaSamples ) );
 	vulkanEngine.setup( window );
 
+	if ( !options.replayPath.empty() ) {
+
+		vulkanEngine.enableFrameStats( true );
+	}
+
 	return vulkanEngine.isSafe();
 }
 
@@ -54,13 +86,157 @@ void Application::pollEvents() {
 			case SDL_QUIT:
 				running = false;
 				break;
+
+			case SDL_KEYDOWN:
+				// F1 toggles the depth pre-pass to compare GPU frame times
+				if ( e.key.keysym.sym == SDLK_F1 ) {
+
+					if ( vulkanEngine.canDepthPrepass() ) {
+
+						settings.flags ^= FRAME_DEPTH_PREPASS;
+					} else {
+
+						std::cout << "Depth pre-pass requires dynamic rendering" << std::endl;
+					}
+				}
+
+				// F2 cycles max anisotropy through 1x, 2x, 4x, 8x and 16x
+				if ( e.key.keysym.sym == SDLK_F2 ) {
+
+					settings.maxAnisotropy = settings.maxAnisotropy >= 16.f ? 1.f : settings.maxAnisotropy * 2.f;
+				}
+
+				// F3 to F5 toggle bloom, tonemapping and FXAA
+				if ( e.key.keysym.sym >= SDLK_F3 && e.key.keysym.sym <= SDLK_F5 ) {
+
+					const uint32_t effectFlags[POST_EFFECT_COUNT] = { FRAME_BLOOM_OFF, FRAME_TONEMAP_OFF, FRAME_FXAA_OFF };
+
+					settings.flags ^= effectFlags[e.key.keysym.sym - SDLK_F3];
+				}
+
+				// F6 toggles occlusion culling, it runs with the depth pre-pass
+				if ( e.key.keysym.sym == SDLK_F6 ) {
+
+					if ( vulkanEngine.canCullOcclusion() ) {
+
+						settings.flags ^= FRAME_OCCLUSION_CULLING_OFF;
+					} else {
+
+						std::cout << "Occlusion culling requires dynamic rendering, a depth format without stencil and, with MSAA, a max depth resolve" << std::endl;
+					}
+				}
+				break;
 		}
 	}
 }
 
-void Application::drawFrame() {
+// Settings are read by the engine once no frame is drawn yet, from then on the render thread owns it
+void Application::startRendering() {
+
+	settings = vulkanEngine.getFrameState( 0.f );
+	renderThread = std::thread( &Application::renderLoop, this );
+}
+
+// Frames already simulated are drawn before the render thread exits
+void Application::stopRendering() {
+
+	framePackets.close();
+
+	if ( renderThread.joinable() ) {
+
+		renderThread.join();
+	}
+
+	if ( renderError ) {
 
-	vulkanEngine.drawFrame();
+		std::rethrow_exception( renderError );
+	}
+}
+
+// Next frame's state is simulated while the render thread still draws earlier ones
+void Application::simulateFrame() {
+
+	FrameState* state = framePackets.beginWrite();
+
+	// Render thread stopped on an error
+	if ( !state ) {
+
+		running = false;
+		return;
+	}
+
+	if ( !options.replayPath.empty() ) {
+
+		*state = capture.frames[frame];
+	} else {
+
+		// Fixed timestep makes scene time depend on the frame number only
+		*state = settings;
+		state->time = options.fixedTimestep > 0.f ? frame * options.fixedTimestep : vulkanEngine.getElapsedTime();
+		vulkanEngine.animateCamera( *state );
+
+		if ( !options.capturePath.empty() ) {
+
+			capture.frames.push_back( *state );
+		}
+	}
+
+	framePackets.endWrite();
+	frame++;
+
+	if ( ( !options.replayPath.empty() && frame == static_cast<int>( capture.frames.size() ) ) || frame == options.frameCount ) {
+
+		running = false;
+	}
+}
+
+void Application::renderLoop() {
+
+	try {
+
+		while ( const FrameState* state = framePackets.beginRead() ) {
+
+			vulkanEngine.drawFrame( *state );
+			framePackets.endRead();
+		}
+	} catch ( ... ) {
+
+		renderError = std::current_exception();
+		framePackets.close();
+	}
+}
+
+// One line per frame, GPU time and image hash are what a regression check compares
+void Application::writeReport( const vector<FrameStats>& stats ) {
+
+	std::ofstream file;
+
+	if ( !options.reportPath.empty() ) {
+
+		file.open( options.reportPath, std::ios::trunc );
+	}
+
+	std::ostream& report = file.is_open() ? file : std::cout;
+	double cpuSum = 0.0, gpuSum = 0.0;
+
+	report << "frame,cpu_ms,gpu_ms,image_hash" << std::endl;
+
+	for ( const auto& frameStats : stats ) {
+
+		char hash[17];
+		snprintf( hash, sizeof( hash ), "%016llx", static_cast<unsigned long long>( frameStats.imageHash ) );
+
+		report << frameStats.frame << "," << frameStats.cpuTime << "," << frameStats.gpuTime << "," << hash << std::endl;
+
+		cpuSum += frameStats.cpuTime;
+		gpuSum += frameStats.gpuTime;
+	}
+
+	if ( !stats.empty() ) {
+
+		std::cout << "Replayed " << stats.size() << " frames, CPU " << cpuSum / stats.size() << " ms, GPU "
+				  << gpuSum / stats.size() << " ms on average" << std::endl;
+	}
 }
 
 void Application::deviceWaitIdle() {
@@ -70,6 +246,17 @@ void Application::deviceWaitIdle() {
 
 void Application::release() {
 
+	if ( !options.capturePath.empty() ) {
+
+		writeCapture( options.capturePath, capture );
+		std::cout << "Captured " << capture.frames.size() << " frames to " << options.capturePath << std::endl;
+	}
+
+	if ( !options.replayPath.empty() ) {
+
+		writeReport( vulkanEngine.takeFrameStats() );
+	}
+
 	vulkanEngine.release();
 
 	SDL_DestroyWindow( window );
@@ -1,30 +1,57 @@
 #include <SDL2/SDL.h>
 
+#include <exception>
+#include <string>
+#include <thread>
+
+#include "capture.hpp"
+#include "triple_buffer.hpp"
 #include "vulkan/engine.hpp"
 
 #pragma once
 
+struct RunOptions {
+	float fixedTimestep = 0.f;	// seconds per frame, zero follows the wall clock
+	int msaaSamples = 4;		// 1, 2, 4 or 8, lowered to what the device supports
+	int frameCount = 0;			// zero runs until the window is closed
+	std::string capturePath;	// records the state of every frame
+	std::string replayPath;		// renders a capture in a hidden window and reports per-frame stats
+	std::string reportPath;		// replay report as CSV, printed when empty
+};
+
 class Application
 {
 public:
-	Application(const char *title) : title(title) {}
+	Application(const char *title, RunOptions options = {}) : title(title), options(options), framePackets(isDeterministic()) {}
 
 	bool init();
 	bool isQuit();
 	void pollEvents();
 	void release();
-	void drawFrame();
+	void startRendering();
+	void stopRendering();
+	void simulateFrame();
 	void deviceWaitIdle();
 
 private:
 
+	bool isDeterministic() const;
 	bool initSDL();
 	bool initVulkan();
+	void renderLoop();
+	void writeReport( const vector<FrameStats>& stats );
 
 private:
 
 	const char *title;
+	RunOptions options;
 	bool running = true;
 	SDL_Window *window;
 	VulkanEngine vulkanEngine;
-};
\ No newline at end of file
+	Capture capture;
+	int frame = 0;				// simulated frames
+	FrameState settings;		// toggled by keys, copied into every simulated frame
+	TripleBuffer<FrameState> framePackets;
+	std::thread renderThread;
+	std::exception_ptr renderError;
+};
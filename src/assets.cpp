@@ -0,0 +1,62 @@
+#include <unistd.h>
+
+#include "assets.hpp"
+
+Asset Asset::view( const char *data, size_t size ) {
+
+	return Asset( std::nullopt, {}, data, size );
+}
+
+Asset Asset::mapped( File file ) {
+
+	const char *data = file.getData();
+	size_t size = file.getSize();
+
+	return Asset( std::move(file), {}, data, size );
+}
+
+Asset Asset::owned( vector<char> storage ) {
+
+	const char *data = storage.data();
+	size_t size = storage.size();
+
+	return Asset( std::nullopt, std::move(storage), data, size );
+}
+
+const char* Asset::getData() const { return _data; }
+
+size_t Asset::getSize() const { return _size; }
+
+Assets Assets::open( const string& pakPath ) {
+
+	Assets assets;
+
+	if ( access( pakPath.c_str(), R_OK ) == 0 ) {
+
+		assets._pak = Pak::open( pakPath );
+	}
+
+	return assets;
+}
+
+Asset Assets::read( const string& name ) const {
+
+	const PakEntry *entry = _pak.has_value() ? _pak->find( name ) : nullptr;
+
+	if ( entry == nullptr ) {
+
+		return Asset::mapped( File::openBinary( name ) );
+	}
+
+	if ( entry->compression == PakCompression::Stored ) {
+
+		return Asset::view( _pak->getEntryData( *entry ), entry->size );
+	}
+
+	vector<char> storage( entry->rawSize );
+	_pak->unpack( *entry, storage.data() );
+
+	return Asset::owned( std::move(storage) );
+}
+
+bool Assets::isPacked() const { return _pak.has_value(); }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "file.hpp"
+#include "pak.hpp"
+
+using std::optional, std::string, std::vector;
+
+// Bytes of a single asset, either viewed in place inside a mapping or decompressed into owned storage
+class Asset {
+
+public:
+
+	Asset( Asset&& other ) = default;
+	Asset& operator=( Asset&& other ) = default;
+
+	const char* getData() const;
+	size_t getSize() const;
+
+	static Asset view( const char *data, size_t size );
+	static Asset mapped( File file );
+	static Asset owned( vector<char> storage );
+
+private:
+
+	Asset( optional<File> file, vector<char> storage, const char *data, size_t size ) :
+		_file(std::move(file)), _storage(std::move(storage)), _data(data), _size(size) {}
+
+	optional<File> _file;
+	vector<char> _storage;
+	const char *_data;
+	size_t _size;
+};
+
+// Resolves asset names in a pak archive, names missing from the archive are read as loose files
+class Assets {
+
+public:
+
+	Asset read( const string& name ) const;
+	bool isPacked() const;
+
+	// Uses loose files only if archive doesn't exist
+	static Assets open( const string& pakPath );
+
+private:
+
+	optional<Pak> _pak;
+};
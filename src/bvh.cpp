@@ -0,0 +1,638 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "jobs.hpp"
+#include "parallel.hpp"
+
+// Candidate splits per axis are the boundaries between bins of item centers
+const int SAH_BINS = 16;
+
+// Larger ranges are always split, smaller ones only when the split is cheaper than testing every item
+const uint MAX_LEAF_ITEMS = 4;
+
+// Cost of visiting a node relative to testing one item
+const float TRAVERSAL_COST = 1.f;
+
+// Ranges of at least this many items build their first half as a separate job
+const uint PARALLEL_BUILD_ITEMS = 4096;
+
+// Nodes of a level refit per thread
+const size_t REFIT_BATCH = 64;
+
+struct Bvh::BuildNode {
+	Aabb bounds;
+	std::unique_ptr<BuildNode> children[2];
+	uint first = 0;
+	uint count = 0;
+
+	bool isLeaf() const { return !children[0]; }
+};
+
+void Aabb::grow( const Aabb& other ) {
+
+	min = glm::min( min, other.min );
+	max = glm::max( max, other.max );
+}
+
+void Aabb::grow( glm::vec3 point ) {
+
+	min = glm::min( min, point );
+	max = glm::max( max, point );
+}
+
+glm::vec3 Aabb::getCenter() const {
+
+	return ( min + max ) * 0.5f;
+}
+
+float Aabb::getArea() const {
+
+	glm::vec3 extent = max - min;
+
+	if ( extent.x < 0.f || extent.y < 0.f || extent.z < 0.f ) {
+		return 0.f;
+	}
+
+	return 2.f * ( extent.x * extent.y + extent.y * extent.z + extent.z * extent.x );
+}
+
+static void setSlot( BvhNode& node, int slot, const Aabb& box ) {
+
+	node.minX[slot] = box.min.x;
+	node.minY[slot] = box.min.y;
+	node.minZ[slot] = box.min.z;
+	node.maxX[slot] = box.max.x;
+	node.maxY[slot] = box.max.y;
+	node.maxZ[slot] = box.max.z;
+}
+
+static Aabb getSlot( const BvhNode& node, int slot ) {
+
+	return Aabb {
+		.min = glm::vec3( node.minX[slot], node.minY[slot], node.minZ[slot] ),
+		.max = glm::vec3( node.maxX[slot], node.maxY[slot], node.maxZ[slot] ),
+	};
+}
+
+void Bvh::build( const vector<Aabb>& bounds ) {
+
+	_nodes.clear();
+	_levelStarts.clear();
+	_bounds = Aabb();
+	_items.resize( bounds.size() );
+
+	if ( bounds.empty() ) {
+		return;
+	}
+
+	vector<glm::vec3> centers( bounds.size() );
+
+	for ( size_t i = 0; i < bounds.size(); i++ ) {
+
+		_items[i] = i;
+		centers[i] = bounds[i].getCenter();
+	}
+
+	auto root = buildRange( bounds, centers, 0, bounds.size() );
+
+	_bounds = root->bounds;
+	collapse( *root );
+}
+
+std::unique_ptr<Bvh::BuildNode> Bvh::buildRange( const vector<Aabb>& bounds, const vector<glm::vec3>& centers, uint first, uint count ) {
+
+	auto node = std::make_unique<BuildNode>();
+	Aabb centerBounds;
+
+	node->first = first;
+	node->count = count;
+
+	for ( uint i = first; i < first + count; i++ ) {
+
+		node->bounds.grow( bounds[_items[i]] );
+		centerBounds.grow( centers[_items[i]] );
+	}
+
+	if ( count <= 1 ) {
+		return node;
+	}
+
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	int bestSplit = 0;
+
+	for ( int axis = 0; axis < 3; axis++ ) {
+
+		float extent = centerBounds.max[axis] - centerBounds.min[axis];
+
+		if ( extent <= 0.f ) {
+			continue;
+		}
+
+		Aabb binBounds[SAH_BINS];
+		uint binCounts[SAH_BINS] = {};
+		float scale = SAH_BINS / extent;
+
+		for ( uint i = first; i < first + count; i++ ) {
+
+			int bin = std::min( static_cast<int>( ( centers[_items[i]][axis] - centerBounds.min[axis] ) * scale ), SAH_BINS - 1 );
+
+			binBounds[bin].grow( bounds[_items[i]] );
+			binCounts[bin]++;
+		}
+
+		// Right sides are swept first, so each split is evaluated in one pass from the left
+		float rightAreas[SAH_BINS - 1];
+		uint rightCounts[SAH_BINS - 1];
+		Aabb right;
+		uint rightCount = 0;
+
+		for ( int split = SAH_BINS - 2; split >= 0; split-- ) {
+
+			right.grow( binBounds[split + 1] );
+			rightCount += binCounts[split + 1];
+			rightAreas[split] = right.getArea();
+			rightCounts[split] = rightCount;
+		}
+
+		Aabb left;
+		uint leftCount = 0;
+
+		for ( int split = 0; split < SAH_BINS - 1; split++ ) {
+
+			left.grow( binBounds[split] );
+			leftCount += binCounts[split];
+
+			if ( leftCount == 0 || rightCounts[split] == 0 ) {
+				continue;
+			}
+
+			float cost = left.getArea() * leftCount + rightAreas[split] * rightCounts[split];
+
+			if ( cost < bestCost ) {
+
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint middle;
+
+	if ( bestAxis < 0 ) {
+
+		// Centers coincide, only ranges too large for a leaf are split, in the middle
+		if ( count <= MAX_LEAF_ITEMS ) {
+			return node;
+		}
+
+		middle = first + count / 2;
+	} else {
+
+		float area = node->bounds.getArea();
+		float splitCost = TRAVERSAL_COST + ( area > 0.f ? bestCost / area : 0.f );
+
+		if ( count <= MAX_LEAF_ITEMS && splitCost >= count ) {
+			return node;
+		}
+
+		float minCenter = centerBounds.min[bestAxis];
+		float scale = SAH_BINS / ( centerBounds.max[bestAxis] - minCenter );
+
+		auto split = std::partition( _items.begin() + first, _items.begin() + first + count, [&] ( uint32_t item ) {
+			return std::min( static_cast<int>( ( centers[item][bestAxis] - minCenter ) * scale ), SAH_BINS - 1 ) <= bestSplit;
+		});
+
+		middle = split - _items.begin();
+	}
+
+	uint leftCount = middle - first;
+
+	// Halves partition disjoint ranges of the item list
+	if ( count >= PARALLEL_BUILD_ITEMS ) {
+
+		JobSystem& jobs = JobSystem::get();
+		JobCounter left;
+		JobWaitGuard guard( jobs, left );
+
+		jobs.run( [&] { node->children[0] = buildRange( bounds, centers, first, leftCount ); }, &left );
+
+		node->children[1] = buildRange( bounds, centers, middle, count - leftCount );
+	} else {
+
+		node->children[0] = buildRange( bounds, centers, first, leftCount );
+		node->children[1] = buildRange( bounds, centers, middle, count - leftCount );
+	}
+
+	return node;
+}
+
+// Each 4-wide node takes the binary node's children, then keeps opening the largest inner child until
+// it has four. Levels are laid out one after another, so the next level's nodes follow the current one
+void Bvh::collapse( const BuildNode& root ) {
+
+	vector<const BuildNode*> level = { &root };
+
+	while ( !level.empty() ) {
+
+		size_t levelStart = _nodes.size();
+		vector<const BuildNode*> nextLevel;
+
+		_levelStarts.push_back( levelStart );
+		_nodes.resize( levelStart + level.size() );
+
+		for ( size_t i = 0; i < level.size(); i++ ) {
+
+			vector<const BuildNode*> slots;
+
+			if ( level[i]->isLeaf() ) {
+
+				slots.push_back( level[i] );
+			} else {
+
+				slots = { level[i]->children[0].get(), level[i]->children[1].get() };
+			}
+
+			while ( slots.size() < BVH_WIDTH ) {
+
+				auto largest = slots.end();
+
+				for ( auto slot = slots.begin(); slot != slots.end(); slot++ ) {
+
+					if ( !( *slot )->isLeaf() && ( largest == slots.end() || ( *slot )->bounds.getArea() > ( *largest )->bounds.getArea() ) ) {
+
+						largest = slot;
+					}
+				}
+
+				if ( largest == slots.end() ) {
+					break;
+				}
+
+				const BuildNode* opened = *largest;
+
+				*largest = opened->children[0].get();
+				slots.push_back( opened->children[1].get() );
+			}
+
+			BvhNode& node = _nodes[levelStart + i];
+
+			for ( int slot = 0; slot < BVH_WIDTH; slot++ ) {
+
+				if ( slot >= static_cast<int>( slots.size() ) ) {
+
+					setSlot( node, slot, Aabb() );
+					node.child[slot] = BVH_EMPTY_SLOT;
+					node.count[slot] = 0;
+					continue;
+				}
+
+				setSlot( node, slot, slots[slot]->bounds );
+
+				if ( slots[slot]->isLeaf() ) {
+
+					node.child[slot] = slots[slot]->first;
+					node.count[slot] = slots[slot]->count;
+				} else {
+
+					node.child[slot] = levelStart + level.size() + nextLevel.size();
+					node.count[slot] = 0;
+					nextLevel.push_back( slots[slot] );
+				}
+			}
+		}
+
+		level = std::move( nextLevel );
+	}
+
+	_levelStarts.push_back( _nodes.size() );
+}
+
+// Children of a level are all in later levels, so levels are refit deepest first
+void Bvh::refit( const vector<Aabb>& bounds ) {
+
+	if ( _nodes.empty() ) {
+		return;
+	}
+
+	for ( size_t level = _levelStarts.size() - 1; level-- > 0; ) {
+
+		size_t levelStart = _levelStarts[level];
+
+		parallelFor( _levelStarts[level + 1] - levelStart, REFIT_BATCH, [&] ( size_t begin, size_t end ) {
+
+			for ( size_t i = levelStart + begin; i < levelStart + end; i++ ) {
+
+				BvhNode& node = _nodes[i];
+
+				for ( int slot = 0; slot < BVH_WIDTH; slot++ ) {
+
+					if ( node.child[slot] == BVH_EMPTY_SLOT ) {
+						continue;
+					}
+
+					Aabb box;
+
+					if ( node.count[slot] > 0 ) {
+
+						for ( uint32_t item = node.child[slot]; item < node.child[slot] + node.count[slot]; item++ ) {
+
+							box.grow( bounds[_items[item]] );
+						}
+					} else {
+
+						const BvhNode& child = _nodes[node.child[slot]];
+
+						for ( int childSlot = 0; childSlot < BVH_WIDTH; childSlot++ ) {
+
+							if ( child.child[childSlot] != BVH_EMPTY_SLOT ) {
+
+								box.grow( getSlot( child, childSlot ) );
+							}
+						}
+					}
+
+					setSlot( node, slot, box );
+				}
+			}
+		});
+	}
+
+	_bounds = Aabb();
+
+	for ( int slot = 0; slot < BVH_WIDTH; slot++ ) {
+
+		if ( _nodes[0].child[slot] != BVH_EMPTY_SLOT ) {
+
+			_bounds.grow( getSlot( _nodes[0], slot ) );
+		}
+	}
+}
+
+// Box is outside when its corner farthest along a plane's normal is behind it
+void Bvh::queryPlanes( const glm::vec4* planes, int planeCount, const std::function<void( uint )>& visit ) const {
+
+	if ( _nodes.empty() ) {
+		return;
+	}
+
+	vector<uint32_t> stack = { 0 };
+
+	while ( !stack.empty() ) {
+
+		const BvhNode& node = _nodes[stack.back()];
+		bool isInside[BVH_WIDTH];
+
+		stack.pop_back();
+
+		for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+			isInside[lane] = node.child[lane] != BVH_EMPTY_SLOT;
+		}
+
+		for ( int i = 0; i < planeCount; i++ ) {
+
+			glm::vec4 plane = planes[i];
+
+			for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+				float distance = plane.x * ( plane.x > 0.f ? node.maxX[lane] : node.minX[lane] ) +
+								 plane.y * ( plane.y > 0.f ? node.maxY[lane] : node.minY[lane] ) +
+								 plane.z * ( plane.z > 0.f ? node.maxZ[lane] : node.minZ[lane] ) + plane.w;
+
+				isInside[lane] = isInside[lane] && distance >= 0.f;
+			}
+		}
+
+		for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+			if ( !isInside[lane] ) {
+				continue;
+			}
+
+			if ( node.count[lane] == 0 ) {
+
+				stack.push_back( node.child[lane] );
+				continue;
+			}
+
+			for ( uint32_t item = node.child[lane]; item < node.child[lane] + node.count[lane]; item++ ) {
+
+				visit( _items[item] );
+			}
+		}
+	}
+}
+
+void Bvh::queryBox( const Aabb& box, const std::function<void( uint )>& visit ) const {
+
+	if ( _nodes.empty() ) {
+		return;
+	}
+
+	vector<uint32_t> stack = { 0 };
+
+	while ( !stack.empty() ) {
+
+		const BvhNode& node = _nodes[stack.back()];
+		bool isOverlapping[BVH_WIDTH];
+
+		stack.pop_back();
+
+		for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+			isOverlapping[lane] = node.child[lane] != BVH_EMPTY_SLOT &&
+								  node.minX[lane] <= box.max.x && node.maxX[lane] >= box.min.x &&
+								  node.minY[lane] <= box.max.y && node.maxY[lane] >= box.min.y &&
+								  node.minZ[lane] <= box.max.z && node.maxZ[lane] >= box.min.z;
+		}
+
+		for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+			if ( !isOverlapping[lane] ) {
+				continue;
+			}
+
+			if ( node.count[lane] == 0 ) {
+
+				stack.push_back( node.child[lane] );
+				continue;
+			}
+
+			for ( uint32_t item = node.child[lane]; item < node.child[lane] + node.count[lane]; item++ ) {
+
+				visit( _items[item] );
+			}
+		}
+	}
+}
+
+// Children are visited nearest first and nodes remember their entry distance, so anything beyond
+// the closest hit found meanwhile is skipped when it's popped
+bool Bvh::raycast( const Ray& ray, const std::function<float( uint )>& intersect, uint& item, float& distance ) const {
+
+	if ( _nodes.empty() ) {
+		return false;
+	}
+
+	glm::vec3 inverse = 1.f / ray.direction;
+	float closest = ray.maxDistance;
+	bool isHit = false;
+
+	vector<std::pair<uint32_t, float>> stack = { { 0, 0.f } };
+
+	while ( !stack.empty() ) {
+
+		auto [nodeIndex, entry] = stack.back();
+		stack.pop_back();
+
+		if ( entry > closest ) {
+			continue;
+		}
+
+		const BvhNode& node = _nodes[nodeIndex];
+		float near[BVH_WIDTH];
+		bool isHitLane[BVH_WIDTH];
+
+		for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+			float x0 = ( node.minX[lane] - ray.origin.x ) * inverse.x;
+			float x1 = ( node.maxX[lane] - ray.origin.x ) * inverse.x;
+			float y0 = ( node.minY[lane] - ray.origin.y ) * inverse.y;
+			float y1 = ( node.maxY[lane] - ray.origin.y ) * inverse.y;
+			float z0 = ( node.minZ[lane] - ray.origin.z ) * inverse.z;
+			float z1 = ( node.maxZ[lane] - ray.origin.z ) * inverse.z;
+
+			near[lane] = std::max( std::max( std::min( x0, x1 ), std::min( y0, y1 ) ), std::max( std::min( z0, z1 ), 0.f ) );
+			float far = std::min( std::min( std::max( x0, x1 ), std::max( y0, y1 ) ), std::max( z0, z1 ) );
+
+			isHitLane[lane] = node.child[lane] != BVH_EMPTY_SLOT && near[lane] <= far && near[lane] <= closest;
+		}
+
+		int order[BVH_WIDTH];
+		int hitCount = 0;
+
+		for ( int lane = 0; lane < BVH_WIDTH; lane++ ) {
+
+			if ( !isHitLane[lane] ) {
+				continue;
+			}
+
+			int position = hitCount++;
+
+			for ( ; position > 0 && near[order[position - 1]] > near[lane]; position-- ) {
+
+				order[position] = order[position - 1];
+			}
+
+			order[position] = lane;
+		}
+
+		// Farthest inner child goes on the stack first
+		for ( int i = hitCount - 1; i >= 0; i-- ) {
+
+			int lane = order[i];
+
+			if ( node.count[lane] == 0 ) {
+
+				stack.push_back( { node.child[lane], near[lane] } );
+			}
+		}
+
+		for ( int i = 0; i < hitCount; i++ ) {
+
+			int lane = order[i];
+
+			if ( node.count[lane] == 0 || near[lane] > closest ) {
+				continue;
+			}
+
+			for ( uint32_t leafItem = node.child[lane]; leafItem < node.child[lane] + node.count[lane]; leafItem++ ) {
+
+				float hit = intersect( _items[leafItem] );
+
+				if ( hit >= 0.f && hit < closest ) {
+
+					closest = hit;
+					item = _items[leafItem];
+					isHit = true;
+				}
+			}
+		}
+	}
+
+	distance = closest;
+
+	return isHit;
+}
+
+// Probability of visiting a child is its area over the root's, inner children cost a visit, leaves their items
+float Bvh::getCost() const {
+
+	float rootArea = _bounds.getArea();
+
+	if ( _nodes.empty() || rootArea <= 0.f ) {
+		return 0.f;
+	}
+
+	float cost = TRAVERSAL_COST;
+
+	for ( const auto& node : _nodes ) {
+
+		for ( int slot = 0; slot < BVH_WIDTH; slot++ ) {
+
+			if ( node.child[slot] == BVH_EMPTY_SLOT ) {
+				continue;
+			}
+
+			float probability = getSlot( node, slot ).getArea() / rootArea;
+
+			cost += probability * ( node.count[slot] > 0 ? node.count[slot] : TRAVERSAL_COST );
+		}
+	}
+
+	return cost;
+}
+
+const Aabb& Bvh::getBounds() const {
+
+	return _bounds;
+}
+
+size_t Bvh::getNodeCount() const {
+
+	return _nodes.size();
+}
+
+bool Bvh::isEmpty() const {
+
+	return _nodes.empty();
+}
+
+// Rows of the view projection combined, clip space depth goes from zero to one
+void extractFrustumPlanes( const glm::mat4& viewProj, glm::vec4 planes[6] ) {
+
+	glm::vec4 rows[4];
+
+	for ( int i = 0; i < 4; i++ ) {
+
+		rows[i] = glm::vec4( viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i] );
+	}
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[2];
+	planes[5] = rows[3] - rows[2];
+
+	for ( int i = 0; i < 6; i++ ) {
+
+		planes[i] /= glm::length( glm::vec3( planes[i] ) );
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+using std::vector;
+
+struct Aabb {
+	glm::vec3 min = glm::vec3( std::numeric_limits<float>::max() );
+	glm::vec3 max = glm::vec3( -std::numeric_limits<float>::max() );
+
+	void grow( const Aabb& other );
+	void grow( glm::vec3 point );
+	glm::vec3 getCenter() const;
+	float getArea() const; // surface area, zero for empty boxes
+};
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float maxDistance = std::numeric_limits<float>::max();
+};
+
+const int BVH_WIDTH = 4;
+const uint32_t BVH_EMPTY_SLOT = UINT32_MAX;
+
+// Child boxes are stored per axis, so one node visit tests all four children with 4-wide vector math.
+// A child with a count is a leaf of that many items starting at child, otherwise it's an inner node.
+// Empty slots hold an inverted box and BVH_EMPTY_SLOT
+struct alignas( 16 ) BvhNode {
+	float minX[BVH_WIDTH];
+	float minY[BVH_WIDTH];
+	float minZ[BVH_WIDTH];
+	float maxX[BVH_WIDTH];
+	float maxY[BVH_WIDTH];
+	float maxZ[BVH_WIDTH];
+	uint32_t child[BVH_WIDTH];
+	uint32_t count[BVH_WIDTH];
+};
+
+// Bounding volume hierarchy over items given by their boxes, items are referred to by their index.
+// Built top down with binned SAH splits into a binary tree, which is collapsed into 4-wide nodes stored
+// breadth first. Moving items are handled by refit, which keeps the topology and recomputes boxes one level
+// at a time from the leaves up. Quality drops as items move away from where they were built, getCost()
+// tells when a rebuild pays off. Large builds split subtrees and refits split levels across threads
+class Bvh {
+
+	struct BuildNode;
+
+public:
+
+	void build( const vector<Aabb>& bounds );
+
+	// Bounds must hold the same items as the build
+	void refit( const vector<Aabb>& bounds );
+
+	// Items whose box isn't entirely behind one of the planes, planes point inwards
+	void queryPlanes( const glm::vec4* planes, int planeCount, const std::function<void( uint )>& visit ) const;
+	void queryBox( const Aabb& box, const std::function<void( uint )>& visit ) const;
+
+	// Closest item along the ray. Intersect tests an item whose box was hit and returns its distance,
+	// negative for a miss. Boxes farther than the closest hit so far are skipped
+	bool raycast( const Ray& ray, const std::function<float( uint )>& intersect, uint& item, float& distance ) const;
+
+	// Expected SAH cost of a random query relative to testing the root box
+	float getCost() const;
+	const Aabb& getBounds() const;
+	size_t getNodeCount() const;
+	bool isEmpty() const;
+
+private:
+
+	std::unique_ptr<BuildNode> buildRange( const vector<Aabb>& bounds, const vector<glm::vec3>& centers, uint first, uint count );
+	void collapse( const BuildNode& root );
+
+	vector<BvhNode> _nodes;
+	vector<uint32_t> _items;	  // item indices, leaves are ranges of it
+	vector<size_t> _levelStarts; // first node of every level, then the node count
+	Aabb _bounds;
+};
+
+// Planes of a zero to one depth projection, near and far included
+void extractFrustumPlanes( const glm::mat4& viewProj, glm::vec4 planes[6] );
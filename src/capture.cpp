@@ -0,0 +1,73 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "capture.hpp"
+#include "file.hpp"
+
+static_assert( std::is_trivially_copyable_v<FrameState>, "Frame states are written as raw bytes" );
+
+void writeCapture( const string& filepath, const Capture& capture ) {
+
+	std::ofstream stream( filepath, std::ios::binary | std::ios::trunc );
+
+	if ( !stream ) {
+
+		throw std::runtime_error("Capture: cannot open " + filepath);
+	}
+
+	CaptureHeader header {
+		.version = captureVersion,
+		.timestep = capture.timestep,
+		.width = capture.width,
+		.height = capture.height,
+		.msaaSamples = capture.msaaSamples,
+		.frameCount = static_cast<uint32_t>( capture.frames.size() ),
+	};
+
+	memcpy( header.magic, captureMagic, sizeof( captureMagic ) );
+
+	stream.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+	stream.write( reinterpret_cast<const char*>( capture.frames.data() ), capture.frames.size() * sizeof( FrameState ) );
+
+	if ( !stream ) {
+
+		throw std::runtime_error("Capture: failed to write " + filepath);
+	}
+}
+
+Capture readCapture( const string& filepath ) {
+
+	auto file = File::openBinary( filepath );
+
+	if ( file.getSize() < sizeof( CaptureHeader ) ) {
+
+		throw std::runtime_error("Capture: file is too small");
+	}
+
+	CaptureHeader header;
+	memcpy( &header, file.getData(), sizeof( header ) );
+
+	if ( memcmp( header.magic, captureMagic, sizeof( captureMagic ) ) != 0 || header.version != captureVersion ) {
+
+		throw std::runtime_error("Capture: unsupported file format");
+	}
+
+	if ( sizeof( header ) + header.frameCount * sizeof( FrameState ) > file.getSize() ) {
+
+		throw std::runtime_error("Capture: truncated frame data");
+	}
+
+	Capture capture {
+		.timestep = header.timestep,
+		.width = header.width,
+		.height = header.height,
+		.msaaSamples = header.msaaSamples,
+		.frames = vector<FrameState>( header.frameCount ),
+	};
+
+	memcpy( capture.frames.data(), file.getData() + sizeof( header ), header.frameCount * sizeof( FrameState ) );
+
+	return capture;
+}
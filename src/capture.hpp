@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/ext/vector_float3.hpp>
+
+using std::string, std::vector;
+
+// Capture file layout:
+//   CaptureHeader | FrameState per frame
+// Frames are stored as is, a capture is only replayed on the machine architecture it was made on
+
+const char captureMagic[4] = { 'O', 'D', 'C', 'P' };
+const uint32_t captureVersion = 2;
+
+const uint32_t FRAME_DEPTH_PREPASS = 1 << 0;
+const uint32_t FRAME_BLOOM_OFF = 1 << 1;	// post effects are on unless flagged off
+const uint32_t FRAME_TONEMAP_OFF = 1 << 2;
+const uint32_t FRAME_FXAA_OFF = 1 << 3;
+const uint32_t FRAME_OCCLUSION_CULLING_OFF = 1 << 4;
+
+// Everything that decides what a frame renders, the same state always renders the same image
+struct FrameState {
+	float time;			// scene time driving animation and lights
+	glm::vec3 eyePos;
+	glm::vec3 targetPos;
+	uint32_t flags;
+	float maxAnisotropy;
+};
+
+struct CaptureHeader {
+	char magic[4];
+	uint32_t version;
+	float timestep;
+	uint32_t width;
+	uint32_t height;
+	uint32_t msaaSamples;
+	uint32_t frameCount;
+};
+
+struct Capture {
+	float timestep;
+	uint32_t width;
+	uint32_t height;
+	uint32_t msaaSamples; // requested, replays ask for the same count
+	vector<FrameState> frames;
+};
+
+void writeCapture( const string& filepath, const Capture& capture );
+Capture readCapture( const string& filepath );
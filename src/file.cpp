@@ -1,30 +1,102 @@
+#include <fcntl.h>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "file.hpp"
 
-File File::openBinary( const string& filepath ) {
+static int toAdvice( File::Access access ) {
 
-	ifstream stream( filepath, iostream::ate | iostream::binary );
+	switch ( access ) {
+		case File::Access::Sequential:
+			return MADV_SEQUENTIAL;
+		case File::Access::WillNeed:
+			return MADV_WILLNEED;
+		case File::Access::Random:
+			return MADV_RANDOM;
+	}
+
+	return MADV_NORMAL;
+}
+
+File File::openBinary( const string& filepath, Access access ) {
+
+	int fd = open( filepath.c_str(), O_RDONLY | O_CLOEXEC );
 
-	if ( !stream.is_open() ) {
+	if ( fd < 0 ) {
 		throw std::runtime_error("Failed to open file");
 	}
 
-	// Look for file size
-	File file( stream.tellg(), filepath );
-	stream.close();
+	struct stat fileStat;
+
+	if ( fstat( fd, &fileStat ) != 0 ) {
+
+		::close( fd );
+		throw std::runtime_error("Failed to read file size");
+	}
+
+	size_t size = fileStat.st_size;
+
+	// Empty files can't be mapped
+	if ( size == 0 ) {
+
+		::close( fd );
+		return File( nullptr, 0 );
+	}
+
+	void *data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+	// Mapping keeps its own reference to the file
+	::close( fd );
+
+	if ( data == MAP_FAILED ) {
+		throw std::runtime_error("Failed to map file");
+	}
+
+	madvise( data, size, toAdvice( access ) );
 
-	return file;
+	return File( static_cast<const char*>( data ), size );
 }
 
-void File::readBinary( int count, char *data) {
+File::File( File&& other ) : _data(other._data), _size(other._size) {
 
-	ifstream stream( _filepath, iostream::binary );
-	
-	stream.read( data, count );
-	stream.close();
+	other._data = nullptr;
+	other._size = 0;
+}
+
+File& File::operator=( File&& other ) {
+
+	if ( this != &other ) {
+
+		close();
+
+		_data = other._data;
+		_size = other._size;
+
+		other._data = nullptr;
+		other._size = 0;
+	}
+
+	return *this;
+}
+
+File::~File() {
+
+	close();
+}
+
+void File::close() {
+
+	if ( _data ) {
+
+		munmap( const_cast<char*>( _data ), _size );
+
+		_data = nullptr;
+		_size = 0;
+	}
 }
 
-void File::close() {}
+const char* File::getData() const { return _data; }
 
-int File::getSize() { return _size; }
\ No newline at end of file
+size_t File::getSize() const { return _size; }
@@ -1,25 +1,39 @@
 #pragma once
 
-#include <fstream>
-#include <istream>
+#include <cstddef>
+#include <string>
 
-using std::istream, std::ifstream, std::iostream, std::string;
+using std::string;
 
+// Read-only memory mapped file, the mapping lives as long as the object
 class File {
 
 public:
 
+	// Access pattern hint passed to madvise
+	enum class Access {
+		Sequential,
+		WillNeed,
+		Random
+	};
+
+	File( File&& other );
+	File( const File& ) = delete;
+	File& operator=( File&& other );
+	File& operator=( const File& ) = delete;
+	~File();
+
 	void close();
-	void readBinary( int count, char *data );
 
-	int getSize();
+	const char* getData() const;
+	size_t getSize() const;
 
-	static File openBinary( const string& filepath );
+	static File openBinary( const string& filepath, Access access = Access::Sequential );
 
 private:
 
-	File( int size, string filepath ) : _size(size), _filepath(filepath) {}
+	File( const char *data, size_t size ) : _data(data), _size(size) {}
 
-	int _size;
-	string _filepath;
-};
\ No newline at end of file
+	const char *_data;
+	size_t _size;
+};
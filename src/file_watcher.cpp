@@ -0,0 +1,131 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "file_watcher.hpp"
+
+FileWatcher::~FileWatcher() {
+
+	stop();
+}
+
+bool FileWatcher::watch( const string& directory ) {
+
+	if ( _inotifyFd < 0 ) {
+
+		_inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+		if ( _inotifyFd < 0 ) {
+
+			throw std::runtime_error("Failed to initialize inotify");
+		}
+	}
+
+	// Editors and build tools often replace files instead of writing them in place
+	int wd = inotify_add_watch( _inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+
+	if ( wd < 0 ) {
+
+		return false;
+	}
+
+	_directories[wd] = directory;
+
+	return true;
+}
+
+void FileWatcher::start( std::function<void( const string& )> onChange ) {
+
+	if ( _inotifyFd < 0 || _thread.joinable() ) {
+
+		return;
+	}
+
+	_wakeFd = eventfd( 0, EFD_CLOEXEC );
+
+	if ( _wakeFd < 0 ) {
+
+		throw std::runtime_error("Failed to create file watcher wake event");
+	}
+
+	_onChange = onChange;
+	_thread = std::thread( &FileWatcher::run, this );
+}
+
+void FileWatcher::stop() {
+
+	if ( _thread.joinable() ) {
+
+		uint64_t wake = 1;
+		[[maybe_unused]] auto written = write( _wakeFd, &wake, sizeof( wake ) );
+
+		_thread.join();
+	}
+
+	if ( _wakeFd >= 0 ) {
+
+		close( _wakeFd );
+		_wakeFd = -1;
+	}
+
+	if ( _inotifyFd >= 0 ) {
+
+		close( _inotifyFd );
+		_inotifyFd = -1;
+	}
+
+	_directories.clear();
+}
+
+void FileWatcher::run() {
+
+	alignas( inotify_event ) char buffer[sizeof( inotify_event ) + NAME_MAX + 1];
+
+	pollfd fds[] = {
+		{ .fd = _inotifyFd, .events = POLLIN },
+		{ .fd = _wakeFd, .events = POLLIN },
+	};
+
+	while ( true ) {
+
+		if ( poll( fds, 2, -1 ) < 0 ) {
+
+			// Only an interrupted wait is retried, any other error would fail again right away
+			if ( errno == EINTR ) {
+				continue;
+			}
+
+			std::cerr << "File watcher stopped: " << strerror( errno ) << std::endl;
+			return;
+		}
+
+		if ( fds[1].revents & POLLIN ) {
+
+			return;
+		}
+
+		ssize_t length;
+
+		while ( ( length = read( _inotifyFd, buffer, sizeof( buffer ) ) ) > 0 ) {
+
+			for ( char *ptr = buffer; ptr < buffer + length; ) {
+
+				auto event = reinterpret_cast<const inotify_event*>( ptr );
+				ptr += sizeof( inotify_event ) + event->len;
+
+				auto it = _directories.find( event->wd );
+
+				if ( event->len > 0 && it != _directories.end() ) {
+
+					_onChange( it->second + "/" + event->name );
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+
+using std::string;
+
+// Watches directories with inotify on a background thread.
+// Callback runs on that thread and receives paths in form "<directory>/<file name>"
+class FileWatcher {
+
+public:
+
+	FileWatcher() {}
+	FileWatcher( const FileWatcher& ) = delete;
+	FileWatcher& operator=( const FileWatcher& ) = delete;
+	~FileWatcher();
+
+	// Returns false if directory can't be watched (e.g. it doesn't exist)
+	bool watch( const string& directory );
+
+	void start( std::function<void( const string& )> onChange );
+	void stop();
+
+private:
+
+	void run();
+
+	int _inotifyFd = -1;
+	int _wakeFd = -1;
+	std::map<int, string> _directories;
+	std::function<void( const string& )> _onChange;
+	std::thread _thread;
+};
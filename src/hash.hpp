@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+const uint64_t fnvOffsetBasis = 0xcbf29ce484222325ull;
+const uint64_t fnvPrime = 0x100000001b3ull;
+
+// FNV-1a, seed allows hashing several pieces of data into a single value
+inline uint64_t fnv1a( const void *data, size_t size, uint64_t seed = fnvOffsetBasis ) {
+
+	auto bytes = static_cast<const unsigned char*>( data );
+	uint64_t hash = seed;
+
+	for ( size_t i = 0; i < size; i++ ) {
+
+		hash ^= bytes[i];
+		hash *= fnvPrime;
+	}
+
+	return hash;
+}
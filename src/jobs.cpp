@@ -0,0 +1,213 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+
+// Pool the calling thread belongs to, and its queue there
+thread_local const JobSystem* t_jobSystem = nullptr;
+thread_local size_t t_queue = 0;
+
+bool JobCounter::isDone() const {
+
+	return _pending.load( std::memory_order_acquire ) == 0;
+}
+
+JobSystem::JobSystem( size_t threadCount ) {
+
+	_queues.push_back( std::make_unique<Queue>() );
+
+	for ( size_t i = 0; i < threadCount; i++ ) {
+
+		_queues.push_back( std::make_unique<Queue>() );
+	}
+
+	for ( size_t i = 0; i < threadCount; i++ ) {
+
+		_threads.emplace_back( &JobSystem::workerLoop, this, i + 1 );
+	}
+}
+
+// Queued jobs are run to completion before the workers exit
+JobSystem::~JobSystem() {
+
+	{
+		std::lock_guard<std::mutex> lock( _sleepMutex );
+		_isStopping = true;
+	}
+
+	_wake.notify_all();
+
+	for ( auto& thread : _threads ) {
+
+		thread.join();
+	}
+
+	while ( runQueued( 0 ) );
+}
+
+JobSystem& JobSystem::get() {
+
+	static JobSystem jobSystem( std::max( std::thread::hardware_concurrency(), 1u ) - 1 );
+
+	return jobSystem;
+}
+
+void JobSystem::run( Job job, JobCounter* counter ) {
+
+	if ( counter ) {
+
+		counter->_pending.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	schedule( { std::move( job ), counter } );
+}
+
+// Dependency's lock orders this against finish(), so the job is either held or scheduled right away
+void JobSystem::runAfter( JobCounter& dependency, Job job, JobCounter* counter ) {
+
+	if ( counter ) {
+
+		counter->_pending.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( dependency._mutex );
+
+		if ( dependency._pending.load( std::memory_order_acquire ) > 0 ) {
+
+			dependency._continuations.push_back( { std::move( job ), counter } );
+			return;
+		}
+	}
+
+	schedule( { std::move( job ), counter } );
+}
+
+void JobSystem::wait( JobCounter& counter ) {
+
+	size_t queue = getQueue();
+
+	while ( !counter.isDone() ) {
+
+		if ( !runQueued( queue ) ) {
+
+			std::this_thread::yield();
+		}
+	}
+
+	// Last job may still be releasing the lock, the counter can go out of scope once it has
+	std::lock_guard<std::mutex> lock( counter._mutex );
+}
+
+size_t JobSystem::getThreadCount() const {
+
+	return _queues.size();
+}
+
+void JobSystem::schedule( JobCounter::Continuation job ) {
+
+	Queue& queue = *_queues[getQueue()];
+
+	{
+		std::lock_guard<std::mutex> lock( queue.mutex );
+		queue.jobs.push_back( std::move( job ) );
+	}
+
+	_queuedJobs.fetch_add( 1, std::memory_order_release );
+
+	// Taking the sleep lock keeps a worker from missing the wake up between checking and sleeping
+	{
+		std::lock_guard<std::mutex> lock( _sleepMutex );
+	}
+
+	_wake.notify_one();
+}
+
+// Own queue is taken from the back, newest jobs have the hottest data. Others are stolen from the front,
+// oldest jobs tend to be the largest, which keeps steals rare
+bool JobSystem::runQueued( size_t queue ) {
+
+	JobCounter::Continuation job;
+	bool isFound = false;
+
+	for ( size_t i = 0; i < _queues.size() && !isFound; i++ ) {
+
+		Queue& victim = *_queues[( queue + i ) % _queues.size()];
+		std::lock_guard<std::mutex> lock( victim.mutex );
+
+		if ( victim.jobs.empty() ) {
+			continue;
+		}
+
+		if ( i == 0 ) {
+
+			job = std::move( victim.jobs.back() );
+			victim.jobs.pop_back();
+		} else {
+
+			job = std::move( victim.jobs.front() );
+			victim.jobs.pop_front();
+		}
+
+		isFound = true;
+	}
+
+	if ( !isFound ) {
+		return false;
+	}
+
+	_queuedJobs.fetch_sub( 1, std::memory_order_relaxed );
+
+	job.job();
+	finish( job.counter );
+
+	return true;
+}
+
+void JobSystem::finish( JobCounter* counter ) {
+
+	if ( !counter ) {
+		return;
+	}
+
+	vector<JobCounter::Continuation> continuations;
+
+	{
+		std::lock_guard<std::mutex> lock( counter->_mutex );
+
+		if ( counter->_pending.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+
+			continuations.swap( counter->_continuations );
+		}
+	}
+
+	for ( auto& continuation : continuations ) {
+
+		schedule( std::move( continuation ) );
+	}
+}
+
+void JobSystem::workerLoop( size_t queue ) {
+
+	t_jobSystem = this;
+	t_queue = queue;
+
+	while ( true ) {
+
+		if ( runQueued( queue ) ) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock( _sleepMutex );
+
+		_wake.wait( lock, [this] { return _isStopping || _queuedJobs.load( std::memory_order_acquire ) > 0; } );
+
+		if ( _isStopping && _queuedJobs.load( std::memory_order_acquire ) == 0 ) {
+			return;
+		}
+	}
+}
+
+size_t JobSystem::getQueue() const {
+
+	return t_jobSystem == this ? t_queue : 0;
+}
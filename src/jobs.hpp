@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+using Job = std::function<void()>;
+
+// Counts jobs that haven't finished yet. Jobs scheduled after a counter start once it reaches zero
+class JobCounter {
+
+	friend class JobSystem;
+
+	struct Continuation {
+		Job job;
+		JobCounter* counter;
+	};
+
+public:
+
+	bool isDone() const;
+
+private:
+
+	std::atomic<int> _pending = 0;
+	std::mutex _mutex;
+	vector<Continuation> _continuations;
+};
+
+// Worker threads, one per core besides the calling thread, each with its own deque of jobs. A worker takes
+// its newest job first and, when it runs out, steals the oldest job of another worker. Threads outside the
+// pool share one deque. Waiting on a counter runs queued jobs instead of blocking, so jobs can wait on jobs
+// they scheduled. Jobs must not throw
+class JobSystem {
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<JobCounter::Continuation> jobs;
+	};
+
+public:
+
+	explicit JobSystem( size_t threadCount );
+	~JobSystem();
+
+	JobSystem( const JobSystem& ) = delete;
+	JobSystem& operator=( const JobSystem& ) = delete;
+
+	// Engine wide pool, started on first use
+	static JobSystem& get();
+
+	// Counter, when given, counts the job until it finishes
+	void run( Job job, JobCounter* counter = nullptr );
+
+	// Job is held back until dependency reaches zero
+	void runAfter( JobCounter& dependency, Job job, JobCounter* counter = nullptr );
+
+	// Runs queued jobs on the calling thread until the counter reaches zero
+	void wait( JobCounter& counter );
+
+	// Worker threads and the calling thread
+	size_t getThreadCount() const;
+
+private:
+
+	void schedule( JobCounter::Continuation job );
+	bool runQueued( size_t queue );
+	void finish( JobCounter* counter );
+	void workerLoop( size_t queue );
+	size_t getQueue() const;
+
+	vector<std::unique_ptr<Queue>> _queues; // first is shared by threads outside the pool
+	vector<std::thread> _threads;
+	std::atomic<int> _queuedJobs = 0;
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+	bool _isStopping = false;
+};
+
+// Waits on the counter when the scope is left, also by an exception, so jobs referring to locals of the
+// scope are done before they go away
+class JobWaitGuard {
+
+public:
+
+	JobWaitGuard( JobSystem& jobs, JobCounter& counter ) : _jobs(jobs), _counter(counter) {}
+	~JobWaitGuard() { _jobs.wait( _counter ); }
+
+	JobWaitGuard( const JobWaitGuard& ) = delete;
+	JobWaitGuard& operator=( const JobWaitGuard& ) = delete;
+
+private:
+
+	JobSystem& _jobs;
+	JobCounter& _counter;
+};
@@ -1,24 +1,113 @@
+#include <exception>
 #include <iostream>
+#include <string>
 
 #include "application.hpp"
 
-int main() {
+// --fixed-step <seconds> --frames <count> --msaa <samples> --capture <file> --replay <file> --report <file>
+bool parseOptions( int argc, char *argv[], RunOptions& options ) {
 
-	Application app( "Hello, Devil Hunter!" );
+	for ( int i = 1; i < argc; i++ ) {
 
-	bool success = app.init();
+		std::string option = argv[i];
+
+		if ( i + 1 == argc ) {
+
+			return false;
+		}
+
+		const char *value = argv[++i];
+
+		if ( option == "--fixed-step" ) {
+
+			options.fixedTimestep = std::stof( value );
+		} else if ( option == "--frames" ) {
+
+			options.frameCount = std::stoi( value );
+		} else if ( option == "--msaa" ) {
+
+			options.msaaSamples = std::stoi( value );
+
+			if ( options.msaaSamples != 1 && options.msaaSamples != 2 && options.msaaSamples != 4 && options.msaaSamples != 8 ) {
+
+				return false;
+			}
+		} else if ( option == "--capture" ) {
+
+			options.capturePath = value;
+		} else if ( option == "--replay" ) {
+
+			options.replayPath = value;
+		} else if ( option == "--report" ) {
+
+			options.reportPath = value;
+		} else {
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Malformed or out of range numbers are reported like any other bad option
+bool tryParseOptions( int argc, char *argv[], RunOptions& options ) {
+
+	try {
+
+		return parseOptions( argc, argv, options );
+	} catch ( const std::exception& ) {
+
+		return false;
+	}
+}
+
+int main( int argc, char *argv[] ) {
+
+	RunOptions options;
+
+	if ( !tryParseOptions( argc, argv, options ) ) {
+
+		std::cout << "Usage: " << argv[0] << " [--fixed-step <seconds>] [--frames <count>] [--msaa <samples>]"
+				  << " [--capture <file>] [--replay <file> [--report <file>]]" << std::endl;
+		return 1;
+	}
+
+	Application app( "Hello, Devil Hunter!", options );
+
+	if ( !app.init() ) {
+
+		std::cout << "Initialization failed" << std::endl;
+		return 1;
+	}
 
 	std::cout << "Window created successfully" << std::endl;
 
+	// Input and simulation stay on this thread, the window's events have to be polled where it was created.
+	// Frames are drawn on a render thread, so waiting on the GPU doesn't hold up input
+	app.startRendering();
+
 	while ( !app.isQuit() ) {
 
 		app.pollEvents();
-		app.drawFrame();
+		app.simulateFrame();
+	}
+
+	// Error that stopped the render thread is rethrown here, resources are released either way
+	int result = 0;
+
+	try {
+
+		app.stopRendering();
+	} catch ( const std::exception& e ) {
+
+		std::cout << "Rendering failed: " << e.what() << std::endl;
+		result = 1;
 	}
 
 	// make sure device is idling before releasing any resources
 	app.deviceWaitIdle();
 	app.release();
 
-	return 0;
-}
\ No newline at end of file
+	return result;
+}
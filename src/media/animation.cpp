@@ -0,0 +1,152 @@
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
+
+#include "animation.hpp"
+
+void Pose::resize( size_t jointCount ) {
+
+	for ( auto lane : { &tx, &ty, &tz, &rx, &ry, &rz, &rw, &sx, &sy, &sz } ) {
+
+		lane->resize( jointCount );
+	}
+}
+
+size_t Pose::size() const {
+
+	return tx.size();
+}
+
+void Pose::setJoint( size_t joint, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale ) {
+
+	tx[joint] = translation.x;
+	ty[joint] = translation.y;
+	tz[joint] = translation.z;
+
+	rx[joint] = rotation.x;
+	ry[joint] = rotation.y;
+	rz[joint] = rotation.z;
+	rw[joint] = rotation.w;
+
+	sx[joint] = scale.x;
+	sy[joint] = scale.y;
+	sz[joint] = scale.z;
+}
+
+size_t Skeleton::size() const {
+
+	return parents.size();
+}
+
+int Skeleton::findJoint( const string& name ) const {
+
+	auto it = std::find( jointNames.begin(), jointNames.end(), name );
+
+	return it == jointNames.end() ? -1 : it - jointNames.begin();
+}
+
+static glm::quat nlerp( glm::quat a, glm::quat b, float t ) {
+
+	if ( glm::dot( a, b ) < 0.f ) {
+
+		b = -b;
+	}
+
+	return glm::normalize( a * ( 1.f - t ) + b * t );
+}
+
+static void lerpLane( const vector<float>& a, const vector<float>& b, float weight, vector<float>& out ) {
+
+	size_t count = a.size();
+
+	for ( size_t i = 0; i < count; i++ ) {
+
+		out[i] = a[i] + ( b[i] - a[i] ) * weight;
+	}
+}
+
+void blendPoses( const Pose& a, const Pose& b, float weight, Pose& out ) {
+
+	size_t count = a.size();
+	out.resize( count );
+
+	lerpLane( a.tx, b.tx, weight, out.tx );
+	lerpLane( a.ty, b.ty, weight, out.ty );
+	lerpLane( a.tz, b.tz, weight, out.tz );
+	lerpLane( a.sx, b.sx, weight, out.sx );
+	lerpLane( a.sy, b.sy, weight, out.sy );
+	lerpLane( a.sz, b.sz, weight, out.sz );
+
+	size_t i = 0;
+
+#ifdef __SSE2__
+	// Four joints per iteration, hemisphere check is a sign flip of b's weight instead of a branch
+	const __m128 signBit = _mm_set1_ps( -0.f );
+	const __m128 weightA = _mm_set1_ps( 1.f - weight );
+	const __m128 weightB = _mm_set1_ps( weight );
+	const __m128 zero = _mm_setzero_ps();
+
+	for ( ; i + 4 <= count; i += 4 ) {
+
+		__m128 ax = _mm_loadu_ps( &a.rx[i] ), ay = _mm_loadu_ps( &a.ry[i] ), az = _mm_loadu_ps( &a.rz[i] ), aw = _mm_loadu_ps( &a.rw[i] );
+		__m128 bx = _mm_loadu_ps( &b.rx[i] ), by = _mm_loadu_ps( &b.ry[i] ), bz = _mm_loadu_ps( &b.rz[i] ), bw = _mm_loadu_ps( &b.rw[i] );
+
+		__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), 
+								 _mm_add_ps( _mm_mul_ps( az, bz ), _mm_mul_ps( aw, bw ) ) );
+
+		__m128 signedWeightB = _mm_xor_ps( weightB, _mm_and_ps( _mm_cmplt_ps( dot, zero ), signBit ) );
+
+		__m128 ox = _mm_add_ps( _mm_mul_ps( ax, weightA ), _mm_mul_ps( bx, signedWeightB ) );
+		__m128 oy = _mm_add_ps( _mm_mul_ps( ay, weightA ), _mm_mul_ps( by, signedWeightB ) );
+		__m128 oz = _mm_add_ps( _mm_mul_ps( az, weightA ), _mm_mul_ps( bz, signedWeightB ) );
+		__m128 ow = _mm_add_ps( _mm_mul_ps( aw, weightA ), _mm_mul_ps( bw, signedWeightB ) );
+
+		__m128 lengthSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, ox ), _mm_mul_ps( oy, oy ) ), 
+									  _mm_add_ps( _mm_mul_ps( oz, oz ), _mm_mul_ps( ow, ow ) ) );
+
+		__m128 invLength = _mm_div_ps( _mm_set1_ps( 1.f ), _mm_sqrt_ps( lengthSq ) );
+
+		_mm_storeu_ps( &out.rx[i], _mm_mul_ps( ox, invLength ) );
+		_mm_storeu_ps( &out.ry[i], _mm_mul_ps( oy, invLength ) );
+		_mm_storeu_ps( &out.rz[i], _mm_mul_ps( oz, invLength ) );
+		_mm_storeu_ps( &out.rw[i], _mm_mul_ps( ow, invLength ) );
+	}
+#endif
+
+	for ( ; i < count; i++ ) {
+
+		auto rotation = nlerp( 
+			glm::quat( a.rw[i], a.rx[i], a.ry[i], a.rz[i] ), 
+			glm::quat( b.rw[i], b.rx[i], b.ry[i], b.rz[i] ), weight );
+
+		out.rx[i] = rotation.x;
+		out.ry[i] = rotation.y;
+		out.rz[i] = rotation.z;
+		out.rw[i] = rotation.w;
+	}
+}
+
+void computeSkinningPalette( const Skeleton& skeleton, const Pose& pose, vector<glm::mat4>& globalTransforms, glm::mat4 *palette ) {
+
+	size_t count = skeleton.size();
+	globalTransforms.resize( count );
+
+	for ( size_t joint = 0; joint < count; joint++ ) {
+
+		glm::quat rotation( pose.rw[joint], pose.rx[joint], pose.ry[joint], pose.rz[joint] );
+
+		glm::mat4 local = glm::mat4_cast( rotation );
+
+		local[0] *= pose.sx[joint];
+		local[1] *= pose.sy[joint];
+		local[2] *= pose.sz[joint];
+		local[3] = glm::vec4( pose.tx[joint], pose.ty[joint], pose.tz[joint], 1.f );
+
+		int parent = skeleton.parents[joint];
+
+		globalTransforms[joint] = parent < 0 ? local : globalTransforms[parent] * local;
+		palette[joint] = globalTransforms[joint] * skeleton.inverseBindMatrices[joint];
+	}
+}
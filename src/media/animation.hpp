@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+using std::string, std::vector;
+
+// Joint indices are stored as 8 bit per vertex, joint palettes are laid out with this stride per instance
+const int MAX_JOINTS = 256;
+
+// Local joint transforms in structure of arrays layout, so blending works on whole lanes of joints
+struct Pose {
+	vector<float> tx, ty, tz;
+	vector<float> rx, ry, rz, rw;
+	vector<float> sx, sy, sz;
+
+	void resize( size_t jointCount );
+	size_t size() const;
+
+	void setJoint( size_t joint, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale );
+};
+
+struct Skeleton {
+	vector<string> jointNames;
+	vector<int> parents;                   // parent always precedes its children, -1 for roots
+	vector<glm::mat4> inverseBindMatrices; // mesh space to joint space
+	Pose bindPose;
+
+	size_t size() const;
+	int findJoint( const string& name ) const;
+};
+
+// Keys of a single joint, empty channel means the joint stays in bind pose for that component
+struct JointTrack {
+	vector<float> positionTimes;
+	vector<glm::vec3> positions;
+	vector<float> rotationTimes;
+	vector<glm::quat> rotations;
+	vector<float> scaleTimes;
+	vector<glm::vec3> scales;
+};
+
+struct AnimationClip {
+	string name;
+	float duration; // seconds
+	vector<JointTrack> tracks; // one per skeleton joint
+};
+
+// Linear blend of translation and scale, normalized lerp with hemisphere correction for rotation. Out may be a
+void blendPoses( const Pose& a, const Pose& b, float weight, Pose& out );
+
+// Writes skeleton.size() matrices of (global joint transform * inverse bind) into palette
+void computeSkinningPalette( const Skeleton& skeleton, const Pose& pose, vector<glm::mat4>& globalTransforms, glm::mat4 *palette );
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "compressed_animation.hpp"
+
+const float quantizedMax = 65535.f;
+const float rotationComponentMax = 32767.f;
+const float invSqrt2 = 0.70710678f;
+
+static uint16_t quantizeTime( float time, float duration ) {
+
+	if ( duration <= 0.f ) {
+
+		return 0;
+	}
+
+	return static_cast<uint16_t>( std::round( std::clamp( time / duration, 0.f, 1.f ) * quantizedMax ) );
+}
+
+static float dequantizeTime( uint16_t time, float duration ) {
+
+	return time / quantizedMax * duration;
+}
+
+static float rotationError( const glm::quat& a, const glm::quat& b ) {
+
+	return 2.f * std::acos( std::min( 1.f, std::abs( glm::dot( a, b ) ) ) );
+}
+
+static glm::quat nlerp( glm::quat a, glm::quat b, float t ) {
+
+	if ( glm::dot( a, b ) < 0.f ) {
+
+		b = -b;
+	}
+
+	return glm::normalize( a * ( 1.f - t ) + b * t );
+}
+
+// Greedy linear reduction: from each kept key, extend the segment while every skipped key
+// is reproduced by interpolation within tolerance. Returns indices of kept keys.
+template<typename T, typename Interpolate, typename Error>
+static vector<size_t> reduceKeys( const vector<float>& times, const vector<T>& values, float tolerance, Interpolate interpolate, Error error ) {
+
+	size_t count = times.size();
+	vector<size_t> kept = { 0 };
+
+	if ( count < 2 ) {
+
+		return kept;
+	}
+
+	size_t anchor = 0;
+
+	for ( size_t end = 2; end < count; end++ ) {
+
+		bool fits = true;
+
+		for ( size_t k = anchor + 1; k < end && fits; k++ ) {
+
+			float t = ( times[k] - times[anchor] ) / ( times[end] - times[anchor] );
+			fits = error( interpolate( values[anchor], values[end], t ), values[k] ) <= tolerance;
+		}
+
+		if ( !fits ) {
+
+			anchor = end - 1;
+			kept.push_back( anchor );
+		}
+	}
+
+	kept.push_back( count - 1 );
+
+	// Constant channel collapses into a single key
+	if ( kept.size() == 2 && error( values[0], values[count - 1] ) <= tolerance ) {
+
+		kept.pop_back();
+	}
+
+	return kept;
+}
+
+static void encodeRotation( glm::quat rotation, uint16_t *out ) {
+
+	float components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+
+	int largest = 0;
+
+	for ( int i = 1; i < 4; i++ ) {
+
+		if ( std::abs( components[i] ) > std::abs( components[largest] ) ) {
+			largest = i;
+		}
+	}
+
+	// q and -q are the same rotation, so the dropped component can always be made positive
+	float sign = components[largest] < 0.f ? -1.f : 1.f;
+	uint16_t encoded[3];
+
+	for ( int i = 0, j = 0; i < 4; i++ ) {
+
+		if ( i == largest ) {
+			continue;
+		}
+
+		float normalized = std::clamp( components[i] * sign / invSqrt2 * 0.5f + 0.5f, 0.f, 1.f );
+		encoded[j++] = static_cast<uint16_t>( std::round( normalized * rotationComponentMax ) );
+	}
+
+	out[0] = encoded[0] | ( ( largest >> 1 ) << 15 );
+	out[1] = encoded[1] | ( ( largest & 1 ) << 15 );
+	out[2] = encoded[2];
+}
+
+static void decodeRotation( const uint16_t *value, float *out ) {
+
+	int largest = ( ( value[0] >> 15 ) << 1 ) | ( value[1] >> 15 );
+	float sumSq = 0.f;
+
+	for ( int i = 0, j = 0; i < 4; i++ ) {
+
+		if ( i == largest ) {
+			continue;
+		}
+
+		float component = ( ( value[j++] & 0x7FFF ) / rotationComponentMax * 2.f - 1.f ) * invSqrt2;
+
+		out[i] = component;
+		sumSq += component * component;
+	}
+
+	out[largest] = std::sqrt( std::max( 0.f, 1.f - sumSq ) );
+}
+
+static TrackRange findRange( const vector<glm::vec3>& values, const vector<size_t>& kept ) {
+
+	glm::vec3 minValue( std::numeric_limits<float>::max() );
+	glm::vec3 maxValue( std::numeric_limits<float>::lowest() );
+
+	for ( size_t index : kept ) {
+
+		minValue = glm::min( minValue, values[index] );
+		maxValue = glm::max( maxValue, values[index] );
+	}
+
+	return {
+		{ minValue.x, minValue.y, minValue.z },
+		{ maxValue.x - minValue.x, maxValue.y - minValue.y, maxValue.z - minValue.z },
+	};
+}
+
+static void encodeVector( const glm::vec3& vector, const TrackRange& range, uint16_t *out ) {
+
+	for ( int i = 0; i < 3; i++ ) {
+
+		float normalized = range.extent[i] > 0.f ? ( vector[i] - range.min[i] ) / range.extent[i] : 0.f;
+		out[i] = static_cast<uint16_t>( std::round( std::clamp( normalized, 0.f, 1.f ) * quantizedMax ) );
+	}
+}
+
+static void decodeVector( const uint16_t *value, const TrackRange& range, float *out ) {
+
+	for ( int i = 0; i < 3; i++ ) {
+
+		out[i] = range.min[i] + value[i] / quantizedMax * range.extent[i];
+	}
+}
+
+struct PendingKey {
+	uint16_t needTime;
+	CompressedKey key;
+};
+
+// Appends kept keys of a channel, each key is needed as soon as sampling passes its predecessor
+template<typename Encode>
+static void appendKeys( const vector<float>& times, const vector<size_t>& kept, float duration, Encode encode, vector<PendingKey>& keys ) {
+
+	uint16_t previousTime = 0;
+
+	for ( size_t index : kept ) {
+
+		uint16_t time = quantizeTime( times[index], duration );
+
+		keys.push_back({ previousTime, encode( index, time ) });
+		previousTime = time;
+	}
+}
+
+CompressedClip compressClip( const AnimationClip& clip, const CompressionSettings& settings ) {
+
+	CompressedClip compressed {
+		.name = clip.name,
+		.duration = clip.duration,
+		.ranges = vector<TrackRange>( clip.tracks.size() * channelsPerJoint, TrackRange {} ),
+	};
+
+	auto lerpVec = [] ( const glm::vec3& a, const glm::vec3& b, float t ) { return glm::mix( a, b, t ); };
+	auto vecError = [] ( const glm::vec3& a, const glm::vec3& b ) { return glm::length( a - b ); };
+
+	vector<PendingKey> keys;
+
+	for ( size_t joint = 0; joint < clip.tracks.size(); joint++ ) {
+
+		const auto& source = clip.tracks[joint];
+
+		uint16_t translationTrack = joint * channelsPerJoint + static_cast<uint16_t>( TrackChannel::Translation );
+		uint16_t rotationTrack = joint * channelsPerJoint + static_cast<uint16_t>( TrackChannel::Rotation );
+		uint16_t scaleTrack = joint * channelsPerJoint + static_cast<uint16_t>( TrackChannel::Scale );
+
+		if ( !source.positions.empty() ) {
+
+			auto kept = reduceKeys( source.positionTimes, source.positions, settings.translationTolerance, lerpVec, vecError );
+			auto& range = compressed.ranges[translationTrack] = findRange( source.positions, kept );
+
+			appendKeys( source.positionTimes, kept, clip.duration, [&] ( size_t index, uint16_t time ) {
+
+				CompressedKey key { .track = translationTrack, .time = time };
+				encodeVector( source.positions[index], range, key.value );
+
+				return key;
+			}, keys );
+		}
+
+		if ( !source.rotations.empty() ) {
+
+			auto kept = reduceKeys( source.rotationTimes, source.rotations, settings.rotationTolerance, nlerp, rotationError );
+
+			appendKeys( source.rotationTimes, kept, clip.duration, [&] ( size_t index, uint16_t time ) {
+
+				CompressedKey key { .track = rotationTrack, .time = time };
+				encodeRotation( glm::normalize( source.rotations[index] ), key.value );
+
+				return key;
+			}, keys );
+		}
+
+		if ( !source.scales.empty() ) {
+
+			auto kept = reduceKeys( source.scaleTimes, source.scales, settings.scaleTolerance, lerpVec, vecError );
+			auto& range = compressed.ranges[scaleTrack] = findRange( source.scales, kept );
+
+			appendKeys( source.scaleTimes, kept, clip.duration, [&] ( size_t index, uint16_t time ) {
+
+				CompressedKey key { .track = scaleTrack, .time = time };
+				encodeVector( source.scales[index], range, key.value );
+
+				return key;
+			}, keys );
+		}
+	}
+
+	// Stable sort keeps keys of the same track in time order
+	std::stable_sort( keys.begin(), keys.end(), [] ( const PendingKey& a, const PendingKey& b ) { return a.needTime < b.needTime; } );
+
+	compressed.stream.reserve( keys.size() );
+
+	for ( const auto& pending : keys ) {
+
+		compressed.stream.push_back( pending.key );
+	}
+
+	return compressed;
+}
+
+size_t CompressedClip::getMemorySize() const {
+
+	return sizeof( CompressedClip ) + name.size() +
+		   ranges.size() * sizeof( TrackRange ) +
+		   stream.size() * sizeof( CompressedKey );
+}
+
+void ClipSampler::rewind( const CompressedClip& clip ) {
+
+	_clip = &clip;
+	_cursor = 0;
+	_lastTime = 0.f;
+
+	_windows.resize( clip.ranges.size() );
+
+	for ( auto& window : _windows ) {
+
+		window.isEmpty = true;
+	}
+}
+
+void ClipSampler::consume( const CompressedClip& clip, const CompressedKey& key ) {
+
+	auto& window = _windows[key.track];
+	float time = dequantizeTime( key.time, clip.duration );
+
+	float value[4];
+
+	if ( key.track % channelsPerJoint == static_cast<uint16_t>( TrackChannel::Rotation ) ) {
+
+		decodeRotation( key.value, value );
+	} else {
+
+		decodeVector( key.value, clip.ranges[key.track], value );
+	}
+
+	if ( window.isEmpty ) {
+
+		window.t0 = time;
+		std::copy( value, value + 4, window.v0 );
+		window.isEmpty = false;
+	} else {
+
+		window.t0 = window.t1;
+		std::copy( window.v1, window.v1 + 4, window.v0 );
+	}
+
+	window.t1 = time;
+	std::copy( value, value + 4, window.v1 );
+}
+
+void ClipSampler::sample( const CompressedClip& clip, const Skeleton& skeleton, float time, Pose& pose ) {
+
+	time = clip.duration > 0.f ? std::fmod( time, clip.duration ) : 0.f;
+
+	if ( _clip != &clip || time < _lastTime ) {
+
+		rewind( clip );
+	}
+
+	_lastTime = time;
+
+	// Stream is sorted by need time, which for a pending key equals its track's latest key time
+	while ( _cursor < clip.stream.size() ) {
+
+		const auto& key = clip.stream[_cursor];
+		const auto& window = _windows[key.track];
+
+		if ( !window.isEmpty && window.t1 > time ) {
+			break;
+		}
+
+		consume( clip, key );
+		_cursor++;
+	}
+
+	pose = skeleton.bindPose;
+
+	for ( size_t track = 0; track < _windows.size(); track++ ) {
+
+		const auto& window = _windows[track];
+
+		if ( window.isEmpty ) {
+			continue;
+		}
+
+		float t = window.t1 > window.t0 ? std::clamp( ( time - window.t0 ) / ( window.t1 - window.t0 ), 0.f, 1.f ) : 1.f;
+		size_t joint = track / channelsPerJoint;
+
+		switch ( static_cast<TrackChannel>( track % channelsPerJoint ) ) {
+
+			case TrackChannel::Translation:
+				pose.tx[joint] = window.v0[0] + ( window.v1[0] - window.v0[0] ) * t;
+				pose.ty[joint] = window.v0[1] + ( window.v1[1] - window.v0[1] ) * t;
+				pose.tz[joint] = window.v0[2] + ( window.v1[2] - window.v0[2] ) * t;
+				break;
+
+			case TrackChannel::Rotation: {
+				auto rotation = nlerp(
+					glm::quat( window.v0[3], window.v0[0], window.v0[1], window.v0[2] ),
+					glm::quat( window.v1[3], window.v1[0], window.v1[1], window.v1[2] ), t );
+
+				pose.rx[joint] = rotation.x;
+				pose.ry[joint] = rotation.y;
+				pose.rz[joint] = rotation.z;
+				pose.rw[joint] = rotation.w;
+				break;
+			}
+
+			case TrackChannel::Scale:
+				pose.sx[joint] = window.v0[0] + ( window.v1[0] - window.v0[0] ) * t;
+				pose.sy[joint] = window.v0[1] + ( window.v1[1] - window.v0[1] ) * t;
+				pose.sz[joint] = window.v0[2] + ( window.v1[2] - window.v0[2] ) * t;
+				break;
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "animation.hpp"
+
+using std::string, std::vector;
+
+// Keyframe reduction tolerances, keys are dropped while linear interpolation stays within them
+struct CompressionSettings {
+	float translationTolerance = 0.001f; // model units
+	float rotationTolerance = 0.001f;    // radians
+	float scaleTolerance = 0.0001f;
+};
+
+enum class TrackChannel : uint16_t {
+	Translation = 0,
+	Rotation = 1,
+	Scale = 2,
+};
+
+const int channelsPerJoint = 3;
+
+// 10 byte key, track is joint * channelsPerJoint + channel.
+// Rotations use smallest three: three 15 bit components, index of the dropped one in top bits of value[0] and value[1].
+// Translations and scales are 16 bit fractions of the track's range
+struct CompressedKey {
+	uint16_t track;
+	uint16_t time; // fraction of clip duration
+	uint16_t value[3];
+};
+
+// Dequantization range of a translation or scale track
+struct TrackRange {
+	float min[3];
+	float extent[3];
+};
+
+// Keys of all tracks in a single stream, sorted by the time they're needed: a key is needed once
+// sampling passes its predecessor, so a forward playing sampler reads the stream strictly sequentially
+struct CompressedClip {
+	string name;
+	float duration;
+	vector<TrackRange> ranges; // per track
+	vector<CompressedKey> stream;
+
+	size_t getMemorySize() const;
+};
+
+CompressedClip compressClip( const AnimationClip& clip, const CompressionSettings& settings = {} );
+
+// Streams keys of a compressed clip, holding only the two keys around current time per track.
+// Playing forward costs only the keys passed since the previous call, seeking backwards restarts the stream
+class ClipSampler {
+
+public:
+
+	void sample( const CompressedClip& clip, const Skeleton& skeleton, float time, Pose& pose );
+
+private:
+
+	struct Window {
+		float t0;
+		float t1;
+		float v0[4];
+		float v1[4];
+		bool isEmpty;
+	};
+
+	void rewind( const CompressedClip& clip );
+	void consume( const CompressedClip& clip, const CompressedKey& key );
+
+	const CompressedClip *_clip = nullptr;
+	size_t _cursor = 0;
+	float _lastTime = 0.f;
+	vector<Window> _windows;
+};
+
+// Per character evaluation state, scratch memory is reused between frames
+struct AnimationInstance {
+	int clip; // -1 keeps bind pose
+	float timeOffset;
+	int blendClip = -1; // -1 plays clip alone
+	float blendWeight = 0.f; // share of blendClip in the pose
+	ClipSampler sampler;
+	ClipSampler blendSampler;
+	Pose pose;
+	Pose blendPose;
+	vector<glm::mat4> globalTransforms;
+};
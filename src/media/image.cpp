@@ -1,3 +1,4 @@
+#include <csetjmp>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -8,8 +9,50 @@
 #include "image.hpp"
 
 const int signatureSize = 8;
+const int bytesPerPixel = 4;
 
-Image Image::loadFile( const char *path ) {
+// Expand any PNG color type and bit depth to 8 bit RGBA
+static void setupTransforms( png_structp png_ptr, png_infop info_ptr ) {
+
+    png_uint_32 width, height;
+    int depth, colorType;
+
+    png_get_IHDR( png_ptr, info_ptr, &width, &height, &depth, &colorType, NULL, NULL, NULL );
+
+    bool hasTransparency = png_get_valid( png_ptr, info_ptr, PNG_INFO_tRNS );
+
+    if ( colorType == PNG_COLOR_TYPE_PALETTE ) {
+
+        png_set_palette_to_rgb( png_ptr );
+    }
+
+    if ( colorType == PNG_COLOR_TYPE_GRAY && depth < 8 ) {
+
+        png_set_expand_gray_1_2_4_to_8( png_ptr );
+    }
+
+    if ( hasTransparency ) {
+
+        png_set_tRNS_to_alpha( png_ptr );
+    }
+
+    if ( depth == 16 ) {
+
+        png_set_strip_16( png_ptr );
+    }
+
+    if ( colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA ) {
+
+        png_set_gray_to_rgb( png_ptr );
+    }
+
+    if ( !( colorType & PNG_COLOR_MASK_ALPHA ) && !hasTransparency ) {
+
+        png_set_filler( png_ptr, 0xFF, PNG_FILLER_AFTER );
+    }
+}
+
+Image Image::openFile( const char *path ) {
 
     FILE *fp = fopen( path, "rb" );
 
@@ -18,12 +61,29 @@ Image Image::loadFile( const char *path ) {
         throw std::runtime_error("Error load image: couldn't read file");
     }
 
-    unsigned char header[8];
+    return open( fp );
+}
+
+Image Image::openMemory( const char *data, size_t size ) {
+
+    // libpng reads through stdio, so memory is exposed as a stream without copying
+    FILE *fp = fmemopen( const_cast<char*>( data ), size, "rb" );
+
+    if ( !fp ) {
+
+        throw std::runtime_error("Error load image: couldn't open memory stream");
+    }
+
+    return open( fp );
+}
 
-    fread( header, 1, signatureSize, fp );
-    bool is_png = !png_sig_cmp( header, 0, signatureSize );
-    if ( !is_png ) {
+Image Image::open( FILE *fp ) {
 
+    unsigned char header[signatureSize];
+
+    if ( fread( header, 1, signatureSize, fp ) != signatureSize || png_sig_cmp( header, 0, signatureSize ) ) {
+
+        fclose( fp );
         throw std::runtime_error("Error load image: file is not PNG file");
     }
 
@@ -31,6 +91,7 @@ Image Image::loadFile( const char *path ) {
 
     if (!png_ptr) {
 
+        fclose( fp );
         throw std::runtime_error("Error load image: couldn't read struct");
     }
 
@@ -38,43 +99,97 @@ Image Image::loadFile( const char *path ) {
 
     if (!info_ptr) {
 
+        png_destroy_read_struct( &png_ptr, NULL, NULL );
+        fclose( fp );
         throw std::runtime_error("Error load image: couldn't read info");
     }
 
+    if ( setjmp( png_jmpbuf( png_ptr ) ) ) {
+
+        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+        fclose( fp );
+        throw std::runtime_error("Error load image: corrupted header");
+    }
+
     png_init_io( png_ptr, fp );
     png_set_sig_bytes( png_ptr, signatureSize );
     png_read_info( png_ptr, info_ptr );
 
-    uint width, height;
-    int depth, colorType;
+    setupTransforms( png_ptr, info_ptr );
 
-    png_get_IHDR( png_ptr, info_ptr, &width, &height, &depth, &colorType, NULL, NULL, NULL );
+    return Image( fp, png_ptr, info_ptr );
+}
+
+Image::Image( FILE *fp, png_structp png, png_infop info ) : _fp(fp), _png(png), _info(info) {
 
-    int bytesPerRow = png_get_rowbytes( png_ptr, info_ptr );
-    int size = height * bytesPerRow;
-    unsigned char *pixels = new unsigned char[ size ];
-    png_bytepp row_pointers = new png_bytep[height];
+    _passes = png_set_interlace_handling( _png );
+    png_read_update_info( _png, _info );
 
-    for(int i = 0; i < height; i++) {
+    _width = png_get_image_width( _png, _info );
+    _height = png_get_image_height( _png, _info );
+    _rowPitch = png_get_rowbytes( _png, _info );
 
-        row_pointers[i] = pixels + i * bytesPerRow;
+    if ( _rowPitch != _width * bytesPerPixel ) {
+
+        release();
+        throw std::runtime_error("Error load image: unsupported pixel format");
     }
+}
 
-    png_read_image( png_ptr, row_pointers );
+Image::Image( Image&& other ) :
+    _fp(other._fp), _png(other._png), _info(other._info),
+    _width(other._width), _height(other._height), _rowPitch(other._rowPitch), _passes(other._passes) {
+
+    other._fp = NULL;
+    other._png = NULL;
+    other._info = NULL;
+}
 
-    png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+Image::~Image() {
 
-    return Image( width, height, pixels, size );
+    release();
 }
 
-Image::Image( int width, int height, unsigned char * pixels, int size ) : _width(width), _height(height), _pixels(pixels), _size(size) {
+void Image::release() {
+
+    if ( _png ) {
+
+        png_destroy_read_struct( &_png, &_info, NULL );
+    }
 
+    if ( _fp ) {
+
+        fclose( _fp );
+        _fp = NULL;
+    }
 }
 
-Image::~Image() {
+void Image::readPixels( unsigned char *dst ) {
+
+    if ( !_png ) {
+
+        throw std::runtime_error("Error load image: pixels were already read");
+    }
+
+    if ( setjmp( png_jmpbuf( _png ) ) ) {
+
+        release();
+        throw std::runtime_error("Error load image: corrupted pixel data");
+    }
+
+    // Rows land directly in the destination, interlaced images revisit the same rows on each pass
+    for ( int pass = 0; pass < _passes; pass++ ) {
+
+        for ( int y = 0; y < _height; y++ ) {
+
+            png_read_row( _png, dst + y * _rowPitch, NULL );
+        }
+    }
+
+    png_read_end( _png, NULL );
 
-    delete _pixels;
-}    
+    release();
+}
 
 const int Image::getWidth() {
 
@@ -86,12 +201,12 @@ const int Image::getHeight() {
     return _height;
 }
 
-const unsigned char * Image::getPixelPointer() {
+const int Image::getRowPitch() {
 
-    return _pixels;
+    return _rowPitch;
 }
 
 const int Image::getSize() {
 
-    return _size;
-}
\ No newline at end of file
+    return _height * _rowPitch;
+}
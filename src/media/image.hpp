@@ -1,23 +1,47 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdio>
+#include <libpng/png.h>
+
+// PNG decoder that streams rows straight into caller-provided memory (e.g. a mapped staging buffer).
+// Every image is expanded to RGBA8 while decoding, separate images can be decoded on separate threads.
 class Image {
 
 public:
 
-    Image( int width, int height, unsigned char * pixels, int size );
+    Image( Image&& other );
+    Image( const Image& ) = delete;
     ~Image();
 
     const int getWidth();
     const int getHeight();
-    const unsigned char * getPixelPointer();
+    const int getRowPitch();
     const int getSize();
 
-    static Image loadFile( const char * path );
+    // Decodes the whole image into dst, which must hold at least getSize() bytes.
+    // Can be called only once, decoder is released afterwards
+    void readPixels( unsigned char *dst );
+
+    // Reads only the header, pixels are decoded by readPixels()
+    static Image openFile( const char *path );
+
+    // Same as openFile(), data must outlive the decoding
+    static Image openMemory( const char *data, size_t size );
 
 private:
 
+    static Image open( FILE *fp );
+
+    Image( FILE *fp, png_structp png, png_infop info );
+
+    void release();
+
+    FILE *_fp;
+    png_structp _png;
+    png_infop _info;
     int _width;
     int _height;
-    unsigned char * _pixels;
-    int _size;
-};
\ No newline at end of file
+    int _rowPitch;
+    int _passes;
+};
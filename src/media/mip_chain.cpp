@@ -0,0 +1,110 @@
+#include "mip_chain.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+static float srgbToLinear( float value ) {
+
+	return value <= 0.04045f ? value / 12.92f : std::pow( ( value + 0.055f ) / 1.055f, 2.4f );
+}
+
+static unsigned char linearToSrgb( float value ) {
+
+	float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow( value, 1.f / 2.4f ) - 0.055f;
+
+	return static_cast<unsigned char>( std::clamp( srgb * 255.f + 0.5f, 0.f, 255.f ) );
+}
+
+static const std::array<float, 256>& getLinearTable() {
+
+	static const auto table = [] {
+
+		std::array<float, 256> values;
+
+		for ( int i = 0; i < 256; i++ ) {
+
+			values[i] = srgbToLinear( i / 255.f );
+		}
+
+		return values;
+	}();
+
+	return table;
+}
+
+static MipLevel downsample( const MipLevel& source ) {
+
+	const auto& toLinear = getLinearTable();
+
+	MipLevel level {
+		.width = std::max( source.width / 2, 1u ),
+		.height = std::max( source.height / 2, 1u ),
+	};
+
+	level.pixels.resize( level.width * level.height * 4 );
+
+	// Odd sizes drop the last row or column, a 1 texel wide side is repeated
+	for ( uint y = 0; y < level.height; y++ ) {
+
+		uint y0 = std::min( y * 2, source.height - 1 );
+		uint y1 = std::min( y * 2 + 1, source.height - 1 );
+
+		for ( uint x = 0; x < level.width; x++ ) {
+
+			uint x0 = std::min( x * 2, source.width - 1 );
+			uint x1 = std::min( x * 2 + 1, source.width - 1 );
+
+			const unsigned char *taps[4] = {
+				&source.pixels[( y0 * source.width + x0 ) * 4],
+				&source.pixels[( y0 * source.width + x1 ) * 4],
+				&source.pixels[( y1 * source.width + x0 ) * 4],
+				&source.pixels[( y1 * source.width + x1 ) * 4],
+			};
+
+			unsigned char *dst = &level.pixels[( y * level.width + x ) * 4];
+
+			for ( int channel = 0; channel < 3; channel++ ) {
+
+				float sum = 0.f;
+
+				for ( auto tap : taps ) {
+
+					sum += toLinear[tap[channel]];
+				}
+
+				dst[channel] = linearToSrgb( sum * 0.25f );
+			}
+
+			// Alpha is linear
+			dst[3] = ( taps[0][3] + taps[1][3] + taps[2][3] + taps[3][3] + 2 ) / 4;
+		}
+	}
+
+	return level;
+}
+
+vector<MipLevel> buildMipChain( vector<unsigned char> pixels, uint width, uint height ) {
+
+	vector<MipLevel> mips;
+	mips.push_back({ width, height, std::move( pixels ) });
+
+	while ( mips.back().width > 1 || mips.back().height > 1 ) {
+
+		mips.push_back( downsample( mips.back() ) );
+	}
+
+	return mips;
+}
+
+size_t getMipChainSize( const vector<MipLevel>& mips, uint firstLevel ) {
+
+	size_t size = 0;
+
+	for ( uint level = firstLevel; level < mips.size(); level++ ) {
+
+		size += mips[level].pixels.size();
+	}
+
+	return size;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/types.h>
+#include <vector>
+
+using std::vector;
+
+struct MipLevel {
+	uint width;
+	uint height;
+	vector<unsigned char> pixels; // RGBA8
+};
+
+// Box filtered mip chain of an sRGB RGBA8 image, level 0 is the image itself and the last level is 1x1.
+// Texels are averaged in linear space so dark and bright areas keep their brightness at lower levels
+vector<MipLevel> buildMipChain( vector<unsigned char> pixels, uint width, uint height );
+
+size_t getMipChainSize( const vector<MipLevel>& mips, uint firstLevel );
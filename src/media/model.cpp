@@ -4,12 +4,15 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <cmath>
 #include <filesystem>
+#include <set>
 #include <glm/ext/vector_float3.hpp>
 #include <iostream>
 #include <ostream>
 #include <stdexcept>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 
 #include "model.hpp"
@@ -32,11 +35,220 @@ std::pair<glm::vec3, glm::vec3> findAABB(const std::vector<glm::vec3>& vectors)
     return {minPoint, maxPoint};
 }
 
+const auto aiFlags = aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_FlipUVs | aiProcess_LimitBoneWeights;
+
+const int maxInfluences = 4;
+
+glm::mat4 toGlm( const aiMatrix4x4& matrix ) {
+
+	// Assimp matrices are row-major
+	return glm::transpose( glm::make_mat4( &matrix.a1 ) );
+}
+
+// Joints are bone nodes plus their ancestors, so hierarchy transforms between bones are preserved
+void collectJoints( const aiNode* node, int parent, const std::set<const aiNode*>& jointNodes, Skeleton& skeleton ) {
+
+	int index = parent;
+
+	if ( jointNodes.count( node ) ) {
+
+		index = skeleton.size();
+
+		skeleton.jointNames.push_back( node->mName.C_Str() );
+		skeleton.parents.push_back( parent );
+		skeleton.inverseBindMatrices.push_back( glm::mat4( 1.f ) );
+	}
+
+	for ( uint i = 0; i < node->mNumChildren; i++ ) {
+
+		collectJoints( node->mChildren[i], index, jointNodes, skeleton );
+	}
+}
+
+Skeleton readSkeleton( const aiScene* scene ) {
+
+	std::set<const aiNode*> jointNodes;
+
+	for ( uint i = 0; i < scene->mNumMeshes; i++ ) {
+
+		auto mesh = scene->mMeshes[i];
+
+		for ( uint j = 0; j < mesh->mNumBones; j++ ) {
+
+			for ( auto node = scene->mRootNode->FindNode( mesh->mBones[j]->mName ); node != nullptr; node = node->mParent ) {
+
+				jointNodes.insert( node );
+			}
+		}
+	}
+
+	Skeleton skeleton;
+	collectJoints( scene->mRootNode, -1, jointNodes, skeleton );
+
+	if ( skeleton.size() > MAX_JOINTS ) {
+
+		throw std::runtime_error("Skeleton has too many joints");
+	}
+
+	skeleton.bindPose.resize( skeleton.size() );
+
+	for ( size_t joint = 0; joint < skeleton.size(); joint++ ) {
+
+		auto node = scene->mRootNode->FindNode( skeleton.jointNames[joint].c_str() );
+
+		aiVector3D scaling, position;
+		aiQuaternion rotation;
+		node->mTransformation.Decompose( scaling, rotation, position );
+
+		skeleton.bindPose.setJoint( joint, 
+			glm::vec3( position.x, position.y, position.z ),
+			glm::quat( rotation.w, rotation.x, rotation.y, rotation.z ),
+			glm::vec3( scaling.x, scaling.y, scaling.z ) );
+	}
+
+	for ( uint i = 0; i < scene->mNumMeshes; i++ ) {
+
+		auto mesh = scene->mMeshes[i];
+
+		for ( uint j = 0; j < mesh->mNumBones; j++ ) {
+
+			int joint = skeleton.findJoint( mesh->mBones[j]->mName.C_Str() );
+			skeleton.inverseBindMatrices[joint] = toGlm( mesh->mBones[j]->mOffsetMatrix );
+		}
+	}
+
+	return skeleton;
+}
+
+std::vector<AnimationClip> readAnimations( const aiScene* scene, const Skeleton& skeleton ) {
+
+	std::vector<AnimationClip> clips;
+
+	for ( uint i = 0; i < scene->mNumAnimations; i++ ) {
+
+		auto animation = scene->mAnimations[i];
+		double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+
+		AnimationClip clip {
+			.name = animation->mName.C_Str(),
+			.duration = static_cast<float>( animation->mDuration / ticksPerSecond ),
+			.tracks = std::vector<JointTrack>( skeleton.size() ),
+		};
+
+		for ( uint j = 0; j < animation->mNumChannels; j++ ) {
+
+			auto channel = animation->mChannels[j];
+			int joint = skeleton.findJoint( channel->mNodeName.C_Str() );
+
+			// Channels of nodes which don't affect any bone
+			if ( joint < 0 ) {
+				continue;
+			}
+
+			auto& track = clip.tracks[joint];
+
+			for ( uint k = 0; k < channel->mNumPositionKeys; k++ ) {
+
+				auto key = channel->mPositionKeys[k];
+				track.positionTimes.push_back( key.mTime / ticksPerSecond );
+				track.positions.push_back( glm::vec3( key.mValue.x, key.mValue.y, key.mValue.z ) );
+			}
+
+			for ( uint k = 0; k < channel->mNumRotationKeys; k++ ) {
+
+				auto key = channel->mRotationKeys[k];
+				track.rotationTimes.push_back( key.mTime / ticksPerSecond );
+				track.rotations.push_back( glm::quat( key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z ) );
+			}
+
+			for ( uint k = 0; k < channel->mNumScalingKeys; k++ ) {
+
+				auto key = channel->mScalingKeys[k];
+				track.scaleTimes.push_back( key.mTime / ticksPerSecond );
+				track.scales.push_back( glm::vec3( key.mValue.x, key.mValue.y, key.mValue.z ) );
+			}
+		}
+
+		clips.push_back( std::move( clip ) );
+	}
+
+	return clips;
+}
+
+// Keeps the strongest influences and quantizes their weights to 8 bits
+void readJointInfluences( const aiScene* scene, const Skeleton& skeleton, const std::vector<int>& vertOffsets, int vertCount, Mesh& result ) {
+
+	std::vector<std::array<float, maxInfluences>> weights( vertCount, { 0.f, 0.f, 0.f, 0.f } );
+	std::vector<std::array<int, maxInfluences>> joints( vertCount, { 0, 0, 0, 0 } );
+
+	for ( uint i = 0; i < scene->mNumMeshes; i++ ) {
+
+		auto mesh = scene->mMeshes[i];
+
+		for ( uint j = 0; j < mesh->mNumBones; j++ ) {
+
+			auto bone = mesh->mBones[j];
+			int joint = skeleton.findJoint( bone->mName.C_Str() );
+
+			for ( uint k = 0; k < bone->mNumWeights; k++ ) {
+
+				int vertex = vertOffsets[i] + bone->mWeights[k].mVertexId;
+				float weight = bone->mWeights[k].mWeight;
+
+				auto& vertexWeights = weights[vertex];
+				int weakest = std::min_element( vertexWeights.begin(), vertexWeights.end() ) - vertexWeights.begin();
+
+				if ( weight > vertexWeights[weakest] ) {
+
+					vertexWeights[weakest] = weight;
+					joints[vertex][weakest] = joint;
+				}
+			}
+		}
+	}
+
+	result.jointIndices.resize( vertCount );
+	result.jointWeights.resize( vertCount );
+
+	for ( int i = 0; i < vertCount; i++ ) {
+
+		float sum = weights[i][0] + weights[i][1] + weights[i][2] + weights[i][3];
+
+		// Unskinned vertices keep zero weights, shader leaves them in bind pose
+		if ( sum <= 0.f ) {
+
+			result.jointIndices[i] = glm::u8vec4( 0 );
+			result.jointWeights[i] = glm::u8vec4( 0 );
+			continue;
+		}
+
+		int quantizedSum = 0;
+		int strongest = 0;
+
+		for ( int j = 0; j < maxInfluences; j++ ) {
+
+			int quantized = static_cast<int>( std::round( weights[i][j] / sum * 255.f ) );
+
+			result.jointIndices[i][j] = joints[i][j];
+			result.jointWeights[i][j] = quantized;
+			quantizedSum += quantized;
+
+			if ( weights[i][j] > weights[i][strongest] ) {
+				strongest = j;
+			}
+		}
+
+		// Rounding error goes to the strongest influence, so weights always sum up to one
+		result.jointWeights[i][strongest] += 255 - quantizedSum;
+	}
+}
+
+Mesh convertScene( const aiScene* scene );
+
 Mesh readModel( const std::string& meshPath ) {
 
     Assimp::Importer importer;
 
-	const auto aiFlags = aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_FlipUVs;
     const aiScene* scene = importer.ReadFile( meshPath, aiFlags );
 
 	if ( scene == nullptr ) {
@@ -44,14 +256,62 @@ Mesh readModel( const std::string& meshPath ) {
 		throw std::runtime_error("Failed to load mesh");
 	}
 
+	return convertScene( scene );
+}
+
+Mesh readModel( const char* data, size_t size, const char* formatHint ) {
+
+    Assimp::Importer importer;
+
+    const aiScene* scene = importer.ReadFileFromMemory( data, size, aiFlags, formatHint );
+
+	if ( scene == nullptr ) {
+
+		throw std::runtime_error("Failed to load mesh");
+	}
+
+	return convertScene( scene );
+}
+
+const int GLTF_FILTER_NEAREST = 0x2600;
+
+// Decal samples outside the texture as transparent, which is what the border color is for
+TextureWrap toTextureWrap( aiTextureMapMode mode ) {
+
+	switch ( mode ) {
+
+		case aiTextureMapMode_Clamp: return TextureWrap::Clamp;
+		case aiTextureMapMode_Mirror: return TextureWrap::Mirror;
+		case aiTextureMapMode_Decal: return TextureWrap::Border;
+		default: return TextureWrap::Repeat;
+	}
+}
+
+Mesh convertScene( const aiScene* scene ) {
+
 	std::string strTexturePath;
+	TextureSampling textureSampling;
 
 	if ( scene->HasMaterials() && scene->mNumTextures == 0 ) {
 
 		assert( scene->mNumMaterials == 1 );
 
 		auto texturePath = aiString();
-		scene->mMaterials[0]->GetTexture( aiTextureType_DIFFUSE, 0, &texturePath );
+		aiTextureMapMode mapModes[3] = { aiTextureMapMode_Wrap, aiTextureMapMode_Wrap, aiTextureMapMode_Wrap };
+
+		scene->mMaterials[0]->GetTexture( aiTextureType_DIFFUSE, 0, &texturePath, nullptr, nullptr, nullptr, nullptr, mapModes );
+
+		textureSampling.wrapU = toTextureWrap( mapModes[0] );
+		textureSampling.wrapV = toTextureWrap( mapModes[1] );
+
+		// Only glTF carries filters, stored with GL enums. Pixel art textures keep their texels sharp
+		int magFilter = 0;
+
+		if ( scene->mMaterials[0]->Get( "$tex.mappingfiltermag", aiTextureType_DIFFUSE, 0, magFilter ) == AI_SUCCESS && magFilter == GLTF_FILTER_NEAREST ) {
+
+			textureSampling.filter = TextureFilter::Nearest;
+			textureSampling.isAnisotropic = false;
+		}
 
 		std::filesystem::path fullPathToTexture { "textures/" };
 
@@ -92,6 +352,7 @@ Mesh readModel( const std::string& meshPath ) {
 
 		// Combine meshes
 		std::vector<glm::vec3> vertPositions( vertCount );
+		std::vector<glm::vec3> vertNormals( vertCount );
 		std::vector<glm::vec2> texCoords( vertCount );
 		std::vector<int>	   triIndices( indicesCount );
 
@@ -103,6 +364,12 @@ Mesh readModel( const std::string& meshPath ) {
 
 			memcpy( &vertPositions[vertOffset], mesh->mVertices, sizeof( glm::vec3 ) * mesh->mNumVertices );
 
+			// Point and line meshes get no generated normals
+			if ( mesh->HasNormals() ) {
+
+				memcpy( &vertNormals[vertOffset], mesh->mNormals, sizeof( glm::vec3 ) * mesh->mNumVertices );
+			}
+
 			// Write texture coordinates
 			auto textureCoordsChannel = mesh->mTextureCoords[0];
 
@@ -122,18 +389,26 @@ Mesh readModel( const std::string& meshPath ) {
 			}
 		}
 
+		Mesh result { 
+			.texturePath = strTexturePath,
+			.textureSampling = textureSampling,
+			.vertPositions = vertPositions,
+			.vertNormals = vertNormals,
+			.texCoords = texCoords,
+			.indices = triIndices,
+			.skeleton = readSkeleton( scene ),
+		};
+
+		result.clips = readAnimations( scene, result.skeleton );
+		readJointInfluences( scene, result.skeleton, vertOffsets, vertCount, result );
+
 		// Find dimension bounds
 		auto aabb = findAABB( vertPositions );
 
 		printf("Max model bound %f %f, %f\n", aabb.first.x, aabb.first.y, aabb.first.z );
 		printf("Min model bound %f %f, %f\n", aabb.second.x, aabb.second.y, aabb.second.z );
 
-		return Mesh { 
-			.texturePath = strTexturePath,
-			.vertPositions = vertPositions,
-			.texCoords = texCoords,
-			.indices = triIndices,
-		};
+		return result;
 	}
 
 	throw std::runtime_error("No meshes found!");
@@ -1,18 +1,45 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <glm/ext/vector_float2.hpp>
 
 #include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
 #include "image.hpp"
+#include "animation.hpp"
+
+enum class TextureWrap { Repeat, Clamp, Mirror, Border };
+enum class TextureFilter { Linear, Nearest };
+
+// Sampling settings of the diffuse texture as authored in the material
+struct TextureSampling {
+
+    TextureWrap wrapU = TextureWrap::Repeat;
+    TextureWrap wrapV = TextureWrap::Repeat;
+    TextureFilter filter = TextureFilter::Linear;
+    bool isAnisotropic = true;
+};
 
 struct Mesh {
 
     std::string texturePath;
+    TextureSampling textureSampling;
     std::vector<glm::vec3> vertPositions;
+    std::vector<glm::vec3> vertNormals; // generated by the importer when missing
     std::vector<glm::vec2> texCoords;
     std::vector<int> indices;
+
+    // Up to four influences per vertex, weights are normalized to sum up to 255
+    std::vector<glm::u8vec4> jointIndices;
+    std::vector<glm::u8vec4> jointWeights;
+
+    Skeleton skeleton;
+    std::vector<AnimationClip> clips;
 };
 
-Mesh readModel( const std::string& meshPath );
\ No newline at end of file
+Mesh readModel( const std::string& meshPath );
+
+// Texture paths are still resolved relative to "textures/"
+Mesh readModel( const char* data, size_t size, const char* formatHint );
\ No newline at end of file
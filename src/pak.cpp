@@ -0,0 +1,125 @@
+#include <cstring>
+#include <stdexcept>
+
+#ifdef PAK_ZSTD
+#include <zstd.h>
+#endif
+
+#include "hash.hpp"
+#include "pak.hpp"
+
+uint64_t hashPakName( const string& name ) {
+
+	return fnv1a( name.data(), name.size() );
+}
+
+// Offset and size are checked separately, so the sum can't wrap around
+static bool isInRange( uint64_t offset, uint64_t size, uint64_t limit ) {
+
+	return offset <= limit && size <= limit - offset;
+}
+
+Pak Pak::open( const string& filepath ) {
+
+	// Entries are looked up in no particular order
+	return Pak( File::openBinary( filepath, File::Access::Random ) );
+}
+
+Pak::Pak( File file ) : _file(std::move(file)) {
+
+	if ( _file.getSize() < sizeof( PakHeader ) ) {
+
+		throw std::runtime_error("Pak: file is too small");
+	}
+
+	_header = reinterpret_cast<const PakHeader*>( _file.getData() );
+
+	if ( memcmp( _header->magic, pakMagic, sizeof( pakMagic ) ) != 0 || _header->version != pakVersion ) {
+
+		throw std::runtime_error("Pak: unsupported file format");
+	}
+
+	uint64_t fileSize = _file.getSize();
+	bool isPowerOfTwo = _header->bucketCount != 0 && ( _header->bucketCount & ( _header->bucketCount - 1 ) ) == 0;
+
+	if ( !isPowerOfTwo || !isInRange( _header->tocOffset, uint64_t( _header->bucketCount ) * sizeof( PakEntry ), fileSize ) ||
+		 _header->namesOffset > fileSize ) {
+
+		throw std::runtime_error("Pak: corrupted table of contents");
+	}
+
+	_toc = reinterpret_cast<const PakEntry*>( _file.getData() + _header->tocOffset );
+	_names = _file.getData() + _header->namesOffset;
+
+	// Lookups and reads trust the entries from here on
+	for ( uint32_t i = 0; i < _header->bucketCount; i++ ) {
+
+		const PakEntry& entry = _toc[i];
+
+		if ( entry.nameLength == 0 ) {
+			continue;
+		}
+
+		if ( !isInRange( entry.nameOffset, entry.nameLength, fileSize - _header->namesOffset ) ||
+			 !isInRange( entry.offset, entry.size, fileSize ) ||
+			 ( entry.compression == PakCompression::Stored && entry.size != entry.rawSize ) ) {
+
+			throw std::runtime_error("Pak: corrupted entry");
+		}
+	}
+}
+
+const PakEntry* Pak::find( const string& name ) const {
+
+	uint64_t hash = hashPakName( name );
+	uint32_t mask = _header->bucketCount - 1;
+
+	// Every bucket is probed at most once, a full table has no empty bucket to stop at
+	for ( uint32_t probe = 0, i = hash & mask; probe < _header->bucketCount; probe++, i = ( i + 1 ) & mask ) {
+
+		const PakEntry& entry = _toc[i];
+
+		if ( entry.nameLength == 0 ) {
+
+			return nullptr;
+		}
+
+		if ( entry.nameHash == hash && 
+			 entry.nameLength == name.size() && 
+			 memcmp( _names + entry.nameOffset, name.data(), name.size() ) == 0 ) {
+
+			return &entry;
+		}
+	}
+
+	return nullptr;
+}
+
+const char* Pak::getEntryData( const PakEntry& entry ) const {
+
+	return _file.getData() + entry.offset;
+}
+
+void Pak::unpack( const PakEntry& entry, char *dst ) const {
+
+	switch ( entry.compression ) {
+
+		case PakCompression::Stored:
+			memcpy( dst, getEntryData( entry ), entry.size );
+			return;
+
+		case PakCompression::Zstd:
+#ifdef PAK_ZSTD
+			if ( ZSTD_decompress( dst, entry.rawSize, getEntryData( entry ), entry.size ) != entry.rawSize ) {
+
+				throw std::runtime_error("Pak: failed to decompress entry");
+			}
+
+			return;
+#else
+			throw std::runtime_error("Pak: built without zstd support");
+#endif
+	}
+
+	throw std::runtime_error("Pak: unknown compression");
+}
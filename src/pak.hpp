@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "file.hpp"
+
+using std::string, std::vector;
+
+// Packed asset archive layout:
+//   PakHeader | entry data (each entry aligned to pakAlignment) | names | hashed table of contents
+// Table of contents is an open addressing hash table with linear probing, bucket count is a power of two
+
+const char pakMagic[4] = { 'O', 'D', 'P', 'K' };
+const uint32_t pakVersion = 1;
+const uint64_t pakAlignment = 64;
+
+enum class PakCompression : uint32_t {
+	Stored = 0,
+	Zstd = 1,
+};
+
+struct PakHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t bucketCount;
+	uint64_t namesOffset;
+	uint64_t tocOffset;
+};
+
+struct PakEntry {
+	uint64_t nameHash;
+	uint32_t nameOffset;
+	uint32_t nameLength; // zero marks an empty bucket
+	uint64_t offset;
+	uint64_t size;       // size stored in the archive
+	uint64_t rawSize;    // size after decompression
+	PakCompression compression;
+	uint32_t reserved;
+};
+
+uint64_t hashPakName( const string& name );
+
+// Read-only view of a pak file, the whole archive is a single mapping
+class Pak {
+
+public:
+
+	Pak( Pak&& other ) = default;
+	Pak& operator=( Pak&& other ) = default;
+
+	// Returns nullptr if archive has no such entry
+	const PakEntry* find( const string& name ) const;
+
+	// Points into the mapping, only usable as is for PakCompression::Stored entries
+	const char* getEntryData( const PakEntry& entry ) const;
+
+	// Decompresses entry into dst which must hold entry.rawSize bytes
+	void unpack( const PakEntry& entry, char *dst ) const;
+
+	static Pak open( const string& filepath );
+
+private:
+
+	Pak( File file );
+
+	File _file;
+	const PakHeader *_header;
+	const PakEntry *_toc;
+	const char *_names;
+};
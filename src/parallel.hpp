@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "jobs.hpp"
+
+// Batches per thread, more than one lets idle workers steal from slow ones
+const size_t PARALLEL_BATCHES_PER_THREAD = 4;
+
+// Splits [0, count) into contiguous batches of at least minBatch items, batches run as jobs and the
+// calling thread processes the last one itself before helping with the rest. func is called as func( begin, end ).
+template<typename Func>
+void parallelFor( JobSystem& jobs, size_t count, size_t minBatch, Func func ) {
+
+	size_t maxBatches = jobs.getThreadCount() * PARALLEL_BATCHES_PER_THREAD;
+	size_t batches = std::min( maxBatches, ( count + minBatch - 1 ) / std::max<size_t>( minBatch, 1 ) );
+
+	if ( jobs.getThreadCount() <= 1 || batches <= 1 ) {
+
+		if ( count > 0 ) {
+
+			func( size_t( 0 ), count );
+		}
+
+		return;
+	}
+
+	size_t batchSize = ( count + batches - 1 ) / batches;
+	size_t begin = 0;
+	JobCounter counter;
+	JobWaitGuard guard( jobs, counter );
+
+	for ( ; begin + batchSize < count; begin += batchSize ) {
+
+		jobs.run( [&func, begin, batchSize] { func( begin, begin + batchSize ); }, &counter );
+	}
+
+	func( begin, count );
+}
+
+template<typename Func>
+void parallelFor( size_t count, size_t minBatch, Func func ) {
+
+	parallelFor( JobSystem::get(), count, minBatch, func );
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+// Hands values from one writer thread to one reader thread through three slots: one being written, one
+// waiting and one being read. Slots are only touched by one side at a time, so values are written and read
+// in place without copies. In order, every written value is read and the writer waits when it gets two
+// values ahead. Otherwise a new value replaces the one waiting if it wasn't read yet and the writer never
+// waits. Either way the reader waits when it catches up
+template<typename T>
+class TripleBuffer {
+
+public:
+
+	explicit TripleBuffer( bool isInOrder = true ) : _isInOrder(isInOrder) {}
+
+	// Slot for the next value, null once closed
+	T* beginWrite() {
+
+		std::unique_lock<std::mutex> lock( _mutex );
+
+		if ( !_isInOrder ) {
+
+			return _isClosed ? nullptr : &_slots[_writeSlot];
+		}
+
+		_changed.wait( lock, [this] { return _isClosed || _written - _read < SLOT_COUNT; } );
+
+		return _isClosed ? nullptr : &_slots[_written % SLOT_COUNT];
+	}
+
+	void endWrite() {
+
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+
+			// Waiting value, if any, becomes the next slot to write
+			if ( !_isInOrder ) {
+
+				std::swap( _writeSlot, _waitingSlot );
+				_isWaiting = true;
+			}
+
+			_written++;
+		}
+
+		_changed.notify_all();
+	}
+
+	// Oldest value not read yet, or the latest one out of order. Null once closed and every value has been read
+	const T* beginRead() {
+
+		std::unique_lock<std::mutex> lock( _mutex );
+
+		if ( !_isInOrder ) {
+
+			_changed.wait( lock, [this] { return _isClosed || _isWaiting; } );
+
+			if ( !_isWaiting ) {
+				return nullptr;
+			}
+
+			std::swap( _readSlot, _waitingSlot );
+			_isWaiting = false;
+
+			return &_slots[_readSlot];
+		}
+
+		_changed.wait( lock, [this] { return _isClosed || _written > _read; } );
+
+		return _written > _read ? &_slots[_read % SLOT_COUNT] : nullptr;
+	}
+
+	void endRead() {
+
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_read++;
+		}
+
+		_changed.notify_all();
+	}
+
+	// Writer stops, the reader still gets the values already written
+	void close() {
+
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_isClosed = true;
+		}
+
+		_changed.notify_all();
+	}
+
+private:
+
+	static const size_t SLOT_COUNT = 3;
+
+	T _slots[SLOT_COUNT];
+	const bool _isInOrder;
+	size_t _written = 0;
+	size_t _read = 0;
+	size_t _writeSlot = 0;	// slot roles rotate when values are replaced out of order
+	size_t _waitingSlot = 1;
+	size_t _readSlot = 2;
+	bool _isWaiting = false;
+	bool _isClosed = false;
+	std::mutex _mutex;
+	std::condition_variable _changed;
+};
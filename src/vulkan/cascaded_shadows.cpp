@@ -0,0 +1,129 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include "cascaded_shadows.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+CascadedShadows::CascadedShadows( uint resolution, float shadowDistance, float splitLambda ) :
+	_resolution(resolution),
+	_shadowDistance(shadowDistance),
+	_splitLambda(splitLambda),
+	_cascades() {}
+
+void CascadedShadows::update( const CameraFrustum& camera, glm::vec3 lightDirection, const vector<BoundingSphere>& casters ) {
+
+	float nearPlane = camera.near;
+	float farPlane = std::min( camera.far, _shadowDistance );
+	float tanHalfFovY = std::tan( camera.fovY * 0.5f );
+	float tanHalfFovX = tanHalfFovY * camera.aspect;
+
+	glm::mat4 cameraToWorld = glm::inverse( camera.view );
+	glm::vec3 up = std::abs( lightDirection.z ) < 0.99f ? glm::vec3( 0.f, 0.f, 1.f ) : glm::vec3( 0.f, 1.f, 0.f );
+
+	_casterMasks.assign( casters.size(), 0 );
+
+	float sliceNear = nearPlane;
+
+	for ( int i = 0; i < SHADOW_CASCADES; i++ ) {
+
+		// Practical split scheme, blend of logarithmic and uniform distribution
+		float t = static_cast<float>( i + 1 ) / SHADOW_CASCADES;
+		float logSplit = nearPlane * std::pow( farPlane / nearPlane, t );
+		float uniformSplit = nearPlane + ( farPlane - nearPlane ) * t;
+		float sliceFar = _splitLambda * logSplit + ( 1.f - _splitLambda ) * uniformSplit;
+
+		glm::vec3 corners[8];
+		glm::vec3 center( 0.f );
+
+		for ( int corner = 0; corner < 8; corner++ ) {
+
+			float depth = corner & 4 ? sliceFar : sliceNear;
+			float x = ( corner & 1 ? 1.f : -1.f ) * tanHalfFovX * depth;
+			float y = ( corner & 2 ? 1.f : -1.f ) * tanHalfFovY * depth;
+
+			corners[corner] = glm::vec3( cameraToWorld * glm::vec4( x, y, -depth, 1.f ) );
+			center += corners[corner] / 8.f;
+		}
+
+		// Sphere around the slice doesn't change with camera rotation, so texel size stays the same every frame
+		float radius = 0.f;
+
+		for ( const auto& corner : corners ) {
+
+			radius = std::max( radius, glm::length( corner - center ) );
+		}
+
+		radius = std::ceil( radius * 16.f ) / 16.f;
+
+		glm::mat4 lightView = glm::lookAt( center - lightDirection, center, up );
+
+		// Depth range covers the slice, casters between the light and the slice pull the near plane towards the light
+		float zNear = 1.f - radius;
+		float zFar = 1.f + radius;
+
+		for ( size_t caster = 0; caster < casters.size(); caster++ ) {
+
+			glm::vec3 position = glm::vec3( lightView * glm::vec4( casters[caster].center, 1.f ) );
+			float distance = -position.z;
+			float extent = radius + casters[caster].radius;
+
+			bool isVisible = std::abs( position.x ) <= extent &&
+							 std::abs( position.y ) <= extent &&
+							 distance - casters[caster].radius <= zFar;
+
+			if ( isVisible ) {
+
+				_casterMasks[caster] |= 1 << i;
+				zNear = std::min( zNear, distance - casters[caster].radius );
+			}
+		}
+
+		glm::mat4 lightProj = glm::ortho( -radius, radius, -radius, radius, zNear, zFar );
+
+		// Snap the projection to whole texels, otherwise shadow edges shimmer as the camera moves
+		glm::vec4 origin = lightProj * lightView * glm::vec4( 0.f, 0.f, 0.f, 1.f );
+		glm::vec2 texels = glm::vec2( origin ) * ( _resolution * 0.5f );
+		glm::vec2 offset = ( glm::round( texels ) - texels ) * ( 2.f / _resolution );
+
+		lightProj[3][0] += offset.x;
+		lightProj[3][1] += offset.y;
+
+		_cascades[i] = { lightProj * lightView, sliceFar };
+
+		sliceNear = sliceFar;
+	}
+}
+
+const ShadowCascade& CascadedShadows::getCascade( int cascade ) const {
+
+	return _cascades[cascade];
+}
+
+bool CascadedShadows::isCasterVisible( int cascade, size_t caster ) const {
+
+	return _casterMasks[caster] & ( 1 << cascade );
+}
+
+uint CascadedShadows::getResolution() const {
+
+	return _resolution;
+}
+
+uint CascadedShadows::getAtlasWidth() const {
+
+	return _resolution * SHADOW_ATLAS_COLUMNS;
+}
+
+uint CascadedShadows::getAtlasHeight() const {
+
+	return _resolution * ( ( SHADOW_CASCADES + SHADOW_ATLAS_COLUMNS - 1 ) / SHADOW_ATLAS_COLUMNS );
+}
+
+glm::uvec2 CascadedShadows::getTileOffset( int cascade ) const {
+
+	return glm::uvec2( cascade % SHADOW_ATLAS_COLUMNS, cascade / SHADOW_ATLAS_COLUMNS ) * _resolution;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+using std::vector;
+
+// Must match SHADOW_CASCADES and SHADOW_ATLAS_COLUMNS in main.frag
+const int SHADOW_CASCADES = 4;
+const int SHADOW_ATLAS_COLUMNS = 2;
+
+struct BoundingSphere {
+	glm::vec3 center;
+	float radius;
+};
+
+struct CameraFrustum {
+	glm::mat4 view;
+	float fovY;
+	float aspect;
+	float near;
+	float far;
+};
+
+struct ShadowCascade {
+	glm::mat4 viewProj;
+	float splitDepth; // view space distance where the cascade ends
+};
+
+// Splits the camera frustum into slices, each one gets a stable orthographic projection fitted around it.
+// Cascades are tiles of a single atlas, resolution is the size of one tile in texels
+class CascadedShadows {
+
+public:
+
+	CascadedShadows() {}
+	CascadedShadows( uint resolution, float shadowDistance, float splitLambda = 0.75f );
+
+	// Casters are world space bounds, a caster is kept for a cascade when it can throw shadows into it
+	void update( const CameraFrustum& camera, glm::vec3 lightDirection, const vector<BoundingSphere>& casters );
+
+	const ShadowCascade& getCascade( int cascade ) const;
+	bool isCasterVisible( int cascade, size_t caster ) const;
+
+	uint getResolution() const;
+	uint getAtlasWidth() const;
+	uint getAtlasHeight() const;
+	glm::uvec2 getTileOffset( int cascade ) const;
+
+private:
+
+	uint _resolution;
+	float _shadowDistance;
+	float _splitLambda;
+	std::array<ShadowCascade, SHADOW_CASCADES> _cascades;
+	vector<uint8_t> _casterMasks; // bit per cascade
+};
@@ -0,0 +1,63 @@
+#include "deletion_queue.hpp"
+
+#include <algorithm>
+
+void DeletionQueue::init( VkDevice device ) {
+
+	_device = device;
+}
+
+void DeletionQueue::push( TimelinePoint lastUse, std::function<void()> destroy ) {
+
+	_entries.push_back({ lastUse, std::move( destroy ) });
+}
+
+void DeletionQueue::pushPending( std::function<void()> destroy ) {
+
+	_pending.push_back( std::move( destroy ) );
+}
+
+void DeletionQueue::pushPending( VkBuffer buffer, VkDeviceMemory memory ) {
+
+	pushPending( [device = _device, buffer, memory] {
+		vkDestroyBuffer( device, buffer, nullptr );
+		vkFreeMemory( device, memory, nullptr );
+	});
+}
+
+void DeletionQueue::retirePending( TimelinePoint lastUse ) {
+
+	for ( auto& destroy : _pending ) {
+
+		_entries.push_back({ lastUse, std::move( destroy ) });
+	}
+
+	_pending.clear();
+}
+
+// Entries are destroyed in the order they were pushed
+void DeletionQueue::collect( TimelinePoint completed ) {
+
+	auto retired = std::stable_partition( _entries.begin(), _entries.end(), [completed] ( const Entry& entry ) {
+		return entry.lastUse.graphics > completed.graphics || entry.lastUse.compute > completed.compute;
+	});
+
+	for ( auto it = retired; it != _entries.end(); it++ ) {
+
+		it->destroy();
+	}
+
+	_entries.erase( retired, _entries.end() );
+}
+
+void DeletionQueue::flush() {
+
+	retirePending( {} );
+
+	for ( auto& entry : _entries ) {
+
+		entry.destroy();
+	}
+
+	_entries.clear();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using std::vector;
+
+// Values on the queue timelines, zero for a queue which isn't involved
+struct TimelinePoint {
+	uint64_t graphics = 0;
+	uint64_t compute = 0;
+};
+
+// Destroys resources once the GPU work that last used them has completed, so nothing waits for an
+// idle device. Resources used by commands not submitted yet are pushed as pending and get their
+// point once the submission is known
+class DeletionQueue {
+
+	struct Entry {
+		TimelinePoint lastUse;
+		std::function<void()> destroy;
+	};
+
+public:
+
+	void init( VkDevice device );
+
+	void push( TimelinePoint lastUse, std::function<void()> destroy );
+	void pushPending( std::function<void()> destroy );
+	void pushPending( VkBuffer buffer, VkDeviceMemory memory );
+
+	// Pending resources retire with the submission that reaches this point
+	void retirePending( TimelinePoint lastUse );
+
+	// Destroys everything the completed values cover
+	void collect( TimelinePoint completed );
+
+	// Destroys everything, the device must be idle
+	void flush();
+
+private:
+
+	VkDevice _device = VK_NULL_HANDLE;
+	vector<Entry> _entries;
+	vector<std::function<void()>> _pending;
+};
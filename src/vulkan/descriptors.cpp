@@ -0,0 +1,257 @@
+#include "descriptors.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+const uint MAX_SETS_PER_POOL = 4096;
+
+bool DescriptorLayoutCache::LayoutKey::operator==( const LayoutKey& other ) const {
+
+	return std::equal( bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(),
+		[] ( const auto& a, const auto& b ) {
+
+			return a.binding == b.binding &&
+				   a.descriptorType == b.descriptorType &&
+				   a.descriptorCount == b.descriptorCount &&
+				   a.stageFlags == b.stageFlags;
+		});
+}
+
+size_t DescriptorLayoutCache::LayoutKeyHash::operator()( const LayoutKey& key ) const {
+
+	size_t seed = key.bindings.size();
+
+	for ( const auto& binding : key.bindings ) {
+
+		// Small binding numbers, types and counts pack into one word with the stages
+		size_t packed = binding.binding | ( binding.descriptorType << 8 ) | ( binding.descriptorCount << 16 ) |
+						( static_cast<size_t>( binding.stageFlags ) << 32 );
+
+		seed ^= std::hash<size_t>{}( packed ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+	}
+
+	return seed;
+}
+
+void DescriptorLayoutCache::init( VkDevice device ) {
+
+	_device = device;
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::get( vector<VkDescriptorSetLayoutBinding> bindings ) {
+
+	std::sort( bindings.begin(), bindings.end(), [] ( const auto& a, const auto& b ) { return a.binding < b.binding; } );
+
+	LayoutKey key { .bindings = std::move( bindings ) };
+
+	auto found = _layouts.find( key );
+
+	if ( found != _layouts.end() ) {
+
+		return found->second;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = static_cast<uint>( key.bindings.size() ),
+		.pBindings = key.bindings.data()
+	};
+
+	VkDescriptorSetLayout layout;
+
+	if ( vkCreateDescriptorSetLayout( _device, &layoutInfo, nullptr, &layout ) != VK_SUCCESS ) {
+
+		throw std::runtime_error( "Failed to create descriptor layout" );
+	}
+
+	_layouts.emplace( std::move( key ), layout );
+
+	return layout;
+}
+
+void DescriptorLayoutCache::release() {
+
+	for ( auto& [key, layout] : _layouts ) {
+
+		vkDestroyDescriptorSetLayout( _device, layout, nullptr );
+	}
+
+	_layouts.clear();
+}
+
+void DescriptorAllocator::init( VkDevice device, uint setsPerPool, const vector<PoolRatio>& ratios ) {
+
+	_device = device;
+	_setsPerPool = setsPerPool;
+	_ratios = ratios;
+	_readyPools.push_back( createPool( setsPerPool ) );
+}
+
+VkDescriptorSet DescriptorAllocator::allocate( VkDescriptorSetLayout layout ) {
+
+	VkDescriptorPool pool = getPool();
+
+	VkDescriptorSetAllocateInfo allocInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &layout,
+	};
+
+	VkDescriptorSet set;
+	VkResult result = vkAllocateDescriptorSets( _device, &allocInfo, &set );
+
+	// Full pool is parked until reset, the retry goes to a fresh one
+	if ( result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL ) {
+
+		_fullPools.push_back( pool );
+
+		allocInfo.descriptorPool = pool = getPool();
+		result = vkAllocateDescriptorSets( _device, &allocInfo, &set );
+	}
+
+	// Pool is kept until reset, release() destroys it either way
+	if ( result != VK_SUCCESS ) {
+
+		_fullPools.push_back( pool );
+		throw std::runtime_error( "Failed to allocate descriptor set" );
+	}
+
+	_readyPools.push_back( pool );
+
+	return set;
+}
+
+void DescriptorAllocator::reset() {
+
+	for ( auto pool : _readyPools ) {
+
+		vkResetDescriptorPool( _device, pool, 0 );
+	}
+
+	for ( auto pool : _fullPools ) {
+
+		vkResetDescriptorPool( _device, pool, 0 );
+		_readyPools.push_back( pool );
+	}
+
+	_fullPools.clear();
+}
+
+void DescriptorAllocator::release() {
+
+	for ( auto pool : _readyPools ) {
+
+		vkDestroyDescriptorPool( _device, pool, nullptr );
+	}
+
+	for ( auto pool : _fullPools ) {
+
+		vkDestroyDescriptorPool( _device, pool, nullptr );
+	}
+
+	_readyPools.clear();
+	_fullPools.clear();
+}
+
+// Takes a pool out of the ready list, allocate puts it back unless it's full
+VkDescriptorPool DescriptorAllocator::getPool() {
+
+	if ( !_readyPools.empty() ) {
+
+		VkDescriptorPool pool = _readyPools.back();
+		_readyPools.pop_back();
+
+		return pool;
+	}
+
+	// Each new pool is larger, so a busy frame settles on a few pools quickly
+	_setsPerPool = std::min( _setsPerPool + _setsPerPool / 2, MAX_SETS_PER_POOL );
+
+	return createPool( _setsPerPool );
+}
+
+VkDescriptorPool DescriptorAllocator::createPool( uint setCount ) {
+
+	vector<VkDescriptorPoolSize> poolSizes;
+
+	for ( const auto& ratio : _ratios ) {
+
+		poolSizes.push_back( VkDescriptorPoolSize {
+			.type = ratio.type,
+			.descriptorCount = std::max( static_cast<uint>( ratio.ratio * setCount ), 1u ),
+		});
+	}
+
+	VkDescriptorPoolCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = 0,
+		.maxSets = setCount,
+		.poolSizeCount = static_cast<uint>( poolSizes.size() ),
+		.pPoolSizes = poolSizes.data(),
+	};
+
+	VkDescriptorPool pool;
+
+	if ( vkCreateDescriptorPool( _device, &createInfo, nullptr, &pool ) != VK_SUCCESS ) {
+
+		throw std::runtime_error( "Failed to create descriptor pool" );
+	}
+
+	return pool;
+}
+
+void DescriptorWriter::writeBuffer( VkDescriptorSet set, uint binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize range ) {
+
+	auto& bufferInfo = _bufferInfos.emplace_back( VkDescriptorBufferInfo {
+		.buffer = buffer,
+		.offset = 0,
+		.range = range,
+	});
+
+	_writes.push_back( VkWriteDescriptorSet {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = binding,
+		.dstArrayElement = 0,
+		.descriptorCount = 1,
+		.descriptorType = type,
+		.pImageInfo = nullptr,
+		.pBufferInfo = &bufferInfo,
+		.pTexelBufferView = nullptr,
+	});
+}
+
+void DescriptorWriter::writeImage( VkDescriptorSet set, uint binding, VkDescriptorType type, VkImageView view, VkSampler sampler, VkImageLayout layout ) {
+
+	auto& imageInfo = _imageInfos.emplace_back( VkDescriptorImageInfo {
+		.sampler = sampler,
+		.imageView = view,
+		.imageLayout = layout,
+	});
+
+	_writes.push_back( VkWriteDescriptorSet {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = binding,
+		.dstArrayElement = 0,
+		.descriptorCount = 1,
+		.descriptorType = type,
+		.pImageInfo = &imageInfo,
+		.pBufferInfo = nullptr,
+		.pTexelBufferView = nullptr,
+	});
+}
+
+void DescriptorWriter::flush( VkDevice device ) {
+
+	if ( !_writes.empty() ) {
+
+		vkUpdateDescriptorSets( device, _writes.size(), _writes.data(), 0, nullptr );
+	}
+
+	_writes.clear();
+	_bufferInfos.clear();
+	_imageInfos.clear();
+}
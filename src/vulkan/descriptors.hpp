@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+using std::vector;
+
+// Deduplicates set layouts by their bindings, layouts live until release
+class DescriptorLayoutCache {
+
+	struct LayoutKey {
+		vector<VkDescriptorSetLayoutBinding> bindings; // sorted by binding number
+
+		bool operator==( const LayoutKey& other ) const;
+	};
+
+	struct LayoutKeyHash {
+		size_t operator()( const LayoutKey& key ) const;
+	};
+
+public:
+
+	void init( VkDevice device );
+
+	VkDescriptorSetLayout get( vector<VkDescriptorSetLayoutBinding> bindings );
+
+	void release();
+
+private:
+
+	VkDevice _device = VK_NULL_HANDLE;
+	std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> _layouts;
+};
+
+// Descriptors of a type each set is expected to need on average, pools are sized from it
+struct PoolRatio {
+	VkDescriptorType type;
+	float ratio;
+};
+
+// Hands out sets from a growing list of pools. Once a pool runs out, a larger one is created instead
+// of failing, so callers don't size pools by hand. Sets are never freed one by one: reset returns all
+// pools at once, which is cheap enough to do every frame once the frame using them has completed
+class DescriptorAllocator {
+
+public:
+
+	void init( VkDevice device, uint setsPerPool, const vector<PoolRatio>& ratios );
+
+	VkDescriptorSet allocate( VkDescriptorSetLayout layout );
+
+	// Invalidates every set allocated so far, the GPU must be done with them
+	void reset();
+
+	void release();
+
+private:
+
+	VkDescriptorPool getPool();
+	VkDescriptorPool createPool( uint setCount );
+
+	VkDevice _device = VK_NULL_HANDLE;
+	vector<PoolRatio> _ratios;
+	vector<VkDescriptorPool> _readyPools;
+	vector<VkDescriptorPool> _fullPools;
+	uint _setsPerPool = 0;
+};
+
+// Collects writes for any number of sets and submits them in one vkUpdateDescriptorSets call
+class DescriptorWriter {
+
+public:
+
+	void writeBuffer( VkDescriptorSet set, uint binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize range = VK_WHOLE_SIZE );
+	void writeImage( VkDescriptorSet set, uint binding, VkDescriptorType type, VkImageView view, VkSampler sampler, VkImageLayout layout );
+
+	void flush( VkDevice device );
+
+private:
+
+	// Deques keep info pointers stable while writes are being added
+	std::deque<VkDescriptorBufferInfo> _bufferInfos;
+	std::deque<VkDescriptorImageInfo> _imageInfos;
+	vector<VkWriteDescriptorSet> _writes;
+};
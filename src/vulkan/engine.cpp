@@ -9,10 +9,12 @@
 #include <array>
 #include <cmath>
 #include <cstring>
+#include <exception>
 #include <iostream>
 #include <set>
 #include <stdexcept>
 #include <limits>
+#include <unistd.h>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
@@ -21,11 +23,17 @@
 #include <glm/trigonometric.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 
+#include "types/light.hpp"
 #include "types/uniform_buffer.hpp"
 #include "types/qfamily_indices.hpp"
 #include "types/vertex.hpp"
+#include "shader_compiler.hpp"
 #include "../media/image.hpp"
+#include "../media/mip_chain.hpp"
 #include "../media/model.hpp"
+#include "../hash.hpp"
+#include "../jobs.hpp"
+#include "../parallel.hpp"
 
 #ifdef NDEBUG
 	const bool enableValidationLayers = false;
@@ -39,16 +47,120 @@ const vector<const char*> validationLayers = {
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Joint palette capacity, each animated instance takes MAX_JOINTS matrices
+const int MAX_ANIMATED_INSTANCES = 64;
+
+const char *mainVertShaderPath = "shaders/main.vert.spv";
+const char *mainFragShaderPath = "shaders/main.frag.spv";
+const char *mainVertShaderSource = "shaders/main.vert";
+const char *mainFragShaderSource = "shaders/main.frag";
+const char *depthVertShaderPath = "shaders/depth.vert.spv";
+const char *depthVertShaderSource = "shaders/depth.vert";
+const char *shadowVertShaderPath = "shaders/shadow.vert.spv";
+const char *shadowVertShaderSource = "shaders/shadow.vert";
+const char *clusterCompShaderPath = "shaders/cluster_lights.comp.spv";
+const char *clusterCompShaderSource = "shaders/cluster_lights.comp";
+const char *cullCompShaderPath = "shaders/occlusion_cull.comp.spv";
+const char *cullCompShaderSource = "shaders/occlusion_cull.comp";
+
+// Indexed by PostShader
+const char *postShaderPaths[POST_SHADER_COUNT] = {
+	"shaders/bloom_downsample.comp.spv",
+	"shaders/bloom_upsample.comp.spv",
+	"shaders/tonemap.comp.spv",
+	"shaders/fxaa.comp.spv",
+	"shaders/hiz_reduce.comp.spv",
+};
+const char *postShaderSources[POST_SHADER_COUNT] = {
+	"shaders/bloom_downsample.comp",
+	"shaders/bloom_upsample.comp",
+	"shaders/tonemap.comp",
+	"shaders/fxaa.comp",
+	"shaders/hiz_reduce.comp",
+};
+
+// Indexed by PostEffect
+const char *postEffectNames[POST_EFFECT_COUNT] = { "bloom", "tonemap", "fxaa" };
+
+// Cascaded shadow maps, resolution is per cascade tile of the atlas
+const uint SHADOW_MAP_RESOLUTION = 1024;
+const float SHADOW_DISTANCE = 120.f;
+
+// Points from the light towards the scene, world up is -z
+const glm::vec3 LIGHT_DIRECTION = glm::normalize( glm::vec3( 0.4f, 0.3f, 1.f ) );
+
+// Procedural lights orbiting the model, every SPOT_LIGHT_INTERVAL-th one is a spot light
+const int LIGHT_COUNT = 64;
+const int SPOT_LIGHT_INTERVAL = 4;
+
+// Light BVH is rebuilt when refits have made its expected query cost this much worse than after a build
+const float BVH_REBUILD_RATIO = 1.5f;
+
+// Depth range sliced into clusters, lights beyond it all share the last slice
+const float LIGHT_CLUSTER_DISTANCE = 200.f;
+
+// VRAM textures may take, lowered to what the heap has left when VK_EXT_memory_budget is available
+const VkDeviceSize TEXTURE_BUDGET = 256 * 1024 * 1024;
+
+// Initial size of per-frame descriptor pools
+const uint DESCRIPTOR_SETS_PER_POOL = 16;
+
+// Scene is rendered in linear HDR, the post chain brings it down to display range
+const VkFormat HDR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+const VkFormat LDR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+const float EXPOSURE = 1.f;
+
+// Levels below the HDR target, each half the size of the previous one
+const int BLOOM_LEVELS = 5;
+const float BLOOM_THRESHOLD = 1.f;
+const float BLOOM_STRENGTH = 0.05f;
+
+const uint POST_GROUP_SIZE = 8;
+
+// Hi-Z pyramid keeps the farthest depth per texel, starting at half the depth resolution
+const VkFormat HIZ_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+// Chunks per occlusion cull group, must match occlusion_cull.comp
+const uint CULL_GROUP_SIZE = 64;
+
+// Frame begin and end, then begin and end of each post effect
+const int TIMESTAMPS_PER_FRAME = 2 + POST_EFFECT_COUNT * 2;
+
+// Starting anisotropy, adjustable at runtime since full anisotropy everywhere costs bandwidth
+const float DEFAULT_MAX_ANISOTROPY = 8.f;
+
+// Frames averaged for each GPU time report
+const int GPU_TIME_REPORT_INTERVAL = 300;
+
 bool isStrEqual( const char *a, const char *b ) {
 
 	return strcmp( a, b ) == 0;
 }
 
+// Frames, uploads and queues are synchronized with timeline semaphores
 const vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-	VK_KHR_MAINTENANCE1_EXTENSION_NAME
+	VK_KHR_MAINTENANCE1_EXTENSION_NAME,
+	VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
+};
+
+// Enabled when present, render pass and framebuffers are used otherwise
+const vector<const char*> dynamicRenderingExtensions = {
+	VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+	VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME
 };
 
+static bool hasExtension( const vector<VkExtensionProperties>& extensions, const char *name ) {
+
+	return std::any_of( extensions.begin(), extensions.end(),
+		[name] ( const auto& extension ) { return isStrEqual( name, extension.extensionName ); } );
+}
+
+static bool hasStencilComponent( VkFormat format ) {
+
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
 void VulkanEngine::setup( SDL_Window* window ) {
 
 	_safe = true;
@@ -59,26 +171,64 @@ void VulkanEngine::setup( SDL_Window* window ) {
 	}
 
 	_window = window;
+	_startTime = std::chrono::high_resolution_clock::now();
+	_assets = Assets::open( "assets.pak" );
+
+	if ( ShaderCompiler::isAvailable() ) {
+
+		_shaderCompiler = std::make_unique<ShaderCompiler>( "shader_cache" );
+	}
 
 	createInstance( window );
 	createWindowSurface( window );
 	pickPhysicalDevice();
+	detectDynamicRendering();
+	detectMemoryBudget();
+	detectAsyncCompute();
+	chooseMsaaSamples();
+	_depthFormat = findDepthFormat();
+	_shadowFormat = findShadowFormat();
+	detectOcclusionCulling();
 	createLogicalDevice();
+	createSamplerCache();
 	createSwapChain();
 	createSwapChainImageViews();
-	createRenderPass();
+
+	if ( !_hasDynamicRendering ) {
+
+		createRenderPass();
+		createShadowRenderPass();
+	}
+
 	createDescriptorSetlayout();
 	createRenderPipeline();
 	createSyncObjects();
+	createTimestampQueries();
 	createCommandPool();
-	createCommandBuffers();
-	createDepthResources();
-	createFramebuffers();
+	createQueues();
+	_deletionQueue.init( _device );
+	createShadowResources();
+
+	if ( _canCullOcclusion ) {
+
+		createHizResources();
+	}
+
+	createRenderGraph();
+
+	if ( !_hasDynamicRendering ) {
+
+		createFramebuffers();
+	}
+
+	_textureStreamer.init( _device, _physicalDevice, TEXTURE_BUDGET, _hasMemoryBudget );
 	loadModel();
 	createUniformBuffer();
-	createDescriptorPool();
+	createJointPaletteBuffers();
+	createLightBuffers();
+	createDescriptorAllocators();
 	createTextureSampler();
-	allocDescriptorSets();
+	startHotReload();
 }
 
 bool VulkanEngine::checkValidationLayerSupport() {
@@ -113,7 +263,7 @@ void VulkanEngine::createInstance( SDL_Window* window ) {
 		.applicationVersion = 0,
 		.pEngineName = "open-devil-engine",
 		.engineVersion = 0,
-		.apiVersion = VK_API_VERSION_1_0
+		.apiVersion = VK_API_VERSION_1_2
 	};
 
 	// List required SDL extensions for Vulkan
@@ -193,6 +343,161 @@ void VulkanEngine::pickPhysicalDevice() {
 	std::cout << "Device picked: (" << props.deviceID << ") " << props.deviceName << std::endl;
 }
 
+void VulkanEngine::detectDynamicRendering() {
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties( _physicalDevice, &props );
+
+	// Extensions depend on 1.2 core features (depth stencil resolve, physical device properties 2)
+	if ( props.apiVersion < VK_API_VERSION_1_2 ) {
+
+		return;
+	}
+
+	uint extensionsCount;
+	vkEnumerateDeviceExtensionProperties( _physicalDevice, nullptr, &extensionsCount, nullptr );
+
+	vector<VkExtensionProperties> availableExtensions( extensionsCount );
+	vkEnumerateDeviceExtensionProperties( _physicalDevice, nullptr, &extensionsCount, availableExtensions.data() );
+
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+	};
+
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+		.pNext = &synchronization2Features,
+	};
+
+	VkPhysicalDeviceFeatures2 features {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &dynamicRenderingFeatures,
+	};
+
+	vkGetPhysicalDeviceFeatures2( _physicalDevice, &features );
+
+	_hasSynchronization2 = hasExtension( availableExtensions, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME ) &&
+						   synchronization2Features.synchronization2;
+
+	// Dynamic rendering path transitions attachments itself, so it's only used together with synchronization 2
+	_hasDynamicRendering = _hasSynchronization2 &&
+						   hasExtension( availableExtensions, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME ) &&
+						   dynamicRenderingFeatures.dynamicRendering;
+
+	std::cout << "Rendering path: " << ( _hasDynamicRendering ? "dynamic rendering" : "render pass" ) << std::endl;
+}
+
+void VulkanEngine::detectMemoryBudget() {
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties( _physicalDevice, &props );
+
+	// Budget is queried with physical device properties 2
+	if ( props.apiVersion < VK_API_VERSION_1_1 ) {
+
+		return;
+	}
+
+	uint extensionsCount;
+	vkEnumerateDeviceExtensionProperties( _physicalDevice, nullptr, &extensionsCount, nullptr );
+
+	vector<VkExtensionProperties> availableExtensions( extensionsCount );
+	vkEnumerateDeviceExtensionProperties( _physicalDevice, nullptr, &extensionsCount, availableExtensions.data() );
+
+	_hasMemoryBudget = hasExtension( availableExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+}
+
+// Async compute needs a compute only family, queues wait for each other with timeline semaphores
+void VulkanEngine::detectAsyncCompute() {
+
+	_computeFamily = findQueueFamilies( _physicalDevice, _surface ).computeFamily;
+	_hasAsyncCompute = _computeFamily.has_value();
+
+	if ( _hasAsyncCompute ) {
+
+		std::cout << "Async compute: queue family " << _computeFamily.value() << std::endl;
+	} else {
+
+		std::cout << "Async compute: unavailable, compute passes run on the graphics queue" << std::endl;
+	}
+}
+
+// Culling runs between the depth pre-pass and its second half, so it needs dynamic rendering. The pyramid
+// is built by sampling depth, depth formats with stencil would need a separate view per aspect
+void VulkanEngine::detectOcclusionCulling() {
+
+	VkPhysicalDeviceProperties props;
+	VkPhysicalDeviceFeatures features;
+	VkFormatProperties depthProps;
+
+	vkGetPhysicalDeviceProperties( _physicalDevice, &props );
+	vkGetPhysicalDeviceFeatures( _physicalDevice, &features );
+	vkGetPhysicalDeviceFormatProperties( _physicalDevice, _depthFormat, &depthProps );
+
+	// Without multi draw indirect every chunk is its own indirect draw
+	_maxDrawIndirectCount = features.multiDrawIndirect ? props.limits.maxDrawIndirectCount : 1;
+
+	_canCullOcclusion = _hasDynamicRendering &&
+						!hasStencilComponent( _depthFormat ) &&
+						( depthProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT );
+
+	if ( !_canCullOcclusion ) {
+
+		std::cout << "Occlusion culling: unavailable" << std::endl;
+		return;
+	}
+
+	// Farthest sample keeps the pyramid conservative. Any other resolve could cull geometry behind a nearer
+	// sample, so without it occlusion culling is off under MSAA
+	VkPhysicalDeviceDepthStencilResolveProperties resolveProps {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEPTH_STENCIL_RESOLVE_PROPERTIES,
+	};
+
+	VkPhysicalDeviceProperties2 props2 {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &resolveProps,
+	};
+
+	vkGetPhysicalDeviceProperties2( _physicalDevice, &props2 );
+
+	if ( _msaaSamples != VK_SAMPLE_COUNT_1_BIT && !( resolveProps.supportedDepthResolveModes & VK_RESOLVE_MODE_MAX_BIT ) ) {
+
+		_canCullOcclusion = false;
+
+		std::cout << "Occlusion culling: unavailable, MSAA depth can't be resolved to the farthest sample" << std::endl;
+		return;
+	}
+
+	std::cout << "Occlusion culling: " << ( _maxDrawIndirectCount > 1 ? "multi draw indirect" : "draw indirect per chunk" ) << std::endl;
+}
+
+// Render pass, attachments and pipelines are all built for the sample count, so it is only read at setup
+void VulkanEngine::setMsaaSamples( VkSampleCountFlagBits samples ) {
+
+	_requestedMsaaSamples = samples;
+}
+
+void VulkanEngine::chooseMsaaSamples() {
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties( _physicalDevice, &props );
+
+	VkSampleCountFlags supported = props.limits.framebufferColorSampleCounts & props.limits.framebufferDepthSampleCounts;
+
+	_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	for ( auto samples : { VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT } ) {
+
+		if ( samples <= _requestedMsaaSamples && ( supported & samples ) ) {
+
+			_msaaSamples = samples;
+			break;
+		}
+	}
+
+	std::cout << "MSAA: " << _msaaSamples << "x" << std::endl;
+}
+
 bool VulkanEngine::isSuitableDevice( VkPhysicalDevice device ) {
 
 	VkPhysicalDeviceProperties props;
@@ -205,6 +510,7 @@ bool VulkanEngine::isSuitableDevice( VkPhysicalDevice device ) {
 
 	bool areExtensionsSupported = checkDeviceExtensionsSupported( device );
 	bool swapChainAdequate = false;
+	bool hasTimelineSemaphores = false;
 
 	if ( areExtensionsSupported ) {
 
@@ -212,11 +518,28 @@ bool VulkanEngine::isSuitableDevice( VkPhysicalDevice device ) {
 		swapChainAdequate = swapChainSupport.isComplete();
 	}
 
+	// Extension alone doesn't guarantee the feature, it's queried with physical device properties 2
+	if ( areExtensionsSupported && props.apiVersion >= VK_API_VERSION_1_1 ) {
+
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+		};
+
+		VkPhysicalDeviceFeatures2 features2 {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &timelineFeatures,
+		};
+
+		vkGetPhysicalDeviceFeatures2( device, &features2 );
+		hasTimelineSemaphores = timelineFeatures.timelineSemaphore;
+	}
+
 	return props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
 		   features.geometryShader &&
 		   features.samplerAnisotropy &&
 		   areExtensionsSupported && 
 		   swapChainAdequate &&
+		   hasTimelineSemaphores &&
 		   queueFamilyIndices.isComplete();
 }
 
@@ -245,11 +568,15 @@ bool VulkanEngine::checkDeviceExtensionsSupported( VkPhysicalDevice device ) {
 
 VkSurfaceFormatKHR VulkanEngine::chooseSwapSurfaceFormat( const vector<VkSurfaceFormatKHR>& availableFormats ) {
 
-	for ( const auto& availableFormat : availableFormats) {
+	// Post chain encodes sRGB itself, so a UNORM swapchain takes its output as is
+	for ( VkFormat format : { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB } ) {
 
-		if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+		for ( const auto& availableFormat : availableFormats) {
 
-			return availableFormat;
+			if (availableFormat.format == format && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+
+				return availableFormat;
+			}
 		}
 	}
 
@@ -299,6 +626,11 @@ void VulkanEngine::createLogicalDevice() {
 		familyIndices.graphicsFamily.value(), 
 		familyIndices.presentFamily.value() };
 
+	if ( _hasAsyncCompute ) {
+
+		uniqueQueueFamilies.insert( _computeFamily.value() );
+	}
+
 	float queuePriorities[1] = { 1.0f };
 
 	for (uint queueFamilyIndex : uniqueQueueFamilies ) {
@@ -315,14 +647,53 @@ void VulkanEngine::createLogicalDevice() {
 
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = _maxDrawIndirectCount > 1;
+
+	vector<const char*> enabledExtensions = deviceExtensions;
+
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+		.synchronization2 = VK_TRUE,
+	};
+
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+		.pNext = &synchronization2Features,
+		.dynamicRendering = VK_TRUE,
+	};
+
+	void *featureChain = nullptr;
+
+	if ( _hasDynamicRendering ) {
+
+		enabledExtensions.insert( enabledExtensions.end(), dynamicRenderingExtensions.begin(), dynamicRenderingExtensions.end() );
+		featureChain = &dynamicRenderingFeatures;
+
+	} else if ( _hasSynchronization2 ) {
+
+		enabledExtensions.push_back( VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME );
+		featureChain = &synchronization2Features;
+	}
+
+	if ( _hasMemoryBudget ) {
+
+		enabledExtensions.push_back( VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+	}
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+		.pNext = featureChain,
+		.timelineSemaphore = VK_TRUE,
+	};
 
 	VkDeviceCreateInfo deviceCreateInfo {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.pNext = &timelineFeatures,
 		.queueCreateInfoCount = static_cast<uint>(queueCreateInfos.size()),
 		.pQueueCreateInfos = queueCreateInfos.data(),
 		.enabledLayerCount = 0,
-		.enabledExtensionCount = static_cast<uint>(deviceExtensions.size()),
-		.ppEnabledExtensionNames = deviceExtensions.data(),
+		.enabledExtensionCount = static_cast<uint>(enabledExtensions.size()),
+		.ppEnabledExtensionNames = enabledExtensions.data(),
 		.pEnabledFeatures = &deviceFeatures,
 	};
 
@@ -339,6 +710,23 @@ void VulkanEngine::createLogicalDevice() {
 
 	vkGetDeviceQueue( _device, familyIndices.graphicsFamily.value(), 0, &_graphicsQueue);
 	vkGetDeviceQueue( _device, familyIndices.presentFamily.value(), 0, &_presentQueue);
+
+	if ( _hasAsyncCompute ) {
+
+		vkGetDeviceQueue( _device, _computeFamily.value(), 0, &_computeQueue );
+	}
+
+	// Extension commands aren't exported by the loader
+	if ( _hasSynchronization2 ) {
+
+		_cmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>( vkGetDeviceProcAddr( _device, "vkCmdPipelineBarrier2KHR" ) );
+	}
+
+	if ( _hasDynamicRendering ) {
+
+		_cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>( vkGetDeviceProcAddr( _device, "vkCmdBeginRenderingKHR" ) );
+		_cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>( vkGetDeviceProcAddr( _device, "vkCmdEndRenderingKHR" ) );
+	}
 }
 
 void VulkanEngine::createSwapChain() {
@@ -357,6 +745,20 @@ void VulkanEngine::createSwapChain() {
 		imageCount = supportDetails.capabilities.maxImageCount;
 	}
 
+	// Post chain blits its result in, readback for frame stats copies out of the swapchain images
+	if ( !( supportDetails.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT ) ) {
+
+		throw std::runtime_error( "Vulkan API: swap chain images can't be blitted to" );
+	}
+
+	VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	_canReadback = supportDetails.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+	if ( _canReadback ) {
+
+		imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+
 	VkSwapchainCreateInfoKHR createInfo{
 		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 		.surface = _surface,
@@ -365,7 +767,7 @@ void VulkanEngine::createSwapChain() {
 		.imageColorSpace = surfaceFormat.colorSpace,
 		.imageExtent = extent,
 		.imageArrayLayers = 1,
-		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		.imageUsage = imageUsage,
 		.preTransform = supportDetails.capabilities.currentTransform,
 		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 		.presentMode = presentMode,
@@ -399,6 +801,9 @@ void VulkanEngine::createSwapChain() {
 	vkGetSwapchainImagesKHR( _device, _swapchain, &imageCount, _swapchainImages.data() );
 
 	_swapchainImageFormat = surfaceFormat.format;
+	_isSwapchainSrgb = surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB ||
+					   surfaceFormat.format == VK_FORMAT_R8G8B8A8_SRGB ||
+					   surfaceFormat.format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
 	_swapchainExtent = extent;
 }
 
@@ -417,17 +822,21 @@ void VulkanEngine::createSwapChainImageViews() {
 	}
 }
 
+// Multisampled attachments are resolved into the HDR target at the end of the subpass and never stored,
+// so on tile-based GPUs they stay in tile memory
 void VulkanEngine::createRenderPass() {
 
+	bool isMultisampled = _msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
 	VkAttachmentDescription colorAttachment {
-		.format = _swapchainImageFormat,
-		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.format = HDR_FORMAT,
+		.samples = _msaaSamples,
 		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.storeOp = isMultisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
 		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+		.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	};
 
 	VkAttachmentReference colorAttachmentRef {
@@ -436,13 +845,13 @@ void VulkanEngine::createRenderPass() {
 	};
 
 	VkAttachmentDescription depthAttachment {
-		.format = findDepthFormat(),
-		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.format = _depthFormat,
+		.samples = _msaaSamples,
 		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
 		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 	};
 
@@ -451,32 +860,45 @@ void VulkanEngine::createRenderPass() {
 		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 	};
 
+	VkAttachmentDescription resolveAttachment {
+		.format = HDR_FORMAT,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	};
+
+	VkAttachmentReference resolveAttachmentRef {
+		.attachment = 2,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	};
+
 	VkSubpassDescription subpass {
 		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
 		.colorAttachmentCount = 1,
 		.pColorAttachments = &colorAttachmentRef,
+		.pResolveAttachments = isMultisampled ? &resolveAttachmentRef : nullptr,
 		.pDepthStencilAttachment = &depthAttachmentRef
 	};
 
-	VkSubpassDependency dependency { 
-		.srcSubpass = VK_SUBPASS_EXTERNAL, 
-		.dstSubpass = 0,
-		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-		.srcAccessMask = 0,
-		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-	};
+	vector<VkAttachmentDescription> attachments = { colorAttachment, depthAttachment };
+
+	if ( isMultisampled ) {
 
-	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+		attachments.push_back( resolveAttachment );
+	}
 
 	VkRenderPassCreateInfo createInfo {
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-		.attachmentCount = attachments.size(),
+		.attachmentCount = static_cast<uint>( attachments.size() ),
 		.pAttachments = attachments.data(),
 		.subpassCount = 1,
 		.pSubpasses = &subpass,
-		.dependencyCount = 1,
-		.pDependencies = &dependency
+		.dependencyCount = 0, // layout transitions and dependencies are recorded by the render graph
+		.pDependencies = nullptr
 	};
 
 	if ( vkCreateRenderPass( _device, &createInfo, nullptr, &_renderPass ) != VK_SUCCESS ) {
@@ -485,70 +907,201 @@ void VulkanEngine::createRenderPass() {
 	}
 }
 
-void VulkanEngine::createRenderPipeline() {
-
-	_mainShader = Shader::loadShader( _device, "shaders/main.vert.spv", "shaders/main.frag.spv");
+// Render pass fallback for the shadow atlas, layouts are handled by the render graph
+void VulkanEngine::createShadowRenderPass() {
 
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_VERTEX_BIT,
-		.module = _mainShader.getVertexShaderModule(),
-		.pName = "main"
+	VkAttachmentDescription depthAttachment {
+		.format = _shadowFormat,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 	};
 
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.module = _mainShader.getFragmentShaderModule(),
-		.pName = "main"
+	VkAttachmentReference depthAttachmentRef {
+		.attachment = 0,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 	};
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkSubpassDescription subpass {
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 0,
+		.pDepthStencilAttachment = &depthAttachmentRef,
+	};
 
-	VkPipelineDynamicStateCreateInfo dynamicState {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-		.dynamicStateCount = static_cast<uint>(dynamicStates.size()),
-		.pDynamicStates = dynamicStates.data()
+	VkRenderPassCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &depthAttachment,
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
 	};
 
-	// Vertex input attribute description
-	auto bindingDesc = Vertex::getBindingDescription();
-	auto attrsDesc = Vertex::getAttributeDescription();
+	if ( vkCreateRenderPass( _device, &createInfo, nullptr, &_shadowRenderPass ) != VK_SUCCESS ) {
 
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions = &bindingDesc,
-		.vertexAttributeDescriptionCount = attrsDesc.size(),
-		.pVertexAttributeDescriptions = attrsDesc.data(),
-	};
+		throw std::runtime_error( "Failed to create shadow render pass" );
+	}
+}
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.primitiveRestartEnable = VK_FALSE,  
-	};
+void VulkanEngine::createRenderPipeline() {
 
-	float width = static_cast<float>(std::round(_swapchainExtent.width));
-	float height = static_cast<float>(std::round(_swapchainExtent.height));
+	_mainShader = loadMainShader( false );
 
-	VkViewport viewport {
-		.x = 0.f,
-		.y = height, // invert y
-		.width = width,
-		.height = -height, // invert y
-		.minDepth = 0.f,
-		.maxDepth = 1.f
+	// Shadow pass selects the cascade with a push constant
+	VkPushConstantRange pushConstantRange {
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.offset = 0,
+		.size = sizeof( uint ),
 	};
 
-	VkRect2D scissor {
-		.offset = {0, 0},
-		.extent = _swapchainExtent
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &_descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstantRange,
 	};
 
-	VkPipelineViewportStateCreateInfo viewportState {
+	if ( vkCreatePipelineLayout( _device, &pipelineLayoutCreateInfo, nullptr, &_pipelineLayout ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Unable to create pipeline layout");
+	}
+
+	_mainGraphicsPipeline = createMainPipeline( _mainShader, _depthPrepass );
+
+	if ( _hasDynamicRendering ) {
+
+		VkShaderModule depthShader = loadShaderModule( depthVertShaderPath, depthVertShaderSource, ShaderStage::Vertex, false );
+
+		_depthPrepassPipeline = createDepthOnlyPipeline( depthShader, false );
+		vkDestroyShaderModule( _device, depthShader, nullptr );
+	}
+
+	VkShaderModule shadowShader = loadShaderModule( shadowVertShaderPath, shadowVertShaderSource, ShaderStage::Vertex, false );
+
+	_shadowPipeline = createDepthOnlyPipeline( shadowShader, true );
+	vkDestroyShaderModule( _device, shadowShader, nullptr );
+
+	VkShaderModule clusterShader = loadShaderModule( clusterCompShaderPath, clusterCompShaderSource, ShaderStage::Compute, false );
+
+	_clusterPipeline = createClusterPipeline( clusterShader );
+	vkDestroyShaderModule( _device, clusterShader, nullptr );
+
+	if ( _canCullOcclusion ) {
+
+		VkShaderModule cullShader = loadShaderModule( cullCompShaderPath, cullCompShaderSource, ShaderStage::Compute, false );
+
+		createCullPipelineLayout();
+		_cullPipeline = createCullPipeline( cullShader );
+		vkDestroyShaderModule( _device, cullShader, nullptr );
+	}
+
+	createPostPipelineLayout();
+	_postPipelines = createPostPipelines( false );
+}
+
+Shader VulkanEngine::loadMainShader( bool fromLooseFiles ) {
+
+	// Compile GLSL at runtime when sources are shipped alongside, otherwise use SPIR-V built by the Makefile
+	bool hasSources = access( mainVertShaderSource, R_OK ) == 0 && access( mainFragShaderSource, R_OK ) == 0;
+
+	if ( _shaderCompiler && hasSources ) {
+
+		auto vertShaderCode = _shaderCompiler->compileAsync( mainVertShaderSource, ShaderStage::Vertex );
+		auto fragShaderCode = _shaderCompiler->compileAsync( mainFragShaderSource, ShaderStage::Fragment );
+
+		return Shader::loadShader( _device, vertShaderCode.get(), fragShaderCode.get() );
+	}
+
+	if ( fromLooseFiles ) {
+
+		return Shader::loadShader( _device, 
+			Asset::mapped( File::openBinary( mainVertShaderPath ) ), 
+			Asset::mapped( File::openBinary( mainFragShaderPath ) ) );
+	}
+
+	return Shader::loadShader( _device, _assets.read( mainVertShaderPath ), _assets.read( mainFragShaderPath ) );
+}
+
+VkShaderModule VulkanEngine::loadShaderModule( const char *binaryPath, const char *sourcePath, ShaderStage stage, bool fromLooseFiles ) {
+
+	if ( _shaderCompiler && access( sourcePath, R_OK ) == 0 ) {
+
+		auto code = _shaderCompiler->compile( sourcePath, stage );
+		return Shader::createShaderModule( _device, code.getData(), code.getSize() );
+	}
+
+	auto code = fromLooseFiles ? Asset::mapped( File::openBinary( binaryPath ) ) : _assets.read( binaryPath );
+
+	return Shader::createShaderModule( _device, code.getData(), code.getSize() );
+}
+
+// Only reads handles which stay the same for the engine lifetime, so it can be called from the reload thread
+VkPipeline VulkanEngine::createMainPipeline( Shader& shader, bool afterDepthPrepass ) {
+
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = shader.getVertexShaderModule(),
+		.pName = "main"
+	};
+
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = shader.getFragmentShaderModule(),
+		.pName = "main"
+	};
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+	vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = static_cast<uint>(dynamicStates.size()),
+		.pDynamicStates = dynamicStates.data()
+	};
+
+	// Vertex input attribute description
+	auto bindingDesc = Vertex::getBindingDescription();
+	auto attrsDesc = Vertex::getAttributeDescription();
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &bindingDesc,
+		.vertexAttributeDescriptionCount = attrsDesc.size(),
+		.pVertexAttributeDescriptions = attrsDesc.data(),
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		.primitiveRestartEnable = VK_FALSE,  
+	};
+
+	float width = static_cast<float>(std::round(_swapchainExtent.width));
+	float height = static_cast<float>(std::round(_swapchainExtent.height));
+
+	VkViewport viewport {
+		.x = 0.f,
+		.y = height, // invert y
+		.width = width,
+		.height = -height, // invert y
+		.minDepth = 0.f,
+		.maxDepth = 1.f
+	};
+
+	VkRect2D scissor {
+		.offset = {0, 0},
+		.extent = _swapchainExtent
+	};
+
+	VkPipelineViewportStateCreateInfo viewportState {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
 		.viewportCount = 1,
 		.pViewports = &viewport,
@@ -572,7 +1125,7 @@ void VulkanEngine::createRenderPipeline() {
 
 	VkPipelineMultisampleStateCreateInfo multisampling {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+		.rasterizationSamples = _msaaSamples,
 		.sampleShadingEnable = VK_FALSE,
 		.minSampleShading = 1.f,
 		.pSampleMask = nullptr,
@@ -599,24 +1152,12 @@ void VulkanEngine::createRenderPipeline() {
 		.blendConstants = { 0.f, 0.f, 0.f, 0.f }
 	};
 
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount = 1,
-		.pSetLayouts = &_descriptorSetLayout,
-		.pushConstantRangeCount = 0,
-		.pPushConstantRanges = nullptr,
-	};
-
-	if ( vkCreatePipelineLayout( _device, &pipelineLayoutCreateInfo, nullptr, &_pipelineLayout ) != VK_SUCCESS ) {
-
-		throw std::runtime_error("Unable to create pipeline layout");
-	}
-
+	// After the pre-pass only the visible surface passes, each pixel is shaded once
 	VkPipelineDepthStencilStateCreateInfo depthStencil {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
 		.depthTestEnable = VK_TRUE,
-		.depthWriteEnable = VK_TRUE,
-		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthWriteEnable = afterDepthPrepass ? VK_FALSE : VK_TRUE,
+		.depthCompareOp = afterDepthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS,
 		.depthBoundsTestEnable = VK_FALSE,
 		.stencilTestEnable = VK_FALSE,
 		.front = {},
@@ -625,8 +1166,18 @@ void VulkanEngine::createRenderPipeline() {
 		.maxDepthBounds = 1.0f,
 	};
 
+	// With dynamic rendering pipeline is compatible with any pass using the same attachment formats
+	VkPipelineRenderingCreateInfoKHR renderingInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &HDR_FORMAT,
+		.depthAttachmentFormat = _depthFormat,
+		.stencilAttachmentFormat = hasStencilComponent( _depthFormat ) ? _depthFormat : VK_FORMAT_UNDEFINED,
+	};
+
 	VkGraphicsPipelineCreateInfo pipelineCreateInfo {
 		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.pNext = _hasDynamicRendering ? &renderingInfo : nullptr,
 		.stageCount = 2,
 		.pStages = shaderStages,
 		.pVertexInputState = &vertexInputInfo,
@@ -638,110 +1189,472 @@ void VulkanEngine::createRenderPipeline() {
 		.pColorBlendState = &colorBlending,
 		.pDynamicState = &dynamicState,
 		.layout = _pipelineLayout,
-		.renderPass = _renderPass,
+		.renderPass = _hasDynamicRendering ? VK_NULL_HANDLE : _renderPass,
 		.subpass = 0,
 		.basePipelineHandle = VK_NULL_HANDLE,
 		.basePipelineIndex = -1,
 	};
 
-	if ( vkCreateGraphicsPipelines( _device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_mainGraphicsPipeline ) != VK_SUCCESS ) {
+	VkPipeline pipeline;
+
+	if ( vkCreateGraphicsPipelines( _device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline ) != VK_SUCCESS ) {
 
 		throw std::runtime_error("Failed to create graphics pipeline");
 	}
+
+	return pipeline;
 }
 
-void VulkanEngine::createFramebuffers() {
+// Vertex only pipeline without color attachments. Pre-pass variant matches the main pipeline's rasterization,
+// shadow caster variant renders into the single sampled shadow atlas with depth bias against acne
+VkPipeline VulkanEngine::createDepthOnlyPipeline( VkShaderModule vertShader, bool isShadowCaster ) {
 
-	for ( auto iImageView : _swapchainImageViews ) {
+	VkFormat format = isShadowCaster ? _shadowFormat : _depthFormat;
 
-		std::array<VkImageView, 2> attachments = { iImageView, _depthImageView };
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = vertShader,
+		.pName = "main"
+	};
 
-		VkFramebufferCreateInfo createInfo {
-			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-			.renderPass = _renderPass,
-			.attachmentCount = attachments.size(),
-			.pAttachments = attachments.data(),
-			.width = _swapchainExtent.width,
-			.height = _swapchainExtent.height,
-			.layers = 1
-		};
+	vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 
-		VkFramebuffer framebuffer;
+	VkPipelineDynamicStateCreateInfo dynamicState {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = static_cast<uint>(dynamicStates.size()),
+		.pDynamicStates = dynamicStates.data()
+	};
 
-		if ( vkCreateFramebuffer( _device, &createInfo, nullptr, &framebuffer ) != VK_SUCCESS ) {
+	auto bindingDesc = DepthVertex::getBindingDescription();
+	auto attrsDesc = DepthVertex::getAttributeDescription();
 
-			throw std::runtime_error("Failed to create framebuffer");
-		}
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &bindingDesc,
+		.vertexAttributeDescriptionCount = attrsDesc.size(),
+		.pVertexAttributeDescriptions = attrsDesc.data(),
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		.primitiveRestartEnable = VK_FALSE,
+	};
+
+	VkPipelineViewportStateCreateInfo viewportState {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount = 1,
+	};
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = VK_CULL_MODE_BACK_BIT,
+		.frontFace = VK_FRONT_FACE_CLOCKWISE,
+		.depthBiasEnable = isShadowCaster ? VK_TRUE : VK_FALSE,
+		.depthBiasConstantFactor = isShadowCaster ? 1.25f : 0.f,
+		.depthBiasClamp = 0.f,
+		.depthBiasSlopeFactor = isShadowCaster ? 1.75f : 0.f,
+		.lineWidth = 1.f,
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisampling {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = isShadowCaster ? VK_SAMPLE_COUNT_1_BIT : _msaaSamples,
+		.sampleShadingEnable = VK_FALSE,
+		.minSampleShading = 1.f,
+	};
+
+	VkPipelineColorBlendStateCreateInfo colorBlending {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.logicOpEnable = VK_FALSE,
+		.attachmentCount = 0,
+	};
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = VK_TRUE,
+		.depthWriteEnable = VK_TRUE,
+		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE,
+		.minDepthBounds = 0.0f,
+		.maxDepthBounds = 1.0f,
+	};
+
+	VkPipelineRenderingCreateInfoKHR renderingInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+		.colorAttachmentCount = 0,
+		.depthAttachmentFormat = format,
+		.stencilAttachmentFormat = hasStencilComponent( format ) ? format : VK_FORMAT_UNDEFINED,
+	};
+
+	// No fragment stage, depth is written by fixed function tests only
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo {
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.pNext = _hasDynamicRendering ? &renderingInfo : nullptr,
+		.stageCount = 1,
+		.pStages = &vertShaderStageInfo,
+		.pVertexInputState = &vertexInputInfo,
+		.pInputAssemblyState = &inputAssembly,
+		.pViewportState = &viewportState,
+		.pRasterizationState = &rasterizer,
+		.pMultisampleState = &multisampling,
+		.pDepthStencilState = &depthStencil,
+		.pColorBlendState = &colorBlending,
+		.pDynamicState = &dynamicState,
+		.layout = _pipelineLayout,
+		.renderPass = _hasDynamicRendering ? VK_NULL_HANDLE : _shadowRenderPass, // pre-pass needs dynamic rendering
+		.subpass = 0,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = -1,
+	};
+
+	VkPipeline pipeline;
 
-		_swapchainFramebuffers.push_back( framebuffer );
+	if ( vkCreateGraphicsPipelines( _device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create depth only pipeline");
 	}
-}
 
-void VulkanEngine::createCommandPool() {
+	return pipeline;
+}
 
-	auto queueFamilyIndices = findQueueFamilies( _physicalDevice, _surface );
+// Shares the graphics pipeline layout, the cluster shader only uses the descriptor set
+VkPipeline VulkanEngine::createClusterPipeline( VkShaderModule compShader ) {
 
-	VkCommandPoolCreateInfo createInfo {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-		.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value()
+	VkComputePipelineCreateInfo pipelineCreateInfo {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = compShader,
+			.pName = "main",
+		},
+		.layout = _pipelineLayout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = -1,
 	};
 
-	if ( vkCreateCommandPool( _device, &createInfo, nullptr, &_commandPool) != VK_SUCCESS ) {
+	VkPipeline pipeline;
 
-		throw std::runtime_error("Failed to create command pool");
+	if ( vkCreateComputePipelines( _device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create light cluster pipeline");
 	}
+
+	return pipeline;
 }
 
-void VulkanEngine::createCommandBuffers() {
+// Both cull phases share the layout, the phase and chunk count are pushed
+void VulkanEngine::createCullPipelineLayout() {
 
-	// Allocate multiple buffers for each frame in flight
-	_commandBuffers.resize( MAX_FRAMES_IN_FLIGHT );
+	_cullSetLayout = _layoutCache.get({
+		{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+	});
 
-	VkCommandBufferAllocateInfo allocInfo {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = _commandPool,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = MAX_FRAMES_IN_FLIGHT
+	VkPushConstantRange pushConstantRange {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof( uint ) * 2,
+	};
+
+	VkPipelineLayoutCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &_cullSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstantRange,
 	};
 
-	if ( vkAllocateCommandBuffers( _device, &allocInfo, _commandBuffers.data() ) != VK_SUCCESS ) {
+	if ( vkCreatePipelineLayout( _device, &createInfo, nullptr, &_cullPipelineLayout ) != VK_SUCCESS ) {
 
-		throw std::runtime_error("Failed to allocate command buffers");
+		throw std::runtime_error("Failed to create occlusion cull pipeline layout");
 	}
 }
 
-uint VulkanEngine::findMemoryType(uint typeFilter, VkMemoryPropertyFlags desiredProperties) {
+VkPipeline VulkanEngine::createCullPipeline( VkShaderModule compShader ) {
 
-	VkPhysicalDeviceMemoryProperties memProps;
-	vkGetPhysicalDeviceMemoryProperties( _physicalDevice, &memProps );
+	VkComputePipelineCreateInfo pipelineCreateInfo {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = compShader,
+			.pName = "main",
+		},
+		.layout = _cullPipelineLayout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = -1,
+	};
 
-	for ( uint i = 0; i < memProps.memoryTypeCount; i++ ) {
+	VkPipeline pipeline;
 
-		if ( typeFilter & (1 << i) && (memProps.memoryTypes[i].propertyFlags & desiredProperties) ) {
-			return i;
-		}
+	if ( vkCreateComputePipelines( _device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create occlusion cull pipeline");
 	}
 
-	throw std::runtime_error("failed to find suitable memory type");
+	return pipeline;
 }
 
-void VulkanEngine::loadModel() {
+// Every post shader samples up to two inputs and stores into one image, parameters are pushed
+void VulkanEngine::createPostPipelineLayout() {
 
-	auto model = readModel("models/vergil.fbx");
+	_postSetLayout = _layoutCache.get({
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		{ 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+	});
 
-	// Initialize vertex buffer
-	{
-		int vertexCount = model.vertPositions.size();
-		uint bufferSize = sizeof( Vertex ) * vertexCount;
-		std::vector<Vertex> vertices( vertexCount );
+	VkPushConstantRange pushConstantRange {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof( glm::vec4 ),
+	};
 
-		// Populate vertices list
-		glm::u8vec3 whiteColor = {255, 255, 255};
+	VkPipelineLayoutCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &_postSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstantRange,
+	};
+
+	if ( vkCreatePipelineLayout( _device, &createInfo, nullptr, &_postPipelineLayout ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create post pipeline layout");
+	}
+
+	// Bloom levels are filtered bilinearly, edges clamp so the pyramid doesn't bleed across borders
+	_postSampler = _samplerCache.get({
+		.filter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.maxLod = 0.0f,
+	});
+}
+
+PostPipelines VulkanEngine::createPostPipelines( bool fromLooseFiles ) {
+
+	PostPipelines pipelines {};
+
+	try {
+
+		for ( int i = 0; i < POST_SHADER_COUNT; i++ ) {
+
+			VkShaderModule compShader = loadShaderModule( postShaderPaths[i], postShaderSources[i], ShaderStage::Compute, fromLooseFiles );
+
+			VkComputePipelineCreateInfo pipelineCreateInfo {
+				.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+				.stage = {
+					.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+					.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+					.module = compShader,
+					.pName = "main",
+				},
+				.layout = _postPipelineLayout,
+				.basePipelineHandle = VK_NULL_HANDLE,
+				.basePipelineIndex = -1,
+			};
+
+			VkResult result = vkCreateComputePipelines( _device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipelines[i] );
+			vkDestroyShaderModule( _device, compShader, nullptr );
+
+			if ( result != VK_SUCCESS ) {
+
+				throw std::runtime_error( string( "Failed to create post pipeline for " ) + postShaderSources[i] );
+			}
+		}
+
+	} catch ( ... ) {
+
+		destroyPostPipelines( pipelines );
+		throw;
+	}
+
+	return pipelines;
+}
+
+void VulkanEngine::destroyPostPipelines( PostPipelines& pipelines ) {
+
+	for ( VkPipeline& pipeline : pipelines ) {
+
+		if ( pipeline != VK_NULL_HANDLE ) {
+
+			vkDestroyPipeline( _device, pipeline, nullptr );
+			pipeline = VK_NULL_HANDLE;
+		}
+	}
+}
+
+// Main pass renders into the HDR target only, the swapchain image is written by the post chain
+void VulkanEngine::createFramebuffers() {
+
+	vector<VkImageView> attachments = { _renderGraph.getImageView( _hdrTarget ), _renderGraph.getImageView( _depthTarget ) };
+
+	// HDR target becomes the resolve target
+	if ( _msaaSamples != VK_SAMPLE_COUNT_1_BIT ) {
+
+		attachments = { _renderGraph.getImageView( _msaaColorTarget ), _renderGraph.getImageView( _depthTarget ), _renderGraph.getImageView( _hdrTarget ) };
+	}
+
+	VkFramebufferCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = _renderPass,
+		.attachmentCount = static_cast<uint>( attachments.size() ),
+		.pAttachments = attachments.data(),
+		.width = _swapchainExtent.width,
+		.height = _swapchainExtent.height,
+		.layers = 1
+	};
+
+	if ( vkCreateFramebuffer( _device, &createInfo, nullptr, &_mainFramebuffer ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create framebuffer");
+	}
+}
+
+void VulkanEngine::createCommandPool() {
+
+	auto queueFamilyIndices = findQueueFamilies( _physicalDevice, _surface );
+
+	VkCommandPoolCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value()
+	};
+
+	if ( vkCreateCommandPool( _device, &createInfo, nullptr, &_commandPool) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create command pool");
+	}
+}
+
+// Frame command buffers come from the queues' per frame pools, the command pool is left to one time submits
+void VulkanEngine::createQueues() {
+
+	auto queueFamilyIndices = findQueueFamilies( _physicalDevice, _surface );
+
+	_graphicsTimeline.init( _device, _graphicsQueue, queueFamilyIndices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT );
+
+	if ( _hasAsyncCompute ) {
+
+		_computeTimeline.init( _device, _computeQueue, _computeFamily.value(), MAX_FRAMES_IN_FLIGHT );
+	}
+
+	_frameValues.assign( MAX_FRAMES_IN_FLIGHT, FrameValues {} );
+}
+
+uint VulkanEngine::findMemoryType(uint typeFilter, VkMemoryPropertyFlags desiredProperties) {
+
+	VkPhysicalDeviceMemoryProperties memProps;
+	vkGetPhysicalDeviceMemoryProperties( _physicalDevice, &memProps );
+
+	for ( uint i = 0; i < memProps.memoryTypeCount; i++ ) {
+
+		if ( typeFilter & (1 << i) && (memProps.memoryTypes[i].propertyFlags & desiredProperties) ) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type");
+}
+
+void VulkanEngine::loadModel() {
+
+	auto modelAsset = _assets.read( "models/vergil.fbx" );
+	auto model = readModel( modelAsset.getData(), modelAsset.getSize(), "fbx" );
+
+	// Path is matched against hot reloads and sampling builds the sampler. The pixels are decoded below by a job
+	// into a mip chain kept in system memory
+	_texturePath = model.texturePath;
+	_textureSampling = model.textureSampling;
+	_skeleton = std::move( model.skeleton );
+
+	// Only compressed clips are kept, keys are streamed by each instance's sampler
+	for ( const auto& clip : model.clips ) {
+
+		_animationClips.push_back( compressClip( clip ) );
+
+		size_t rawKeys = 0;
+
+		for ( const auto& track : clip.tracks ) {
+
+			rawKeys += track.positions.size() + track.rotations.size() + track.scales.size();
+		}
+
+		std::cout << "Animation " << clip.name << ": " << rawKeys << " keys -> " << _animationClips.back().stream.size()
+				  << " keys, " << _animationClips.back().getMemorySize() << " bytes" << std::endl;
+	}
+
+	// Skinned vertices always read the palette, without clips it holds the bind pose
+	if ( _skeleton.size() > 0 ) {
+
+		int clip = _animationClips.empty() ? -1 : 0;
+		AnimationInstance instance { .clip = clip, .timeOffset = 0.f };
+
+		// Second clip, when there is one, is layered over the first at half weight
+		if ( _animationClips.size() > 1 ) {
+
+			instance.blendClip = 1;
+			instance.blendWeight = 0.5f;
+		}
+
+		_animationInstances.push_back( std::move( instance ) );
+	}
+
+	auto textureAsset = _assets.read( model.texturePath );
+
+	// Mip chain stays in system memory, the streamer keeps only the levels in use resident.
+	// Jobs can't throw, a decoding error is rethrown once the job is waited on. The guard keeps the job's
+	// references valid when an upload below throws first
+	vector<MipLevel> textureMips;
+	std::exception_ptr textureError;
+	JobCounter textureDecoding;
+	JobWaitGuard textureDecodingGuard( JobSystem::get(), textureDecoding );
+
+	JobSystem::get().run( [&textureAsset, &textureMips, &textureError] {
+
+		try {
+
+			auto image = Image::openMemory( textureAsset.getData(), textureAsset.getSize() );
+			vector<unsigned char> pixels( image.getSize() );
+
+			image.readPixels( pixels.data() );
+
+			textureMips = buildMipChain( std::move( pixels ), image.getWidth(), image.getHeight() );
+		} catch ( ... ) {
+
+			textureError = std::current_exception();
+		}
+	}, &textureDecoding );
+
+	// Uploads go into one submission, the first frame waits for it on the GPU
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	// Initialize vertex buffer
+	{
+		int vertexCount = model.vertPositions.size();
+		uint bufferSize = sizeof( Vertex ) * vertexCount;
+		std::vector<Vertex> vertices( vertexCount );
+
+		// Populate vertices list
+		glm::u8vec3 whiteColor = {255, 255, 255};
 
 		for( int i = 0; i < vertexCount; i++ ) {
 
-			vertices[i] = { model.vertPositions[i], whiteColor, model.texCoords[i] };
+			vertices[i] = { model.vertPositions[i], whiteColor, model.texCoords[i], model.jointIndices[i], model.jointWeights[i], model.vertNormals[i] };
 		}
 
 		VkBuffer stagingBuffer;
@@ -765,10 +1678,72 @@ void VulkanEngine::loadModel() {
 			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
 			_vertexBuffer, _vertexBufferMemory);
-		copyBuffer( stagingBuffer, _vertexBuffer, bufferSize);
+		recordCopyBuffer( commandBuffer, stagingBuffer, _vertexBuffer, bufferSize );
+
+		_deletionQueue.pushPending( stagingBuffer, stagingBufferMemory );
+	}
+
+	// How far animation moves each vertex, culling bounds are grown by it
+	vector<float> skinnedDisplacements;
+
+	if ( _skeleton.size() > 0 ) {
 
-		vkDestroyBuffer( _device, stagingBuffer, nullptr );
-		vkFreeMemory( _device, stagingBufferMemory, nullptr );
+		skinnedDisplacements = measureSkinnedDisplacements( model.vertPositions, model.jointIndices, model.jointWeights,
+															_skeleton, _animationClips );
+	}
+
+	// Caster bounds for shadow culling
+	{
+		glm::vec3 min = model.vertPositions.empty() ? glm::vec3( 0.f ) : model.vertPositions[0];
+		glm::vec3 max = min;
+
+		for ( const auto& position : model.vertPositions ) {
+
+			min = glm::min( min, position );
+			max = glm::max( max, position );
+		}
+
+		_modelBounds.center = ( min + max ) * 0.5f;
+		_modelBounds.radius = glm::length( max - min ) * 0.5f;
+
+		if ( !skinnedDisplacements.empty() ) {
+
+			_modelBounds.radius += *std::max_element( skinnedDisplacements.begin(), skinnedDisplacements.end() );
+		}
+	}
+
+	// Depth pre-pass and shadow casters read only positions and skinning inputs
+	{
+		int vertexCount = model.vertPositions.size();
+		uint bufferSize = sizeof( DepthVertex ) * vertexCount;
+		std::vector<DepthVertex> vertices( vertexCount );
+
+		for( int i = 0; i < vertexCount; i++ ) {
+
+			vertices[i] = { model.vertPositions[i], model.jointIndices[i], model.jointWeights[i] };
+		}
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+
+		createBuffer( bufferSize,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				stagingBuffer, stagingBufferMemory );
+
+		void *data;
+		vkMapMemory( _device, stagingBufferMemory, 0, bufferSize, 0, &data );
+		memcpy( data, vertices.data(), bufferSize );
+		vkUnmapMemory( _device, stagingBufferMemory );
+
+		createBuffer( bufferSize,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_depthVertexBuffer, _depthVertexBufferMemory );
+
+		recordCopyBuffer( commandBuffer, stagingBuffer, _depthVertexBuffer, bufferSize );
+
+		_deletionQueue.pushPending( stagingBuffer, stagingBufferMemory );
 	}
 
 	// Initialize index buffer 
@@ -803,174 +1778,1575 @@ void VulkanEngine::loadModel() {
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
 				_indexBuffer, _indexBufferMemory );
 
-		copyBuffer( stagingBuffer, _indexBuffer, bufferSize );
+		recordCopyBuffer( commandBuffer, stagingBuffer, _indexBuffer, bufferSize );
+
+		_deletionQueue.pushPending( stagingBuffer, stagingBufferMemory );
+	}
+
+	// Chunks are culled with bind pose spheres grown by how far their vertices get in any clip
+	{
+		auto chunks = buildMeshChunks( model.vertPositions, model.indices, skinnedDisplacements );
+
+		_chunkCount = chunks.size();
+
+		std::cout << "Mesh chunks: " << _chunkCount << " of " << CHUNK_TRIANGLES << " triangles" << std::endl;
+
+		if ( _canCullOcclusion ) {
+
+			createCullBuffers( commandBuffer, chunks );
+		}
+	}
+
+	JobSystem::get().wait( textureDecoding );
+
+	if ( textureError ) {
 
-		vkDestroyBuffer( _device, stagingBuffer, nullptr );
-		vkFreeMemory( _device, stagingBufferMemory, nullptr );
+		std::rethrow_exception( textureError );
 	}
 
-	createTextureImage( Image::loadFile( model.texturePath.c_str() ));
-	createTextureImageView();
+	_texture = _textureStreamer.addTexture( std::move( textureMips ) );
+
+	// Mip tail is uploaded right away, so the texture can be bound from the first frame
+	_textureStreamer.update( commandBuffer, 0, [this] ( std::function<void()> destroy ) {
+		_deletionQueue.pushPending( std::move( destroy ) );
+	});
+
+	_uploadValue = _graphicsTimeline.submit( commandBuffer, {} );
 
+	_deletionQueue.pushPending( [this, commandBuffer] { vkFreeCommandBuffers( _device, _commandPool, 1, &commandBuffer ); } );
+	_deletionQueue.retirePending({ .graphics = _uploadValue });
 }
 
-void VulkanEngine::copyBuffer( VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size ) {
+// Every chunk starts out visible, so the first frame draws everything in its early phase
+void VulkanEngine::createCullBuffers( VkCommandBuffer commandBuffer, const vector<MeshChunk>& chunks ) {
 
-	// TODO: replace with singleTimeCmmands()
-	VkCommandBufferAllocateInfo allocInfo{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = _commandPool,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
-	};
+	VkDeviceSize chunksSize = sizeof( MeshChunk ) * chunks.size();
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers( _device, &allocInfo, &commandBuffer);
+	createBuffer( chunksSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			_chunkBuffer, _chunkMemory );
 
-	{
-		VkCommandBufferBeginInfo beginInfo {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-		};
+	void *data;
+	vkMapMemory( _device, _chunkMemory, 0, chunksSize, 0, &data );
+	memcpy( data, chunks.data(), chunksSize );
+	vkUnmapMemory( _device, _chunkMemory );
 
-		vkBeginCommandBuffer( commandBuffer, &beginInfo );
+	createBuffer( sizeof( uint ) * chunks.size(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			_visibilityBuffer, _visibilityMemory );
 
-		VkBufferCopy copyRegion {
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = size,
-		};
+	vkCmdFillBuffer( commandBuffer, _visibilityBuffer, 0, VK_WHOLE_SIZE, 1 );
+
+	VkDeviceSize drawsSize = sizeof( VkDrawIndexedIndirectCommand ) * chunks.size();
+
+	for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+
+		VkBuffer earlyBuffer, lateBuffer;
+		VkDeviceMemory earlyMemory, lateMemory;
 
-		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+		createBuffer( drawsSize,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				earlyBuffer, earlyMemory );
 
-		vkEndCommandBuffer(commandBuffer);
+		createBuffer( drawsSize,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				lateBuffer, lateMemory );
+
+		_earlyDrawBuffers.push_back( earlyBuffer );
+		_earlyDrawMemory.push_back( earlyMemory );
+		_lateDrawBuffers.push_back( lateBuffer );
+		_lateDrawMemory.push_back( lateMemory );
 	}
+}
 
-	VkSubmitInfo submitInfo {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &commandBuffer
-	};
+void VulkanEngine::recordCopyBuffer( VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size ) {
 
-	vkQueueSubmit( _graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-	vkQueueWaitIdle( _graphicsQueue );
+	VkBufferCopy copyRegion {
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = size,
+	};
 
-	vkFreeCommandBuffers(_device, _commandPool, 1, &commandBuffer);
+	vkCmdCopyBuffer( commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion );
 }
 	
-void VulkanEngine::recordCommandBuffer( VkCommandBuffer commandBuffer, uint imageIndex, int flightFrame ) {
+// Graph batches are recorded and submitted one after another. Frame setup goes into the first graphics
+// batch, the last one waits for the swapchain image. The frame completes with the values its last batches signal
+void VulkanEngine::recordFrame( uint imageIndex, int frame ) {
 
-	VkCommandBufferBeginInfo beginInfo {
+	int flightFrame = frame % MAX_FRAMES_IN_FLIGHT;
 
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = 0,
-		.pInheritanceInfo = nullptr
-	};
+	_imageIndex = imageIndex;
+	_flightFrame = flightFrame;
+
+	writeFrameDescriptors( flightFrame );
 
-	if ( vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS ) {
+	_renderGraph.bindImage( _swapchainTarget, _swapchainImages[imageIndex], _swapchainImageViews[imageIndex] );
+	_renderGraph.bindBuffer( _lightGridTarget, _lightGridBuffers[flightFrame] );
 
-		throw std::runtime_error("Failed to begin recording command buffer");
+	if ( isOcclusionCullingActive() ) {
+
+		_renderGraph.bindBuffer( _visibilityTarget, _visibilityBuffer );
+		_renderGraph.bindBuffer( _earlyDrawTarget, _earlyDrawBuffers[flightFrame] );
+		_renderGraph.bindBuffer( _lateDrawTarget, _lateDrawBuffers[flightFrame] );
 	}
 
-	std::array<VkClearValue, 2> clearColors = { 
-		{ { .6f, .6f, .6f, 1.f } },
-	};
+	const auto& batches = _renderGraph.getBatches();
 
-	clearColors[1].depthStencil = { 1.0f, 0 };
+	size_t firstGraphicsBatch = batches.size();
+	size_t firstComputeBatch = batches.size();
+	size_t lastGraphicsBatch = 0;
 
-	VkRenderPassBeginInfo renderPassInfo {
-		
-		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-		.renderPass = _renderPass,
-		.framebuffer = _swapchainFramebuffers[imageIndex],
-		.renderArea = {
-			.offset = {0, 0},
-			.extent = _swapchainExtent,
-		},
-		.clearValueCount = clearColors.size(),
-		.pClearValues = clearColors.data()
-	};
+	for ( size_t i = 0; i < batches.size(); i++ ) {
 
-	vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
+		if ( batches[i].queue == PassQueue::Graphics ) {
 
-	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _mainGraphicsPipeline );
+			firstGraphicsBatch = std::min( firstGraphicsBatch, i );
+			lastGraphicsBatch = i;
+		} else {
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(std::round(_swapchainExtent.width));
-	viewport.height = static_cast<float>(std::round(_swapchainExtent.height));
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+			firstComputeBatch = std::min( firstComputeBatch, i );
+		}
+	}
 
-	vkCmdSetViewport( commandBuffer, 0, 1, &viewport );
+	_batchValues.assign( batches.size(), 0 );
+	_postTimestampsWritten[flightFrame] = 0;
 
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = _swapchainExtent;
-	vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
+	_renderGraph.execute( [&] ( size_t batch ) {
 
-	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 
-							0, 1, &_descriptorSets[flightFrame], 0, nullptr );
+		if ( batches[batch].queue == PassQueue::AsyncCompute ) {
 
-	{
-		VkBuffer vertexBuffers[] = { _vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets );
-		vkCmdBindIndexBuffer( commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16 );
+			VkCommandBuffer commandBuffer = _computeTimeline.beginCommandBuffer();
 
-		vkCmdDrawIndexed( commandBuffer, _numberOfIndices, 1, 0, 0, 0 );
-	}
+			if ( batch == firstComputeBatch && _postTimestampPool != _timestampPool && _postTimestampPool != VK_NULL_HANDLE ) {
 
-	vkCmdEndRenderPass( commandBuffer );
+				vkCmdResetQueryPool( commandBuffer, _postTimestampPool, flightFrame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME );
+			}
 
-	if ( vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS ) {
+			return commandBuffer;
+		}
 
-		throw std::runtime_error("Failed to record command buffer");
-	}
-}
+		VkCommandBuffer commandBuffer = _graphicsTimeline.beginCommandBuffer();
 
-void VulkanEngine::createSyncObjects() {
+		if ( batch == firstGraphicsBatch ) {
 
-	VkSemaphoreCreateInfo semaphoreInfo{
-		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-	};
+			// Copies old images from the previous frames' resident levels, so they're retired with this frame
+			auto retire = [this] ( std::function<void()> destroy ) { _deletionQueue.pushPending( std::move( destroy ) ); };
 
-	_imageAvailableSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
-	_renderFinishedSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
+			_textureStreamer.update( commandBuffer, frame, retire );
 
-	VkFenceCreateInfo fenceInfo{
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-		.flags = VK_FENCE_CREATE_SIGNALED_BIT
-	};
+			vkCmdResetQueryPool( commandBuffer, _timestampPool, flightFrame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME );
+			vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestampPool, flightFrame * TIMESTAMPS_PER_FRAME );
+		}
 
-	_inFlightFences.resize( MAX_FRAMES_IN_FLIGHT );
+		return commandBuffer;
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	}, [&] ( size_t batch, VkCommandBuffer commandBuffer ) {
 
-		if ( vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i] ) != VK_SUCCESS ||
-			vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i] ) != VK_SUCCESS ) {
+		if ( batch == lastGraphicsBatch ) {
 
-			throw std::runtime_error("Unable to create semaphores");
+			vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestampPool, flightFrame * TIMESTAMPS_PER_FRAME + 1 );
+			_timestampsWritten[flightFrame] = true;
 		}
 
-		if ( vkCreateFence( _device, &fenceInfo, nullptr, &_inFlightFences[i] ) != VK_SUCCESS ) {
+		submitBatch( batch, commandBuffer, batch == lastGraphicsBatch );
+	});
+
+	// Next frame's batches may wait for this frame's on the other queue
+	_previousBatchValues = _batchValues;
 
-			throw std::runtime_error("Unable to create fences");
-		} 
-	}
+	// Compute work of the frame may still run after its last graphics batch
+	_frameValues[flightFrame] = FrameValues {
+		.frame = frame,
+		.graphics = _graphicsTimeline.getLastSubmitted(),
+		.compute = _hasAsyncCompute ? _computeTimeline.getLastSubmitted() : 0,
+	};
+
+	_deletionQueue.retirePending( getFrameEnd( frame ) );
 }
 
-void VulkanEngine::createBuffer( 
-		VkDeviceSize bufferSize, VkBufferUsageFlags usageFlags,
-		VkMemoryPropertyFlags memProps, VkBuffer &buffer, VkDeviceMemory &bufferMemory ){
+// Waits are on the other queue's timeline, sync 2 stage bits used by the graph match the legacy ones
+void VulkanEngine::submitBatch( size_t batchIndex, VkCommandBuffer commandBuffer, bool isLastGraphicsBatch ) {
 
-	{
-		VkBufferCreateInfo createInfo {
+	const auto& batch = _renderGraph.getBatches()[batchIndex];
+
+	bool isCompute = batch.queue == PassQueue::AsyncCompute;
+	TimelineQueue& queue = isCompute ? _computeTimeline : _graphicsTimeline;
+	TimelineQueue& otherQueue = isCompute ? _graphicsTimeline : _computeTimeline;
+	VkPipelineStageFlags waitStages = static_cast<VkPipelineStageFlags>( batch.waitStages );
+
+	vector<QueueWait> waits;
+
+	// Uploads were submitted on the graphics queue, waiting for its own timeline orders the first frame after them
+	if ( !isCompute && _uploadValue > 0 ) {
+
+		waits.push_back({ _graphicsTimeline.getTimeline(), _uploadValue, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT });
+		_uploadValue = 0;
+	}
+
+	for ( size_t wait : batch.waits ) {
+
+		waits.push_back({ otherQueue.getTimeline(), _batchValues[wait], waitStages });
+	}
+
+	// Previous frame's values are gone once the graph was rebuilt, the GPU was idle then
+	for ( size_t wait : batch.previousFrameWaits ) {
+
+		if ( wait < _previousBatchValues.size() ) {
+
+			waits.push_back({ otherQueue.getTimeline(), _previousBatchValues[wait], waitStages });
+		}
+	}
+
+	if ( !isLastGraphicsBatch ) {
+
+		_batchValues[batchIndex] = queue.submit( commandBuffer, waits );
+		return;
+	}
+
+	// Swapchain image is first touched by the present blit
+	waits.push_back({ _imageAvailableSemaphores[_flightFrame], 0, VK_PIPELINE_STAGE_TRANSFER_BIT });
+
+	_batchValues[batchIndex] = queue.submit( commandBuffer, waits, { _renderFinishedSemaphores[_flightFrame] } );
+}
+
+void VulkanEngine::recordMainPass( VkCommandBuffer commandBuffer ) {
+
+	std::array<VkClearValue, 2> clearColors = { 
+		{ { .6f, .6f, .6f, 1.f } },
+	};
+
+	clearColors[1].depthStencil = { 1.0f, 0 };
+
+	if ( _hasDynamicRendering ) {
+
+		beginDynamicRendering( commandBuffer, clearColors[0], clearColors[1] );
+	} else {
+
+		VkRenderPassBeginInfo renderPassInfo {
+			
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			.renderPass = _renderPass,
+			.framebuffer = _mainFramebuffer,
+			.renderArea = {
+				.offset = {0, 0},
+				.extent = _swapchainExtent,
+			},
+			.clearValueCount = clearColors.size(),
+			.pClearValues = clearColors.data()
+		};
+
+		vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
+	}
+
+	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _mainGraphicsPipeline );
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(std::round(_swapchainExtent.width));
+	viewport.height = static_cast<float>(std::round(_swapchainExtent.height));
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	vkCmdSetViewport( commandBuffer, 0, 1, &viewport );
+
+	VkRect2D scissor{};
+	scissor.offset = {0, 0};
+	scissor.extent = _swapchainExtent;
+	vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
+
+	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 
+							0, 1, &_descriptorSets[_flightFrame], 0, nullptr );
+
+	{
+		VkBuffer vertexBuffers[] = { _vertexBuffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets );
+		vkCmdBindIndexBuffer( commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16 );
+
+		// Chunks of both pre-pass phases, the rest failed the depth test anyway
+		if ( isOcclusionCullingActive() ) {
+
+			recordCulledDraws( commandBuffer, false );
+			recordCulledDraws( commandBuffer, true );
+		} else {
+
+			vkCmdDrawIndexed( commandBuffer, _numberOfIndices, 1, 0, 0, 0 );
+		}
+	}
+
+	if ( _hasDynamicRendering ) {
+
+		_cmdEndRendering( commandBuffer );
+	} else {
+
+		vkCmdEndRenderPass( commandBuffer );
+	}
+}
+
+void VulkanEngine::beginDynamicRendering( VkCommandBuffer commandBuffer, VkClearValue colorClear, VkClearValue depthClear ) {
+
+	VkRenderingAttachmentInfoKHR colorAttachment {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+		.imageView = _renderGraph.getImageView( _hdrTarget ),
+		.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.resolveMode = VK_RESOLVE_MODE_NONE,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.clearValue = colorClear,
+	};
+
+	// Samples are averaged into the HDR target when rendering ends, multisampled color is never stored
+	if ( _msaaSamples != VK_SAMPLE_COUNT_1_BIT ) {
+
+		colorAttachment.imageView = _renderGraph.getImageView( _msaaColorTarget );
+		colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		colorAttachment.resolveImageView = _renderGraph.getImageView( _hdrTarget );
+		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	}
+
+	// Depth laid down by the pre-pass is only tested against
+	VkRenderingAttachmentInfoKHR depthAttachment {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+		.imageView = _renderGraph.getImageView( _depthTarget ),
+		.imageLayout = _depthPrepass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		.resolveMode = VK_RESOLVE_MODE_NONE,
+		.loadOp = _depthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.clearValue = depthClear,
+	};
+
+	VkRenderingInfoKHR renderingInfo {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+		.renderArea = {
+			.offset = {0, 0},
+			.extent = _swapchainExtent,
+		},
+		.layerCount = 1,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &colorAttachment,
+		.pDepthAttachment = &depthAttachment,
+		.pStencilAttachment = hasStencilComponent( _depthFormat ) ? &depthAttachment : nullptr,
+	};
+
+	_cmdBeginRendering( commandBuffer, &renderingInfo );
+}
+
+// With occlusion culling the late phase adds the chunks the early one skipped on top of its depth
+void VulkanEngine::recordDepthPrepass( VkCommandBuffer commandBuffer, bool isLatePhase ) {
+
+	VkRenderingAttachmentInfoKHR depthAttachment {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+		.imageView = _renderGraph.getImageView( _depthTarget ),
+		.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		.resolveMode = VK_RESOLVE_MODE_NONE,
+		.loadOp = isLatePhase ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.clearValue = { .depthStencil = { 1.0f, 0 } },
+	};
+
+	// Pyramid is reduced from single sample depth, each pixel keeping its farthest sample
+	if ( isOcclusionCullingActive() && !isLatePhase && _msaaSamples != VK_SAMPLE_COUNT_1_BIT ) {
+
+		depthAttachment.resolveMode = VK_RESOLVE_MODE_MAX_BIT;
+		depthAttachment.resolveImageView = _renderGraph.getImageView( _hizDepthTarget );
+		depthAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	}
+
+	VkRenderingInfoKHR renderingInfo {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+		.renderArea = {
+			.offset = {0, 0},
+			.extent = _swapchainExtent,
+		},
+		.layerCount = 1,
+		.colorAttachmentCount = 0,
+		.pDepthAttachment = &depthAttachment,
+		.pStencilAttachment = hasStencilComponent( _depthFormat ) ? &depthAttachment : nullptr,
+	};
+
+	_cmdBeginRendering( commandBuffer, &renderingInfo );
+
+	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _depthPrepassPipeline );
+
+	VkViewport viewport {
+		.x = 0.f,
+		.y = 0.f,
+		.width = static_cast<float>(_swapchainExtent.width),
+		.height = static_cast<float>(_swapchainExtent.height),
+		.minDepth = 0.f,
+		.maxDepth = 1.f,
+	};
+
+	VkRect2D scissor {
+		.offset = {0, 0},
+		.extent = _swapchainExtent,
+	};
+
+	vkCmdSetViewport( commandBuffer, 0, 1, &viewport );
+	vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
+
+	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
+							0, 1, &_descriptorSets[_flightFrame], 0, nullptr );
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers( commandBuffer, 0, 1, &_depthVertexBuffer, &offset );
+	vkCmdBindIndexBuffer( commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16 );
+
+	if ( isOcclusionCullingActive() ) {
+
+		recordCulledDraws( commandBuffer, isLatePhase );
+	} else {
+
+		vkCmdDrawIndexed( commandBuffer, _numberOfIndices, 1, 0, 0, 0 );
+	}
+
+	_cmdEndRendering( commandBuffer );
+}
+
+// Culled chunks have no instances, the whole draw list is issued in as few indirect draws as the device allows
+void VulkanEngine::recordCulledDraws( VkCommandBuffer commandBuffer, bool isLatePhase ) {
+
+	VkBuffer draws = isLatePhase ? _lateDrawBuffers[_flightFrame] : _earlyDrawBuffers[_flightFrame];
+	uint stride = sizeof( VkDrawIndexedIndirectCommand );
+
+	for ( uint first = 0; first < _chunkCount; first += _maxDrawIndirectCount ) {
+
+		vkCmdDrawIndexedIndirect( commandBuffer, draws, first * stride, std::min( _chunkCount - first, _maxDrawIndirectCount ), stride );
+	}
+}
+
+// Culling runs between the two halves of the depth pre-pass
+bool VulkanEngine::isOcclusionCullingActive() {
+
+	return _canCullOcclusion && _occlusionCulling && _depthPrepass;
+}
+
+// Early phase reads last frame's visibility, late phase tests against the pyramid and writes it
+void VulkanEngine::recordOcclusionCull( VkCommandBuffer commandBuffer, bool isLatePhase ) {
+
+	// Graph doesn't carry buffer state across frames, visibility was last written by the previous frame's late phase
+	if ( !isLatePhase ) {
+
+		VkBufferMemoryBarrier2KHR barrier {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+			.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+			.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = _visibilityBuffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		};
+
+		recordBarriers( commandBuffer, {}, { barrier } );
+	}
+
+	VkDescriptorSet set = _frameDescriptors[_flightFrame].allocate( _cullSetLayout );
+
+	_descriptorWriter.writeBuffer( set, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, _uniformBuffers[_flightFrame], sizeof( UniformBufferObject ) );
+	_descriptorWriter.writeBuffer( set, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _chunkBuffer );
+	_descriptorWriter.writeBuffer( set, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _visibilityBuffer );
+	_descriptorWriter.writeBuffer( set, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+								   isLatePhase ? _lateDrawBuffers[_flightFrame] : _earlyDrawBuffers[_flightFrame] );
+	_descriptorWriter.writeImage( set, 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _hizView, _hizSampler, VK_IMAGE_LAYOUT_GENERAL );
+	_descriptorWriter.flush( _device );
+
+	uint params[2] = { isLatePhase ? 1u : 0u, _chunkCount };
+
+	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline );
+	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1, &set, 0, nullptr );
+	vkCmdPushConstants( commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof( params ), params );
+
+	vkCmdDispatch( commandBuffer, ( _chunkCount + CULL_GROUP_SIZE - 1 ) / CULL_GROUP_SIZE, 1, 1 );
+}
+
+// Each level reduces the one below it, the first one the early depth. Levels stay in GENERAL, they're
+// written through their own views and the late cull samples the whole pyramid
+void VulkanEngine::recordHizBuild( VkCommandBuffer commandBuffer ) {
+
+	uint mipCount = _hizMipViews.size();
+
+	// Previous contents were only read by the last frame's late cull
+	VkImageMemoryBarrier2KHR barrier {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		.srcAccessMask = VK_ACCESS_2_NONE_KHR,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = _hizImage,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1 },
+	};
+
+	recordBarriers( commandBuffer, { barrier }, {} );
+
+	VkImageView depthView = _renderGraph.getImageView( _hizDepthTarget );
+	VkExtent2D extent = _hizExtent;
+
+	for ( uint mip = 0; mip < mipCount; mip++ ) {
+
+		VkImageView source = mip == 0 ? depthView : _hizMipViews[mip - 1];
+		VkImageLayout sourceLayout = mip == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		recordPostDispatch( commandBuffer, POST_HIZ_REDUCE, source, source, sourceLayout, _hizSampler, _hizMipViews[mip], extent, glm::vec4( 0.f ) );
+
+		// Next level reads this one, the late cull reads them all
+		barrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+		barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.subresourceRange.baseMipLevel = mip;
+		barrier.subresourceRange.levelCount = 1;
+
+		recordBarriers( commandBuffer, { barrier }, {} );
+
+		extent = { std::max( extent.width / 2, 1u ), std::max( extent.height / 2, 1u ) };
+	}
+}
+
+// Settings change, so stalling the GPU to swap the graph is acceptable
+void VulkanEngine::setOcclusionCulling( bool enabled ) {
+
+	if ( enabled == _occlusionCulling ) {
+		return;
+	}
+
+	if ( !_canCullOcclusion ) {
+
+		std::cout << "Occlusion culling requires dynamic rendering and a depth format without stencil" << std::endl;
+		return;
+	}
+
+	vkDeviceWaitIdle( _device );
+
+	_occlusionCulling = enabled;
+
+	rebuildRenderGraph();
+	resetGpuTimings();
+
+	std::cout << "Occlusion culling: " << ( enabled ? "on" : "off" ) << std::endl;
+}
+
+bool VulkanEngine::isOcclusionCullingEnabled() {
+
+	return _occlusionCulling;
+}
+
+bool VulkanEngine::canCullOcclusion() const {
+
+	return _canCullOcclusion;
+}
+
+// Settings change, so stalling the GPU to swap pipelines and the graph is acceptable
+void VulkanEngine::setDepthPrepass( bool enabled ) {
+
+	if ( !_hasDynamicRendering ) {
+
+		std::cout << "Depth pre-pass requires dynamic rendering" << std::endl;
+		return;
+	}
+
+	if ( enabled == _depthPrepass ) {
+		return;
+	}
+
+	vkDeviceWaitIdle( _device );
+
+	_depthPrepass = enabled;
+
+	VkPipeline pipeline = createMainPipeline( _mainShader, enabled );
+
+	vkDestroyPipeline( _device, _mainGraphicsPipeline, nullptr );
+	_mainGraphicsPipeline = pipeline;
+
+	rebuildRenderGraph();
+	resetGpuTimings();
+
+	std::cout << "Depth pre-pass: " << ( enabled ? "on" : "off" ) << std::endl;
+}
+
+bool VulkanEngine::isDepthPrepassEnabled() {
+
+	return _depthPrepass;
+}
+
+bool VulkanEngine::canDepthPrepass() const {
+
+	return _hasDynamicRendering;
+}
+
+// Previous sampler stays alive in the cache for frames in flight, the next frame's set picks up the new one
+// Clamped here as well as in the cache, so a request above the device limit doesn't rebuild the sampler every frame
+void VulkanEngine::setMaxAnisotropy( float anisotropy ) {
+
+	anisotropy = std::clamp( anisotropy, 1.f, _deviceMaxAnisotropy );
+
+	if ( anisotropy == _maxAnisotropy ) {
+		return;
+	}
+
+	_maxAnisotropy = anisotropy;
+
+	createTextureSampler();
+
+	std::cout << "Max anisotropy: " << _maxAnisotropy << "x, " << _samplerCache.getSize() << " cached samplers" << std::endl;
+}
+
+float VulkanEngine::getMaxAnisotropy() {
+
+	return _maxAnisotropy;
+}
+
+// Shadow atlas lives for the whole engine lifetime, so descriptors can point at it once
+void VulkanEngine::createShadowResources() {
+
+	_shadows = CascadedShadows( SHADOW_MAP_RESOLUTION, SHADOW_DISTANCE );
+
+	const auto imageParameters = samplerImageParams.Overriden({
+		.optFormat = _shadowFormat,
+		.optUsageFlags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	});
+
+	createImage( _shadows.getAtlasWidth(), _shadows.getAtlasHeight(), imageParameters, _shadowImage, _shadowImageMemory );
+
+	if ( createImageView( _shadowImage, _shadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT, &_shadowImageView ) != VK_SUCCESS ) {
+
+		throw std::runtime_error( "Failed to create shadow atlas view" );
+	}
+
+	// Hardware compares and filters 2x2 taps, the shader adds a 3x3 kernel on top
+	_shadowSampler = _samplerCache.get({
+		.filter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.maxLod = 0.0f,
+		.compareEnable = VK_TRUE,
+		.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+	});
+
+	if ( !_hasDynamicRendering ) {
+
+		VkFramebufferCreateInfo createInfo {
+			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass = _shadowRenderPass,
+			.attachmentCount = 1,
+			.pAttachments = &_shadowImageView,
+			.width = _shadows.getAtlasWidth(),
+			.height = _shadows.getAtlasHeight(),
+			.layers = 1
+		};
+
+		if ( vkCreateFramebuffer( _device, &createInfo, nullptr, &_shadowFramebuffer ) != VK_SUCCESS ) {
+
+			throw std::runtime_error( "Failed to create shadow framebuffer" );
+		}
+	}
+}
+
+// Pyramid lives for the whole engine lifetime like the shadow atlas. It's kept in GENERAL, so the
+// cull descriptors are valid before the first reduction
+void VulkanEngine::createHizResources() {
+
+	_hizExtent = { std::max( _swapchainExtent.width / 2, 1u ), std::max( _swapchainExtent.height / 2, 1u ) };
+
+	uint mipCount = static_cast<uint>( std::floor( std::log2( std::max( _hizExtent.width, _hizExtent.height ) ) ) ) + 1;
+
+	const auto imageParameters = samplerImageParams.Overriden({
+		.optFormat = HIZ_FORMAT,
+		.optUsageFlags = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	});
+
+	createImage( _hizExtent.width, _hizExtent.height, imageParameters, _hizImage, _hizMemory, mipCount );
+
+	if ( createImageView( _hizImage, HIZ_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, &_hizView, 0, mipCount ) != VK_SUCCESS ) {
+
+		throw std::runtime_error( "Failed to create Hi-Z view" );
+	}
+
+	_hizMipViews.resize( mipCount );
+
+	for ( uint mip = 0; mip < mipCount; mip++ ) {
+
+		if ( createImageView( _hizImage, HIZ_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, &_hizMipViews[mip], mip, 1 ) != VK_SUCCESS ) {
+
+			throw std::runtime_error( "Failed to create Hi-Z level view" );
+		}
+	}
+
+	// Culling reads exact texels of a chosen level
+	_hizSampler = _samplerCache.get({
+		.filter = VK_FILTER_NEAREST,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+	});
+
+	VkImageMemoryBarrier2KHR barrier {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+		.srcStageMask = VK_PIPELINE_STAGE_2_NONE_KHR,
+		.srcAccessMask = VK_ACCESS_2_NONE_KHR,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = _hizImage,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1 },
+	};
+
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	recordBarriers( commandBuffer, { barrier }, {} );
+	endSingleTimeCommands( commandBuffer );
+}
+
+// All cascades are drawn in one pass, each one into its own viewport of the atlas
+void VulkanEngine::recordShadowPass( VkCommandBuffer commandBuffer ) {
+
+	VkExtent2D atlasExtent = { _shadows.getAtlasWidth(), _shadows.getAtlasHeight() };
+	VkClearValue clearValue = { .depthStencil = { 1.0f, 0 } };
+
+	if ( _hasDynamicRendering ) {
+
+		VkRenderingAttachmentInfoKHR depthAttachment {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+			.imageView = _shadowImageView,
+			.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			.resolveMode = VK_RESOLVE_MODE_NONE,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = clearValue,
+		};
+
+		VkRenderingInfoKHR renderingInfo {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+			.renderArea = {
+				.offset = {0, 0},
+				.extent = atlasExtent,
+			},
+			.layerCount = 1,
+			.colorAttachmentCount = 0,
+			.pDepthAttachment = &depthAttachment,
+		};
+
+		_cmdBeginRendering( commandBuffer, &renderingInfo );
+	} else {
+
+		VkRenderPassBeginInfo renderPassInfo {
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			.renderPass = _shadowRenderPass,
+			.framebuffer = _shadowFramebuffer,
+			.renderArea = {
+				.offset = {0, 0},
+				.extent = atlasExtent,
+			},
+			.clearValueCount = 1,
+			.pClearValues = &clearValue,
+		};
+
+		vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
+	}
+
+	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowPipeline );
+
+	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
+							0, 1, &_descriptorSets[_flightFrame], 0, nullptr );
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers( commandBuffer, 0, 1, &_depthVertexBuffer, &offset );
+	vkCmdBindIndexBuffer( commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16 );
+
+	for ( uint cascade = 0; cascade < SHADOW_CASCADES; cascade++ ) {
+
+		// Model is the only caster
+		if ( !_shadows.isCasterVisible( cascade, 0 ) ) {
+			continue;
+		}
+
+		glm::uvec2 tileOffset = _shadows.getTileOffset( cascade );
+		float resolution = static_cast<float>( _shadows.getResolution() );
+
+		VkViewport viewport {
+			.x = static_cast<float>( tileOffset.x ),
+			.y = static_cast<float>( tileOffset.y ),
+			.width = resolution,
+			.height = resolution,
+			.minDepth = 0.f,
+			.maxDepth = 1.f,
+		};
+
+		VkRect2D scissor {
+			.offset = { static_cast<int>( tileOffset.x ), static_cast<int>( tileOffset.y ) },
+			.extent = { _shadows.getResolution(), _shadows.getResolution() },
+		};
+
+		vkCmdSetViewport( commandBuffer, 0, 1, &viewport );
+		vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
+		vkCmdPushConstants( commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof( uint ), &cascade );
+
+		vkCmdDrawIndexed( commandBuffer, _numberOfIndices, 1, 0, 0, 0 );
+	}
+
+	if ( _hasDynamicRendering ) {
+
+		_cmdEndRendering( commandBuffer );
+	} else {
+
+		vkCmdEndRenderPass( commandBuffer );
+	}
+}
+
+// Light grid barriers and its hand over to the graphics queue are placed by the render graph
+void VulkanEngine::recordLightClustering( VkCommandBuffer commandBuffer ) {
+
+	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterPipeline );
+
+	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout,
+							0, 1, &_descriptorSets[_flightFrame], 0, nullptr );
+
+	vkCmdDispatch( commandBuffer, ( CLUSTER_COUNT + 63 ) / 64, 1, 1 );
+}
+
+void VulkanEngine::createTimestampQueries() {
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties( _physicalDevice, &props );
+
+	_timestampPeriod = props.limits.timestampPeriod;
+
+	// Begin and end of each frame in flight and of its post effects
+	VkQueryPoolCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = MAX_FRAMES_IN_FLIGHT * TIMESTAMPS_PER_FRAME,
+	};
+
+	if ( vkCreateQueryPool( _device, &createInfo, nullptr, &_timestampPool ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create timestamp query pool");
+	}
+
+	_postTimestampPool = _timestampPool;
+
+	// Post passes on the compute queue write a pool of their own, queries are reset on the queue writing them.
+	// Some compute families can't write timestamps, post effects then go untimed
+	if ( _hasAsyncCompute ) {
+
+		uint queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( _physicalDevice, &queueFamilyCount, nullptr );
+
+		vector<VkQueueFamilyProperties> queueFamilies( queueFamilyCount );
+		vkGetPhysicalDeviceQueueFamilyProperties( _physicalDevice, &queueFamilyCount, queueFamilies.data() );
+
+		_postTimestampPool = VK_NULL_HANDLE;
+
+		if ( queueFamilies[_computeFamily.value()].timestampValidBits > 0 &&
+			 vkCreateQueryPool( _device, &createInfo, nullptr, &_postTimestampPool ) != VK_SUCCESS ) {
+
+			throw std::runtime_error("Failed to create timestamp query pool");
+		}
+	}
+
+	_timestampsWritten.assign( MAX_FRAMES_IN_FLIGHT, false );
+	_postTimestampsWritten.assign( MAX_FRAMES_IN_FLIGHT, 0 );
+}
+
+// Called after the frame was waited for, its timestamps from the previous use are available.
+// Returns the frame's GPU time in milliseconds, zero when it wasn't measured
+double VulkanEngine::readGpuTimings( int flightFrame ) {
+
+	if ( !_timestampsWritten[flightFrame] ) {
+		return 0.0;
+	}
+
+	uint64_t timestamps[2];
+
+	if ( vkGetQueryPoolResults( _device, _timestampPool, flightFrame * TIMESTAMPS_PER_FRAME, 2, sizeof( timestamps ), timestamps,
+								sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT ) != VK_SUCCESS ) {
+		return 0.0;
+	}
+
+	double gpuTime = ( timestamps[1] - timestamps[0] ) * _timestampPeriod * 1e-6;
+
+	_gpuTimeSum += gpuTime;
+	_gpuTimeSamples++;
+
+	// Disabled effects leave their queries unwritten, those are never available
+	for ( int effect = 0; effect < POST_EFFECT_COUNT; effect++ ) {
+
+		if ( !( _postTimestampsWritten[flightFrame] & ( 1 << effect ) ) ) {
+			continue;
+		}
+
+		if ( vkGetQueryPoolResults( _device, _postTimestampPool, flightFrame * TIMESTAMPS_PER_FRAME + 2 + effect * 2, 2, sizeof( timestamps ),
+									timestamps, sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT ) == VK_SUCCESS ) {
+
+			_postTimeSums[effect] += ( timestamps[1] - timestamps[0] ) * _timestampPeriod * 1e-6;
+			_postTimeSamples[effect]++;
+		}
+	}
+
+	if ( _gpuTimeSamples == GPU_TIME_REPORT_INTERVAL ) {
+
+		std::cout << "GPU frame time: " << _gpuTimeSum / _gpuTimeSamples << " ms"
+				  << " (depth pre-pass " << ( _depthPrepass ? "on" : "off" ) << ")"
+				  << ", textures " << _textureStreamer.getResidentSize() / ( 1024 * 1024 ) << " / "
+				  << _textureStreamer.getBudget() / ( 1024 * 1024 ) << " MB";
+
+		for ( int effect = 0; effect < POST_EFFECT_COUNT; effect++ ) {
+
+			if ( _postTimeSamples[effect] > 0 ) {
+
+				std::cout << ", " << postEffectNames[effect] << " " << _postTimeSums[effect] / _postTimeSamples[effect] << " ms";
+			}
+		}
+
+		std::cout << std::endl;
+
+		resetGpuTimings();
+	}
+
+	return gpuTime;
+}
+
+// Completes the stats of this flight frame's previous use, which has completed
+void VulkanEngine::finishFrameStats( int flightFrame ) {
+
+	double gpuTime = readGpuTimings( flightFrame );
+
+	if ( !_collectFrameStats || !_pendingStats[flightFrame] ) {
+		return;
+	}
+
+	FrameStats stats = *_pendingStats[flightFrame];
+	stats.gpuTime = gpuTime;
+
+	if ( _readbackWritten[flightFrame] ) {
+
+		stats.imageHash = fnv1a( _readbackMapped[flightFrame], getReadbackSize() );
+		_readbackWritten[flightFrame] = false;
+	}
+
+	_frameStats.push_back( stats );
+	_pendingStats[flightFrame].reset();
+}
+
+// Stats are collected from here on, readback adds a hash of every presented image
+void VulkanEngine::enableFrameStats( bool withReadback ) {
+
+	_collectFrameStats = true;
+	_pendingStats.assign( MAX_FRAMES_IN_FLIGHT, std::nullopt );
+	_readbackWritten.assign( MAX_FRAMES_IN_FLIGHT, false );
+
+	if ( !withReadback || _frameReadback ) {
+		return;
+	}
+
+	if ( !_canReadback ) {
+
+		std::cout << "Frame readback: swapchain images can't be copied, image hashes are skipped" << std::endl;
+		return;
+	}
+
+	vkDeviceWaitIdle( _device );
+
+	for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		void* mappedMemory;
+
+		createBuffer( getReadbackSize(),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			buffer, memory );
+
+		vkMapMemory( _device, memory, 0, getReadbackSize(), 0, &mappedMemory );
+
+		_readbackBuffers.push_back( buffer );
+		_readbackMemory.push_back( memory );
+		_readbackMapped.push_back( mappedMemory );
+	}
+
+	_frameReadback = true;
+
+	rebuildRenderGraph();
+}
+
+// Waits for frames in flight, so every drawn frame is included
+vector<FrameStats> VulkanEngine::takeFrameStats() {
+
+	vkDeviceWaitIdle( _device );
+
+	for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+
+		finishFrameStats( ( _currentFrame + i ) % MAX_FRAMES_IN_FLIGHT );
+	}
+
+	return std::move( _frameStats );
+}
+
+// Swapchain formats picked by the engine are 4 bytes per pixel
+VkDeviceSize VulkanEngine::getReadbackSize() {
+
+	return VkDeviceSize( _swapchainExtent.width ) * _swapchainExtent.height * 4;
+}
+
+void VulkanEngine::recordReadback( VkCommandBuffer commandBuffer ) {
+
+	VkBufferImageCopy region {
+		.bufferOffset = 0,
+		.bufferRowLength = 0,
+		.bufferImageHeight = 0,
+		.imageSubresource = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.imageOffset = { 0, 0, 0 },
+		.imageExtent = { _swapchainExtent.width, _swapchainExtent.height, 1 },
+	};
+
+	vkCmdCopyImageToBuffer( commandBuffer, _renderGraph.getImage( _swapchainTarget ), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+							_readbackBuffers[_flightFrame], 1, &region );
+
+	// Copy becomes visible to the host once the frame's timeline value is reached
+	VkBufferMemoryBarrier barrier {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = _readbackBuffers[_flightFrame],
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+
+	vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+						  0, nullptr, 1, &barrier, 0, nullptr );
+
+	_readbackWritten[_flightFrame] = true;
+}
+
+// Level 0 is half the HDR target
+VkExtent2D VulkanEngine::getBloomExtent( int level ) {
+
+	return {
+		std::max( _swapchainExtent.width >> ( level + 1 ), 1u ),
+		std::max( _swapchainExtent.height >> ( level + 1 ), 1u ),
+	};
+}
+
+// HDR target goes through the bloom pyramid and tonemapping, optionally FXAA, and is blitted into the swapchain.
+// On the compute queue the chain overlaps the next frame's shadow and depth passes
+void VulkanEngine::buildPostChain() {
+
+	_bloomTargets.clear();
+
+	bool hasBloom = _postEffects[static_cast<int>( PostEffect::Bloom )];
+	bool hasFxaa = _postEffects[static_cast<int>( PostEffect::Fxaa )];
+
+	if ( hasBloom ) {
+
+		for ( int level = 0; level < BLOOM_LEVELS; level++ ) {
+
+			_bloomTargets.push_back( _renderGraph.createImage( "bloom " + std::to_string( level ), {
+				.format = HDR_FORMAT,
+				.extent = getBloomExtent( level ),
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				.aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+			}));
+		}
+
+		for ( int level = 0; level < BLOOM_LEVELS; level++ ) {
+
+			RenderGraphImage source = level == 0 ? _hdrTarget : _bloomTargets[level - 1];
+
+			_renderGraph.addPass( "bloom downsample " + std::to_string( level ), [this, level] ( VkCommandBuffer commandBuffer ) {
+					recordBloomDownsample( commandBuffer, level );
+				})
+				.read( source, ImageUsage::ComputeSampled )
+				.write( _bloomTargets[level], ImageUsage::ComputeStorageWrite )
+				.asyncCompute();
+		}
+
+		// Each level adds the coarser one on top of its own downsampled contents
+		for ( int level = BLOOM_LEVELS - 2; level >= 0; level-- ) {
+
+			_renderGraph.addPass( "bloom upsample " + std::to_string( level ), [this, level] ( VkCommandBuffer commandBuffer ) {
+					recordBloomUpsample( commandBuffer, level );
+				})
+				.read( _bloomTargets[level + 1], ImageUsage::ComputeSampled )
+				.write( _bloomTargets[level], ImageUsage::ComputeStorageWrite )
+				.asyncCompute();
+		}
+	}
+
+	// Luma goes into alpha for FXAA, the swapchain takes the color channels only
+	VkImageUsageFlags tonemapUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+	if ( hasFxaa ) {
+
+		tonemapUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
+	_tonemapTarget = _renderGraph.createImage( "tonemapped", {
+		.format = LDR_FORMAT,
+		.extent = _swapchainExtent,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.usage = tonemapUsage,
+		.aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	});
+
+	auto tonemapPass = _renderGraph.addPass( "tonemap", [this] ( VkCommandBuffer commandBuffer ) { recordTonemap( commandBuffer ); } )
+		.read( _hdrTarget, ImageUsage::ComputeSampled )
+		.write( _tonemapTarget, ImageUsage::ComputeStorageWrite )
+		.asyncCompute();
+
+	if ( hasBloom ) {
+
+		tonemapPass.read( _bloomTargets[0], ImageUsage::ComputeSampled );
+	}
+
+	RenderGraphImage finalImage = _tonemapTarget;
+
+	if ( hasFxaa ) {
+
+		_fxaaTarget = _renderGraph.createImage( "antialiased", {
+			.format = LDR_FORMAT,
+			.extent = _swapchainExtent,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			.aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+		});
+
+		_renderGraph.addPass( "fxaa", [this] ( VkCommandBuffer commandBuffer ) { recordFxaa( commandBuffer ); } )
+			.read( _tonemapTarget, ImageUsage::ComputeSampled )
+			.write( _fxaaTarget, ImageUsage::ComputeStorageWrite )
+			.asyncCompute();
+
+		finalImage = _fxaaTarget;
+	}
+
+	_renderGraph.addPass( "present blit", [this, finalImage] ( VkCommandBuffer commandBuffer ) { recordPresentBlit( commandBuffer, finalImage ); } )
+		.read( finalImage, ImageUsage::TransferSrc )
+		.write( _swapchainTarget, ImageUsage::TransferDst );
+}
+
+// Transients are realized anew when the graph changes, the render pass fallback needs a framebuffer over them
+void VulkanEngine::rebuildRenderGraph() {
+
+	buildRenderGraph();
+
+	if ( !_hasDynamicRendering ) {
+
+		vkDestroyFramebuffer( _device, _mainFramebuffer, nullptr );
+		createFramebuffers();
+	}
+}
+
+void VulkanEngine::recordPostDispatch( VkCommandBuffer commandBuffer, PostShader shader, RenderGraphImage input,
+									   RenderGraphImage secondInput, RenderGraphImage output, VkExtent2D extent, glm::vec4 params ) {
+
+	recordPostDispatch( commandBuffer, shader, _renderGraph.getImageView( input ), _renderGraph.getImageView( secondInput ),
+						VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _postSampler, _renderGraph.getImageView( output ), extent, params );
+}
+
+// Sets are allocated per dispatch from the frame's allocator, so they're reclaimed with the frame
+void VulkanEngine::recordPostDispatch( VkCommandBuffer commandBuffer, PostShader shader, VkImageView input, VkImageView secondInput,
+									   VkImageLayout inputLayout, VkSampler sampler, VkImageView output, VkExtent2D extent, glm::vec4 params ) {
+
+	VkDescriptorSet set = _frameDescriptors[_flightFrame].allocate( _postSetLayout );
+
+	_descriptorWriter.writeImage( set, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, input, sampler, inputLayout );
+	_descriptorWriter.writeImage( set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, secondInput, sampler, inputLayout );
+	_descriptorWriter.writeImage( set, 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, output, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL );
+	_descriptorWriter.flush( _device );
+
+	vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _postPipelines[shader] );
+	vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _postPipelineLayout, 0, 1, &set, 0, nullptr );
+	vkCmdPushConstants( commandBuffer, _postPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof( glm::vec4 ), &params );
+
+	vkCmdDispatch( commandBuffer, ( extent.width + POST_GROUP_SIZE - 1 ) / POST_GROUP_SIZE,
+				   ( extent.height + POST_GROUP_SIZE - 1 ) / POST_GROUP_SIZE, 1 );
+}
+
+// Effects spanning several passes are timed from the begin of their first to the end of their last
+void VulkanEngine::writePostTimestamp( VkCommandBuffer commandBuffer, PostEffect effect, bool isEnd ) {
+
+	if ( _postTimestampPool == VK_NULL_HANDLE ) {
+		return;
+	}
+
+	int effectIndex = static_cast<int>( effect );
+	uint query = _flightFrame * TIMESTAMPS_PER_FRAME + 2 + effectIndex * 2 + ( isEnd ? 1 : 0 );
+
+	vkCmdWriteTimestamp( commandBuffer, isEnd ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+						 _postTimestampPool, query );
+
+	if ( isEnd ) {
+
+		_postTimestampsWritten[_flightFrame] |= 1 << effectIndex;
+	}
+}
+
+// Second input is unused when downsampling, the source is bound to both slots
+void VulkanEngine::recordBloomDownsample( VkCommandBuffer commandBuffer, int level ) {
+
+	if ( level == 0 ) {
+
+		writePostTimestamp( commandBuffer, PostEffect::Bloom, false );
+	}
+
+	RenderGraphImage source = level == 0 ? _hdrTarget : _bloomTargets[level - 1];
+
+	recordPostDispatch( commandBuffer, POST_BLOOM_DOWNSAMPLE, source, source, _bloomTargets[level], getBloomExtent( level ),
+						glm::vec4( BLOOM_THRESHOLD, level == 0 ? 1.f : 0.f, 0.f, 0.f ) );
+}
+
+void VulkanEngine::recordBloomUpsample( VkCommandBuffer commandBuffer, int level ) {
+
+	RenderGraphImage source = _bloomTargets[level + 1];
+
+	recordPostDispatch( commandBuffer, POST_BLOOM_UPSAMPLE, source, source, _bloomTargets[level], getBloomExtent( level ), glm::vec4( 0.f ) );
+
+	if ( level == 0 ) {
+
+		writePostTimestamp( commandBuffer, PostEffect::Bloom, true );
+	}
+}
+
+// Without bloom the HDR target is bound as the bloom input with zero strength
+void VulkanEngine::recordTonemap( VkCommandBuffer commandBuffer ) {
+
+	bool hasBloom = !_bloomTargets.empty();
+	bool isTonemapped = _postEffects[static_cast<int>( PostEffect::Tonemap )];
+
+	writePostTimestamp( commandBuffer, PostEffect::Tonemap, false );
+
+	recordPostDispatch( commandBuffer, POST_TONEMAP, _hdrTarget, hasBloom ? _bloomTargets[0] : _hdrTarget, _tonemapTarget, _swapchainExtent,
+						glm::vec4( EXPOSURE, hasBloom ? BLOOM_STRENGTH : 0.f, isTonemapped ? 1.f : 0.f, _isSwapchainSrgb ? 0.f : 1.f ) );
+
+	writePostTimestamp( commandBuffer, PostEffect::Tonemap, true );
+}
+
+void VulkanEngine::recordFxaa( VkCommandBuffer commandBuffer ) {
+
+	writePostTimestamp( commandBuffer, PostEffect::Fxaa, false );
+
+	recordPostDispatch( commandBuffer, POST_FXAA, _tonemapTarget, _tonemapTarget, _fxaaTarget, _swapchainExtent, glm::vec4( 0.f ) );
+
+	writePostTimestamp( commandBuffer, PostEffect::Fxaa, true );
+}
+
+// Same extent on both sides, the blit only converts RGBA to the swapchain's channel order
+void VulkanEngine::recordPresentBlit( VkCommandBuffer commandBuffer, RenderGraphImage source ) {
+
+	VkImageSubresourceLayers subresource {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.mipLevel = 0,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+	};
+
+	VkOffset3D extent = { static_cast<int32_t>( _swapchainExtent.width ), static_cast<int32_t>( _swapchainExtent.height ), 1 };
+
+	VkImageBlit region {
+		.srcSubresource = subresource,
+		.srcOffsets = { { 0, 0, 0 }, extent },
+		.dstSubresource = subresource,
+		.dstOffsets = { { 0, 0, 0 }, extent },
+	};
+
+	vkCmdBlitImage( commandBuffer, _renderGraph.getImage( source ), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					_renderGraph.getImage( _swapchainTarget ), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST );
+}
+
+// Tonemapping always runs since it writes the display range image, turning it off only clamps
+void VulkanEngine::setPostEffect( PostEffect effect, bool enabled ) {
+
+	int effectIndex = static_cast<int>( effect );
+
+	if ( _postEffects[effectIndex] == enabled ) {
+		return;
+	}
+
+	_postEffects[effectIndex] = enabled;
+
+	if ( effect != PostEffect::Tonemap ) {
+
+		vkDeviceWaitIdle( _device );
+		rebuildRenderGraph();
+	}
+
+	resetGpuTimings();
+
+	std::cout << "Post effect " << postEffectNames[effectIndex] << ": " << ( enabled ? "on" : "off" ) << std::endl;
+}
+
+bool VulkanEngine::isPostEffectEnabled( PostEffect effect ) {
+
+	return _postEffects[static_cast<int>( effect )];
+}
+
+void VulkanEngine::resetGpuTimings() {
+
+	_gpuTimeSum = 0.0;
+	_gpuTimeSamples = 0;
+
+	for ( int effect = 0; effect < POST_EFFECT_COUNT; effect++ ) {
+
+		_postTimeSums[effect] = 0.0;
+		_postTimeSamples[effect] = 0;
+	}
+}
+
+void VulkanEngine::createRenderGraph() {
+
+	_renderGraph.init( _device, _physicalDevice, [this] ( VkCommandBuffer commandBuffer, const vector<VkImageMemoryBarrier2KHR>& barriers,
+														   const vector<VkBufferMemoryBarrier2KHR>& bufferBarriers ) {
+		recordBarriers( commandBuffer, barriers, bufferBarriers );
+	});
+
+	// Without async compute both families are the graphics one, so compute passes stay on the graphics queue
+	uint graphicsFamily = _graphicsTimeline.getFamily();
+	_renderGraph.setQueueFamilies( graphicsFamily, _hasAsyncCompute ? _computeFamily.value() : graphicsFamily );
+
+	buildRenderGraph();
+}
+
+// Declares the frame, passes are culled and barriers placed by the graph
+void VulkanEngine::buildRenderGraph() {
+
+	_renderGraph.clear();
+
+	// Batch values of the previous graph don't apply, it was only replaced with the GPU idle
+	_previousBatchValues.clear();
+
+	// Acquire semaphore is waited at transfer, previous contents are discarded
+	_swapchainTarget = _renderGraph.importImage( "swapchain", VK_IMAGE_ASPECT_COLOR_BIT,
+		{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_NONE_KHR },
+		{ VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR } );
+
+	// Atlas is cleared every frame, it only has to wait for the previous frame's sampling
+	_shadowTarget = _renderGraph.importImage( "shadow atlas", VK_IMAGE_ASPECT_DEPTH_BIT,
+		{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR },
+		{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR } );
+
+	_renderGraph.bindImage( _shadowTarget, _shadowImage, _shadowImageView );
+
+	// Each frame in flight has its own grid, bound when the frame is recorded
+	_lightGridTarget = _renderGraph.importBuffer( "light grid" );
+
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	if ( hasStencilComponent( _depthFormat ) ) {
+
+		depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	// Depth only lives within the main pass unless the pre-pass stores it for the main pass to load
+	VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+	if ( !_depthPrepass ) {
+
+		depthUsage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	}
+
+	bool isCulling = isOcclusionCullingActive();
+	bool isMultisampled = _msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+	// Single sample depth is reduced into the pyramid directly
+	if ( isCulling && !isMultisampled ) {
+
+		depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
+	_depthTarget = _renderGraph.createImage( "depth", {
+		.format = _depthFormat,
+		.extent = _swapchainExtent,
+		.samples = _msaaSamples,
+		.usage = depthUsage,
+		.aspect = depthAspect,
+	});
+
+	// Sampled by the post chain, so it's never lazily allocated
+	_hdrTarget = _renderGraph.createImage( "hdr color", {
+		.format = HDR_FORMAT,
+		.extent = _swapchainExtent,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	});
+
+	if ( isMultisampled ) {
+
+		_msaaColorTarget = _renderGraph.createImage( "msaa color", {
+			.format = HDR_FORMAT,
+			.extent = _swapchainExtent,
+			.samples = _msaaSamples,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+			.aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+		});
+	}
+
+	// Visibility persists across frames, draw lists are per frame in flight. All are bound when the frame is recorded
+	if ( isCulling ) {
+
+		_visibilityTarget = _renderGraph.importBuffer( "chunk visibility" );
+		_earlyDrawTarget = _renderGraph.importBuffer( "early draws" );
+		_lateDrawTarget = _renderGraph.importBuffer( "late draws" );
+		_hizDepthTarget = _depthTarget;
+
+		// Early pre-pass resolves its depth for the pyramid
+		if ( isMultisampled ) {
+
+			_hizDepthTarget = _renderGraph.createImage( "hi-z depth", {
+				.format = _depthFormat,
+				.extent = _swapchainExtent,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				.aspect = VK_IMAGE_ASPECT_DEPTH_BIT,
+			});
+		}
+	}
+
+	_renderGraph.addPass( "shadows", [this] ( VkCommandBuffer commandBuffer ) { recordShadowPass( commandBuffer ); } )
+		.write( _shadowTarget, ImageUsage::DepthAttachment );
+
+	// Overlaps the shadow and depth passes on the compute queue
+	_renderGraph.addPass( "light clusters", [this] ( VkCommandBuffer commandBuffer ) { recordLightClustering( commandBuffer ); } )
+		.write( _lightGridTarget, BufferUsage::ComputeStorageWrite )
+		.asyncCompute();
+
+	// Chunks visible last frame are drawn first, the rest is tested against their depth
+	if ( isCulling ) {
+
+		_renderGraph.addPass( "early cull", [this] ( VkCommandBuffer commandBuffer ) { recordOcclusionCull( commandBuffer, false ); } )
+			.read( _visibilityTarget, BufferUsage::ComputeStorageRead )
+			.write( _earlyDrawTarget, BufferUsage::ComputeStorageWrite );
+	}
+
+	if ( _depthPrepass ) {
+
+		auto depthPass = _renderGraph.addPass( "depth prepass", [this] ( VkCommandBuffer commandBuffer ) { recordDepthPrepass( commandBuffer, false ); } )
+			.write( _depthTarget, ImageUsage::DepthAttachment );
+
+		if ( isCulling ) {
+
+			depthPass.read( _earlyDrawTarget, BufferUsage::IndirectRead );
+		}
+
+		if ( isCulling && isMultisampled ) {
+
+			depthPass.write( _hizDepthTarget, ImageUsage::DepthResolve );
+		}
+	}
+
+	// Pyramid is owned by the engine and sampled by the late cull, which runs right after on the same queue
+	if ( isCulling ) {
+
+		_renderGraph.addPass( "hi-z", [this] ( VkCommandBuffer commandBuffer ) { recordHizBuild( commandBuffer ); } )
+			.read( _hizDepthTarget, ImageUsage::ComputeSampled )
+			.sideEffects();
+
+		_renderGraph.addPass( "late cull", [this] ( VkCommandBuffer commandBuffer ) { recordOcclusionCull( commandBuffer, true ); } )
+			.write( _visibilityTarget, BufferUsage::ComputeStorageWrite )
+			.write( _lateDrawTarget, BufferUsage::ComputeStorageWrite );
+
+		_renderGraph.addPass( "late depth prepass", [this] ( VkCommandBuffer commandBuffer ) { recordDepthPrepass( commandBuffer, true ); } )
+			.read( _lateDrawTarget, BufferUsage::IndirectRead )
+			.write( _depthTarget, ImageUsage::DepthAttachment );
+	}
+
+	// Resolve writes the HDR target as a color attachment
+	auto mainPass = _renderGraph.addPass( "main", [this] ( VkCommandBuffer commandBuffer ) { recordMainPass( commandBuffer ); } )
+		.write( _hdrTarget, ImageUsage::ColorAttachment )
+		.read( _shadowTarget, ImageUsage::FragmentSampled )
+		.read( _lightGridTarget, BufferUsage::FragmentStorageRead );
+
+	if ( isMultisampled ) {
+
+		mainPass.write( _msaaColorTarget, ImageUsage::ColorAttachment );
+	}
+
+	if ( isCulling ) {
+
+		mainPass.read( _earlyDrawTarget, BufferUsage::IndirectRead )
+			.read( _lateDrawTarget, BufferUsage::IndirectRead );
+	}
+
+	if ( _depthPrepass ) {
+
+		mainPass.read( _depthTarget, ImageUsage::DepthRead );
+	} else {
+
+		mainPass.write( _depthTarget, ImageUsage::DepthAttachment );
+	}
+
+	buildPostChain();
+
+	// Copies the finished image out for frame stats
+	if ( _frameReadback ) {
+
+		_renderGraph.addPass( "readback", [this] ( VkCommandBuffer commandBuffer ) { recordReadback( commandBuffer ); } )
+			.read( _swapchainTarget, ImageUsage::TransferSrc )
+			.sideEffects();
+	}
+
+	_renderGraph.compile();
+}
+
+void VulkanEngine::createSyncObjects() {
+
+	VkSemaphoreCreateInfo semaphoreInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+
+	_imageAvailableSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
+	_renderFinishedSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+
+		if ( vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i] ) != VK_SUCCESS ||
+			vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i] ) != VK_SUCCESS ) {
+
+			throw std::runtime_error("Unable to create semaphores");
+		}
+	}
+}
+
+// Buffers read by both queues without hand over, like host written per frame data, are shared by their families
+void VulkanEngine::createBuffer( 
+		VkDeviceSize bufferSize, VkBufferUsageFlags usageFlags,
+		VkMemoryPropertyFlags memProps, VkBuffer &buffer, VkDeviceMemory &bufferMemory, bool isSharedByQueues ){
+
+	{
+		uint queueFamilies[] = { _graphicsTimeline.getFamily(), _computeTimeline.getFamily() };
+		bool isConcurrent = isSharedByQueues && _hasAsyncCompute;
+
+		VkBufferCreateInfo createInfo {
 			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 			.size = bufferSize,
 			.usage = usageFlags,
-			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+			.sharingMode = isConcurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = isConcurrent ? 2u : 0u,
+			.pQueueFamilyIndices = isConcurrent ? queueFamilies : nullptr,
 		};
 
 		if ( vkCreateBuffer( _device, &createInfo, nullptr, &buffer) != VK_SUCCESS ) {
@@ -1005,7 +3381,7 @@ void VulkanEngine::createDescriptorSetlayout() {
 		.binding = 0,
 		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
 		.pImmutableSamplers = nullptr
 	};
 
@@ -1017,22 +3393,243 @@ void VulkanEngine::createDescriptorSetlayout() {
 		.pImmutableSamplers = nullptr,
 	};
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+	VkDescriptorSetLayoutBinding paletteLayoutBinding {
+		.binding = 2,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.pImmutableSamplers = nullptr,
+	};
+
+	VkDescriptorSetLayoutBinding shadowLayoutBinding {
+		.binding = 3,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.pImmutableSamplers = nullptr,
+	};
+
+	VkDescriptorSetLayoutBinding lightsLayoutBinding {
+		.binding = 4,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+		.pImmutableSamplers = nullptr,
+	};
+
+	VkDescriptorSetLayoutBinding lightGridLayoutBinding {
+		.binding = 5,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+		.pImmutableSamplers = nullptr,
+	};
+
+	_layoutCache.init( _device );
+	_descriptorSetLayout = _layoutCache.get({
+		uboLayoutBinding, samplerLayoutBinding, paletteLayoutBinding, shadowLayoutBinding, lightsLayoutBinding, lightGridLayoutBinding
+	});
+}
+
+void VulkanEngine::createUniformBuffer() {
+	VkDeviceSize bufferSize = sizeof( UniformBufferObject );
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+
+		createBuffer( bufferSize, 
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+			buffer, memory, true );
+
+		_uniformBuffers.push_back( buffer );
+		_uniformBufferMemory.push_back( memory );
+
+		void* mappedMemory;
+
+		vkMapMemory( _device, memory, 0, bufferSize, 0, &mappedMemory);
+
+		_uniformBufferMapped.push_back( mappedMemory );
+	}
+}
+
+float VulkanEngine::getElapsedTime() {
+
+	auto currentTime = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<float, std::chrono::seconds::period>(currentTime - _startTime).count();
+}
+
+void VulkanEngine::updateUniformBuffer( int frame, const FrameState& state ) {
+
+	int flightFrame = frame % MAX_FRAMES_IN_FLIGHT;
+
+	glm::vec3 eyePos = state.eyePos;
+	glm::vec3 targetPos = state.targetPos;
+	glm::vec3 upVec = glm::vec3(0, 0, -1);
+
+	CameraFrustum camera {
+		.view = glm::lookAt(eyePos, targetPos, upVec),
+		.fovY = glm::radians(45.0f),
+		.aspect = _swapchainExtent.width / (float) _swapchainExtent.height,
+		.near = 0.1f,
+		.far = 1000.0f,
+	};
+
+	UniformBufferObject ubo{};
+	ubo.model = glm::rotate( glm::mat4(1.0f), glm::radians( 180.0f ), glm::vec3( 0.0f, 0.0f, 1.0f) );
+	ubo.view = camera.view;
+	ubo.proj = glm::perspective(camera.fovY, camera.aspect, camera.near, camera.far);
 
-	VkDescriptorSetLayoutCreateInfo layoutInfo {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = bindings.size(),
-		.pBindings = bindings.data()
+	// Rotation only, radius stays the same in world space
+	_modelWorldBounds = {
+		.center = glm::vec3( ubo.model * glm::vec4( _modelBounds.center, 1.f ) ),
+		.radius = _modelBounds.radius,
 	};
 
-	if ( vkCreateDescriptorSetLayout( _device, &layoutInfo, nullptr, &_descriptorSetLayout ) != VK_SUCCESS ) {
+	_shadows.update( camera, LIGHT_DIRECTION, { _modelWorldBounds } );
+
+	// Texture is spread once over the model, so its texel density follows the model's size on screen
+	float distance = std::max( glm::length( eyePos - _modelWorldBounds.center ), _modelWorldBounds.radius );
+	float screenDiameter = _modelWorldBounds.radius / ( distance * std::tan( camera.fovY * 0.5f ) ) * _swapchainExtent.height;
+	float texelsPerPixel = _textureStreamer.getBaseSize( _texture ) / std::max( screenDiameter, 1.f );
+
+	_textureStreamer.requestMip( _texture, static_cast<uint>( std::max( std::floor( std::log2( texelsPerPixel ) ), 0.f ) ), frame );
+
+	for ( int i = 0; i < SHADOW_CASCADES; i++ ) {
+
+		ubo.shadowViewProj[i] = _shadows.getCascade( i ).viewProj;
+		ubo.cascadeSplits[i] = _shadows.getCascade( i ).splitDepth;
+	}
+
+	float clusterFar = std::min( camera.far, LIGHT_CLUSTER_DISTANCE );
+
+	ubo.sunDirection = glm::vec4( LIGHT_DIRECTION, 0.f );
+	ubo.clusterDepth = glm::vec4( camera.near, clusterFar, CLUSTER_Z / std::log( clusterFar / camera.near ), camera.far );
+	ubo.screenSize = glm::vec2( _swapchainExtent.width, _swapchainExtent.height );
+
+	// Light count is filled in by updateLights once the lights are culled against this view
+	_cameraViewProj = ubo.proj * ubo.view;
+
+	memcpy( _uniformBufferMapped[flightFrame], &ubo, sizeof(ubo) );
+}
+
+void VulkanEngine::createLightBuffers() {
+
+	VkDeviceSize lightsSize = sizeof( Light ) * MAX_LIGHTS;
+
+	// Light counts followed by a fixed capacity index list per cluster
+	VkDeviceSize gridSize = sizeof( uint32_t ) * CLUSTER_COUNT * ( 1 + MAX_LIGHTS_PER_CLUSTER );
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+
+		createBuffer( lightsSize, 
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+			buffer, memory, true );
+
+		_lightBuffers.push_back( buffer );
+		_lightBufferMemory.push_back( memory );
+
+		void* mappedMemory;
+
+		vkMapMemory( _device, memory, 0, lightsSize, 0, &mappedMemory);
+
+		_lightBufferMapped.push_back( mappedMemory );
+
+		// Written by the cluster pass every frame, only read on the GPU. The render graph hands it between queues
+		createBuffer( gridSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			buffer, memory);
+
+		_lightGridBuffers.push_back( buffer );
+		_lightGridMemory.push_back( memory );
+	}
+}
+
+void VulkanEngine::updateLights( int flightFrame, float time ) {
+
+	glm::vec3 center = _modelWorldBounds.center;
+	float radius = _modelWorldBounds.radius;
+
+	_sceneLights.resize( LIGHT_COUNT );
+	_lightBounds.resize( LIGHT_COUNT );
+
+	for ( int i = 0; i < LIGHT_COUNT; i++ ) {
+
+		// Golden angle spreads the lights evenly around the orbit
+		float phase = i * 2.39996f;
+		float angle = phase + time * ( 0.2f + 0.3f * ( i % 5 ) / 4.f );
+		float orbit = radius * ( 0.6f + 0.6f * ( i % 7 ) / 6.f );
+		float height = radius * std::sin( phase * 3.f + time * 0.5f ) * 0.5f;
+
+		// World up is -z
+		glm::vec3 position = center + glm::vec3( std::cos( angle ) * orbit, std::sin( angle ) * orbit, -height );
+		glm::vec3 color = glm::vec3( 0.5f ) + 0.5f * glm::cos( glm::vec3( 0.f, 2.094f, 4.189f ) + phase );
+
+		Light& light = _sceneLights[i];
+
+		if ( i % SPOT_LIGHT_INTERVAL == 0 ) {
+
+			light.positionRange = glm::vec4( position, radius * 1.5f );
+			light.color = glm::vec4( color * radius * 2.f, 0.f );
+			light.direction = glm::vec4( glm::normalize( center - position ), 0.f );
+			light.spotCone = glm::vec4( std::cos( glm::radians( 30.f ) ), std::cos( glm::radians( 20.f ) ), 0.f, 0.f );
+		} else {
+
+			light.positionRange = glm::vec4( position, radius * 0.5f );
+			light.color = glm::vec4( color * radius * 0.5f, 0.f );
+			light.direction = glm::vec4( 0.f );
+			light.spotCone = glm::vec4( -1.f, -1.f, 0.f, 0.f );
+		}
+
+		float range = light.positionRange.w;
 
-		throw std::runtime_error("Failed to create descriptor layout");
+		_lightBounds[i] = Aabb { .min = position - glm::vec3( range ), .max = position + glm::vec3( range ) };
 	}
+
+	// Lights move every frame, the tree is refit in place and only rebuilt once it has degraded
+	if ( _lightBvh.isEmpty() ) {
+
+		_lightBvh.build( _lightBounds );
+		_lightBvhBuildCost = _lightBvh.getCost();
+	} else {
+
+		_lightBvh.refit( _lightBounds );
+
+		if ( _lightBvh.getCost() > _lightBvhBuildCost * BVH_REBUILD_RATIO ) {
+
+			_lightBvh.build( _lightBounds );
+			_lightBvhBuildCost = _lightBvh.getCost();
+		}
+	}
+
+	// Only lights reaching into the view are uploaded for clustering
+	glm::vec4 planes[6];
+	extractFrustumPlanes( _cameraViewProj, planes );
+
+	auto lights = static_cast<Light*>( _lightBufferMapped[flightFrame] );
+	int lightCount = 0;
+
+	_lightBvh.queryPlanes( planes, 6, [&] ( uint item ) {
+
+		if ( lightCount < MAX_LIGHTS ) {
+			lights[lightCount++] = _sceneLights[item];
+		}
+	});
+
+	static_cast<UniformBufferObject*>( _uniformBufferMapped[flightFrame] )->lightCount = lightCount;
 }
 
-void VulkanEngine::createUniformBuffer() {
-	VkDeviceSize bufferSize = sizeof( UniformBufferObject );
+void VulkanEngine::createJointPaletteBuffers() {
+
+	VkDeviceSize bufferSize = sizeof( glm::mat4 ) * MAX_JOINTS * MAX_ANIMATED_INSTANCES;
 
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 
@@ -1040,127 +3637,87 @@ void VulkanEngine::createUniformBuffer() {
 		VkDeviceMemory memory;
 
 		createBuffer( bufferSize, 
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
 			buffer, memory);
 
-		_uniformBuffers.push_back( buffer );
-		_uniformBufferMemory.push_back( memory );
+		_jointPaletteBuffers.push_back( buffer );
+		_jointPaletteMemory.push_back( memory );
 
 		void* mappedMemory;
 
 		vkMapMemory( _device, memory, 0, bufferSize, 0, &mappedMemory);
 
-		_uniformBufferMapped.push_back( mappedMemory );
+		_jointPaletteMapped.push_back( mappedMemory );
 	}
 }
 
-void VulkanEngine::updateUniformBuffer( int flightFrame ) {
+void VulkanEngine::updateAnimation( int flightFrame, float time ) {
 
-	static auto startTime = std::chrono::high_resolution_clock::now();
+	auto palettes = static_cast<glm::mat4*>( _jointPaletteMapped[flightFrame] );
+	size_t instanceCount = std::min<size_t>( _animationInstances.size(), MAX_ANIMATED_INSTANCES );
 
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float elapsedTimeSinceStartup = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	// Instances are independent, each one writes its own palette range
+	parallelFor( instanceCount, 4, [this, palettes, time] ( size_t begin, size_t end ) {
 
-	glm::vec3 eyePos = glm::vec3(1.0f, 1.0f, 1.0f) * (24 + abs(sin(elapsedTimeSinceStartup)) * 4);
-	glm::vec3 targetPos = glm::vec3(0.0f, 0.0f, 12.0f);
-	glm::vec3 upVec = glm::vec3(0, 0, -1);
+		for ( size_t i = begin; i < end; i++ ) {
 
-	UniformBufferObject ubo{};
-	ubo.model = glm::rotate( glm::mat4(1.0f), glm::radians( 180.0f ), glm::vec3( 0.0f, 0.0f, 1.0f) );
-	ubo.view = glm::lookAt(eyePos, targetPos, upVec);
-	ubo.proj = glm::perspective(glm::radians(45.0f), _swapchainExtent.width / (float) _swapchainExtent.height, 0.1f, 1000.0f);
+			auto& instance = _animationInstances[i];
 
-	memcpy( _uniformBufferMapped[flightFrame], &ubo, sizeof(ubo) );
-}
+			if ( instance.clip < 0 ) {
 
-void VulkanEngine::createDescriptorPool() {
+				instance.pose = _skeleton.bindPose;
+			} else {
 
-	std::array<VkDescriptorPoolSize, 2> poolSize {
-		VkDescriptorPoolSize {
-			.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			.descriptorCount = MAX_FRAMES_IN_FLIGHT
-		},
-		VkDescriptorPoolSize {
-			.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			.descriptorCount = MAX_FRAMES_IN_FLIGHT
-		},
-	};
+				instance.sampler.sample( _animationClips[instance.clip], _skeleton, time + instance.timeOffset, instance.pose );
 
-	VkDescriptorPoolCreateInfo createInfo {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-		.maxSets = MAX_FRAMES_IN_FLIGHT,
-		.poolSizeCount = poolSize.size(),
-		.pPoolSizes = poolSize.data(),
-	};
+				if ( instance.blendClip >= 0 && instance.blendWeight > 0.f ) {
 
-	if ( vkCreateDescriptorPool( _device, &createInfo, nullptr, &_descriptorPool ) != VK_SUCCESS ) {
+					instance.blendSampler.sample( _animationClips[instance.blendClip], _skeleton, time + instance.timeOffset, instance.blendPose );
+					blendPoses( instance.pose, instance.blendPose, instance.blendWeight, instance.pose );
+				}
+			}
 
-		throw std::runtime_error( "Failed to create descriptor pool" );
-	}
+			computeSkinningPalette( _skeleton, instance.pose, instance.globalTransforms, palettes + i * MAX_JOINTS );
+		}
+	});
 }
 
-void VulkanEngine::allocDescriptorSets() {
+// Pools are sized for the main set and the post passes of a frame and grow when more are allocated
+void VulkanEngine::createDescriptorAllocators() {
 
-	vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, _descriptorSetLayout);
-
-	VkDescriptorSetAllocateInfo allocInfo {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool = _descriptorPool,
-		.descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
-		.pSetLayouts = layouts.data(),
+	const vector<PoolRatio> ratios = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 }, // texture and shadow atlas
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 }, // joint palette, lights and light grid
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }, // post pass output
 	};
 
+	_frameDescriptors.resize( MAX_FRAMES_IN_FLIGHT );
 	_descriptorSets.resize( MAX_FRAMES_IN_FLIGHT );
 
-	if ( vkAllocateDescriptorSets( _device, &allocInfo, _descriptorSets.data() ) != VK_SUCCESS ) {
+	for ( auto& allocator : _frameDescriptors ) {
 
-		throw std::runtime_error( "Failed to allocate descriptor set" );
+		allocator.init( _device, DESCRIPTOR_SETS_PER_POOL, ratios );
 	}
+}
 
-	for( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
-
-		VkDescriptorBufferInfo bufferInfo {
-			.buffer = _uniformBuffers[i],
-			.offset = 0,
-			.range = sizeof(UniformBufferObject)
-		};
-
-		VkDescriptorImageInfo imageInfo {
-			.sampler = _textureSampler,
-			.imageView = _textureImageView,
-			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		};
+// Sets are allocated fresh every frame, so a changed texture view or sampler shows up without tracking
+void VulkanEngine::writeFrameDescriptors( int flightFrame ) {
 
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites {
-
-			VkWriteDescriptorSet {
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.dstSet = _descriptorSets[i],
-				.dstBinding = 0,
-				.dstArrayElement = 0,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.pImageInfo = nullptr,
-				.pBufferInfo = &bufferInfo,
-				.pTexelBufferView = nullptr,
-			},
+	VkDescriptorSet set = _frameDescriptors[flightFrame].allocate( _descriptorSetLayout );
 
-			VkWriteDescriptorSet {
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.dstSet = _descriptorSets[i],
-				.dstBinding = 1,
-				.dstArrayElement = 0,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.pImageInfo = &imageInfo,
-				.pTexelBufferView = nullptr,
-			}
-		};
+	_descriptorWriter.writeBuffer( set, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, _uniformBuffers[flightFrame], sizeof( UniformBufferObject ) );
+	_descriptorWriter.writeImage( set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _textureStreamer.getImageView( _texture ), _textureSampler,
+								  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+	_descriptorWriter.writeBuffer( set, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _jointPaletteBuffers[flightFrame] );
+	_descriptorWriter.writeImage( set, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _shadowImageView, _shadowSampler,
+								  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+	_descriptorWriter.writeBuffer( set, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _lightBuffers[flightFrame] );
+	_descriptorWriter.writeBuffer( set, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _lightGridBuffers[flightFrame] );
+	_descriptorWriter.flush( _device );
 
-		vkUpdateDescriptorSets( _device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr );
-	}
+	_descriptorSets[flightFrame] = set;
 }
 
 VkCommandBuffer VulkanEngine::beginSingleTimeCommands() {
@@ -1185,23 +3742,15 @@ VkCommandBuffer VulkanEngine::beginSingleTimeCommands() {
 	return allocatedBuffer;
 }
 
+// Waits for this submission only, frames in flight keep running
 void VulkanEngine::endSingleTimeCommands( VkCommandBuffer commandBuffer ) {
 
-	vkEndCommandBuffer( commandBuffer );
-
-	VkSubmitInfo submitInfo {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &commandBuffer
-	};
-
-	vkQueueSubmit( _graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-	vkQueueWaitIdle( _graphicsQueue );
+	_graphicsTimeline.wait( _graphicsTimeline.submit( commandBuffer, {} ) );
 
 	vkFreeCommandBuffers( _device, _commandPool, 1, &commandBuffer );
 }
 
-void VulkanEngine::createImage(uint width, uint height, ImageParams parameters, VkImage& image, VkDeviceMemory& imageMemory) {
+void VulkanEngine::createImage(uint width, uint height, ImageParams parameters, VkImage& image, VkDeviceMemory& imageMemory, uint mipLevels) {
 
 	// TODO: optimize for release
 	parameters.validate();
@@ -1214,7 +3763,7 @@ void VulkanEngine::createImage(uint width, uint height, ImageParams parameters,
 		.extent = {.width = static_cast<uint>(width),
 					.height = static_cast<uint>(height),
 					.depth = 1},
-		.mipLevels = 1,
+		.mipLevels = mipLevels,
 		.arrayLayers = 1,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
 		.tiling = parameters.optTiling.value(),
@@ -1223,269 +3772,620 @@ void VulkanEngine::createImage(uint width, uint height, ImageParams parameters,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 	};
 
-	if (vkCreateImage(_device, &imageInfo, nullptr, &image) !=
-		VK_SUCCESS) {
+	if (vkCreateImage(_device, &imageInfo, nullptr, &image) !=
+		VK_SUCCESS) {
+
+	throw std::runtime_error("Failed to create texture image");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(_device, image, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo {
+	.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+	.allocationSize = memRequirements.size,
+	.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
+										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+	};
+
+	if ( vkAllocateMemory( _device, &allocInfo, nullptr, &imageMemory ) !=
+		VK_SUCCESS) {
+
+	throw std::runtime_error("Failed to allocate memory for image");
+	}
+
+	vkBindImageMemory( _device, image, imageMemory, 0 );
+}
+
+VkResult VulkanEngine::createImageView( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageView* pView,
+										uint baseMip, uint mipCount ) {
+
+	VkImageViewCreateInfo viewInfo {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.components {
+			.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.a = VK_COMPONENT_SWIZZLE_IDENTITY,
+		},
+		.subresourceRange = {
+			.aspectMask = aspectFlags,
+			.baseMipLevel = baseMip,
+			.levelCount = mipCount,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+
+	};
+
+	return vkCreateImageView( _device, &viewInfo, nullptr, pView );
+}
+
+void VulkanEngine::transitionImageLayout( VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout ) {
+
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	recordLayoutTransition( commandBuffer, image, format, oldLayout, newLayout );
+
+	endSingleTimeCommands( commandBuffer );
+}
+
+void VulkanEngine::recordLayoutTransition( VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout ) {
+
+	VkPipelineStageFlags2KHR sourceStage;
+	VkPipelineStageFlags2KHR destinationStage;
+	VkAccessFlags2KHR sourceAccessMask;
+	VkAccessFlags2KHR destinationAccessMask;
+
+	bool hasDepthAttachment = newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ) {
+
+		sourceAccessMask = 0;
+		destinationAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	
+	} else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ) {
+
+		sourceAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		destinationAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	} else if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && hasDepthAttachment ) {
+
+		sourceAccessMask = 0;
+		destinationAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+
+	} else {
+
+		throw std::runtime_error("Unsupported layout transition.");
+	}
+
+	VkImageMemoryBarrier2KHR barrier {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+		.srcStageMask = sourceStage,
+		.srcAccessMask = sourceAccessMask,
+		.dstStageMask = destinationStage,
+		.dstAccessMask = destinationAccessMask,
+		.oldLayout = oldLayout,
+		.newLayout = newLayout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = {
+			.aspectMask = hasDepthAttachment ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1
+		},
+	};
+
+	recordBarriers( commandBuffer, { barrier }, {} );
+}
+
+// All barriers are issued in a single call. Without synchronization 2 they are translated to
+// the legacy barrier, which is exact as long as only stage and access bits of Vulkan 1.0 are used
+void VulkanEngine::recordBarriers( VkCommandBuffer commandBuffer, const vector<VkImageMemoryBarrier2KHR>& barriers,
+									const vector<VkBufferMemoryBarrier2KHR>& bufferBarriers ) {
+
+	if ( _hasSynchronization2 ) {
+
+		VkDependencyInfoKHR dependencyInfo {
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+			.bufferMemoryBarrierCount = static_cast<uint>( bufferBarriers.size() ),
+			.pBufferMemoryBarriers = bufferBarriers.data(),
+			.imageMemoryBarrierCount = static_cast<uint>( barriers.size() ),
+			.pImageMemoryBarriers = barriers.data(),
+		};
+
+		_cmdPipelineBarrier2( commandBuffer, &dependencyInfo );
+		return;
+	}
+
+	VkPipelineStageFlags sourceStage = 0;
+	VkPipelineStageFlags destinationStage = 0;
+	vector<VkImageMemoryBarrier> legacyBarriers;
+	vector<VkBufferMemoryBarrier> legacyBufferBarriers;
+
+	for ( const auto& barrier : barriers ) {
+
+		sourceStage |= static_cast<VkPipelineStageFlags>( barrier.srcStageMask );
+		destinationStage |= static_cast<VkPipelineStageFlags>( barrier.dstStageMask );
+
+		legacyBarriers.push_back( VkImageMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = static_cast<VkAccessFlags>( barrier.srcAccessMask ),
+			.dstAccessMask = static_cast<VkAccessFlags>( barrier.dstAccessMask ),
+			.oldLayout = barrier.oldLayout,
+			.newLayout = barrier.newLayout,
+			.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+			.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+			.image = barrier.image,
+			.subresourceRange = barrier.subresourceRange,
+		});
+	}
+
+	for ( const auto& barrier : bufferBarriers ) {
+
+		sourceStage |= static_cast<VkPipelineStageFlags>( barrier.srcStageMask );
+		destinationStage |= static_cast<VkPipelineStageFlags>( barrier.dstStageMask );
+
+		legacyBufferBarriers.push_back( VkBufferMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = static_cast<VkAccessFlags>( barrier.srcAccessMask ),
+			.dstAccessMask = static_cast<VkAccessFlags>( barrier.dstAccessMask ),
+			.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+			.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+			.buffer = barrier.buffer,
+			.offset = barrier.offset,
+			.size = barrier.size,
+		});
+	}
+
+	// Empty stage masks aren't allowed by the legacy barrier
+	vkCmdPipelineBarrier( commandBuffer,
+							sourceStage ? sourceStage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+							destinationStage ? destinationStage : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+							0, nullptr,
+							static_cast<uint>( legacyBufferBarriers.size() ), legacyBufferBarriers.data(),
+							static_cast<uint>( legacyBarriers.size() ), legacyBarriers.data() );
+}
+
+void VulkanEngine::createSamplerCache() {
+
+	VkPhysicalDeviceProperties properties {};
+	vkGetPhysicalDeviceProperties( _physicalDevice, &properties );
+
+	_deviceMaxAnisotropy = properties.limits.maxSamplerAnisotropy;
+	_samplerCache.init( _device, _deviceMaxAnisotropy );
+	_maxAnisotropy = std::min( DEFAULT_MAX_ANISOTROPY, _deviceMaxAnisotropy );
+}
+
+VkSamplerAddressMode toAddressMode( TextureWrap wrap ) {
+
+	switch ( wrap ) {
+
+		case TextureWrap::Clamp: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		case TextureWrap::Mirror: return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+		case TextureWrap::Border: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		default: return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	}
+}
+
+// Material decides wrap and filter, the anisotropy setting only caps materials that want it
+void VulkanEngine::createTextureSampler() {
+
+	bool isNearest = _textureSampling.filter == TextureFilter::Nearest;
+
+	_textureSampler = _samplerCache.get({
+		.filter = isNearest ? VK_FILTER_NEAREST : VK_FILTER_LINEAR,
+		.mipmapMode = isNearest ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU = toAddressMode( _textureSampling.wrapU ),
+		.addressModeV = toAddressMode( _textureSampling.wrapV ),
+		.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+		.maxAnisotropy = _textureSampling.isAnisotropic ? _maxAnisotropy : 1.f,
+		.maxLod = VK_LOD_CLAMP_NONE, // views only hold the resident mips
+	});
+}
+
+void VulkanEngine::copyBufferToImage( VkBuffer buffer, VkImage image, uint width, uint height) {
+
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	recordCopyBufferToImage( commandBuffer, buffer, image, width, height );
+
+	endSingleTimeCommands( commandBuffer );
+}
+
+void VulkanEngine::recordCopyBufferToImage( VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint width, uint height ) {
+
+	VkBufferImageCopy region {
+		.bufferOffset = 0,
+		.bufferRowLength = 0,
+		.bufferImageHeight = 0,
+		.imageSubresource = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.imageOffset = { 0,0,0 },
+		.imageExtent = {
+			width, height, 1
+		}
+	};
+
+	vkCmdCopyBufferToImage( commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+}
+
+VkFormat VulkanEngine::findDepthFormat() {
+
+	auto candidateFormats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+
+	return findSupportedFormat( candidateFormats, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT );
+}
+
+// Shadow atlas is sampled with a linear depth comparison
+VkFormat VulkanEngine::findShadowFormat() {
+
+	auto candidateFormats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM };
+
+	return findSupportedFormat( candidateFormats, VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT );
+}
+
+VkFormat VulkanEngine::findSupportedFormat(
+	const vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+
+	for ( VkFormat format : candidates ) {
+
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties( _physicalDevice, format, &props );
+
+		if ( tiling == VK_IMAGE_TILING_LINEAR && 
+				( props.linearTilingFeatures & features ) == features ) {
+
+			return format;
+		} else if ( tiling == VK_IMAGE_TILING_OPTIMAL && 
+				(props.optimalTilingFeatures & features) == features ) {
+
+			return format;
+		}
+	}
+
+	throw std::runtime_error("Failed to find supported format!");
+}
+
+void VulkanEngine::startHotReload() {
+
+	// Only loose files are watched, packed assets are not meant to be edited
+	bool watching = _watcher.watch( "shaders" );
+	watching = _watcher.watch( "textures" ) || watching;
+
+	if ( watching ) {
+
+		_watcher.start( [this] ( const string& path ) { onAssetChanged( path ); } );
+	}
+}
+
+void VulkanEngine::onAssetChanged( const string& path ) {
+
+	try {
+
+		bool isShaderBinary = path == mainVertShaderPath || path == mainFragShaderPath ||
+							  path == depthVertShaderPath || path == shadowVertShaderPath ||
+							  path == clusterCompShaderPath || path == cullCompShaderPath;
+		bool isShaderSource = path == mainVertShaderSource || path == mainFragShaderSource ||
+							  path == depthVertShaderSource || path == shadowVertShaderSource ||
+							  path == clusterCompShaderSource || path == cullCompShaderSource;
+
+		for ( int i = 0; i < POST_SHADER_COUNT; i++ ) {
+
+			isShaderBinary = isShaderBinary || path == postShaderPaths[i];
+			isShaderSource = isShaderSource || path == postShaderSources[i];
+		}
+
+		if ( isShaderBinary || ( isShaderSource && _shaderCompiler ) ) {
+
+			reloadShaders();
+
+		} else if ( path == _texturePath ) {
+
+			reloadTexture();
+		}
+
+	} catch ( const std::exception& e ) {
+
+		// Keep rendering with previous version, a broken asset shouldn't stop the artist's session
+		std::cout << "Hot reload of " << path << " failed: " << e.what() << std::endl;
+	}
+}
+
+void VulkanEngine::reloadShaders() {
+
+	PendingShaders pending {
+		.shader = loadMainShader( true ),
+		.isDepthPrepassVariant = _depthPrepass,
+	};
+
+	try {
 
-	throw std::runtime_error("Failed to create texture image");
-	}
+		// Variant is read once, the pipeline has to match the tag applyReloads checks
+		pending.mainPipeline = createMainPipeline( pending.shader, pending.isDepthPrepassVariant );
 
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(_device, image, &memRequirements);
+		if ( _hasDynamicRendering ) {
 
-	VkMemoryAllocateInfo allocInfo {
-	.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-	.allocationSize = memRequirements.size,
-	.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-	};
+			VkShaderModule depthShader = loadShaderModule( depthVertShaderPath, depthVertShaderSource, ShaderStage::Vertex, true );
 
-	if ( vkAllocateMemory( _device, &allocInfo, nullptr, &imageMemory ) !=
-		VK_SUCCESS) {
+			try {
 
-	throw std::runtime_error("Failed to allocate memory for image");
-	}
+				pending.depthPrepassPipeline = createDepthOnlyPipeline( depthShader, false );
 
-	vkBindImageMemory( _device, image, imageMemory, 0 );
-}
+			} catch ( ... ) {
 
-void VulkanEngine::createTextureImage( Image image ) {
+				vkDestroyShaderModule( _device, depthShader, nullptr );
+				throw;
+			}
 
-	VkDeviceSize imageSize = image.getSize();
+			vkDestroyShaderModule( _device, depthShader, nullptr );
+		}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+		VkShaderModule shadowShader = loadShaderModule( shadowVertShaderPath, shadowVertShaderSource, ShaderStage::Vertex, true );
 
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				stagingBuffer, stagingBufferMemory);
+		try {
 
-	void *data;
+			pending.shadowPipeline = createDepthOnlyPipeline( shadowShader, true );
 
-	vkMapMemory(_device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, image.getPixelPointer(), image.getSize());
-	vkUnmapMemory(_device, stagingBufferMemory);
+		} catch ( ... ) {
 
-	const auto format = VK_FORMAT_R8G8B8A8_SRGB;
-	const auto imageParameters = samplerImageParams.Overriden( 
-		{ .optFormat = format } 
-	);
+			vkDestroyShaderModule( _device, shadowShader, nullptr );
+			throw;
+		}
 
-	createImage( image.getWidth(), image.getHeight(), imageParameters, _textureImage, _textureImageMemory );
-	transitionImageLayout( _textureImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-	copyBufferToImage( stagingBuffer, _textureImage, image.getWidth(), image.getHeight() );
-	transitionImageLayout( _textureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+		vkDestroyShaderModule( _device, shadowShader, nullptr );
 
-	vkDestroyBuffer( _device, stagingBuffer, nullptr );
-	vkFreeMemory( _device, stagingBufferMemory, nullptr );
-}
+		VkShaderModule clusterShader = loadShaderModule( clusterCompShaderPath, clusterCompShaderSource, ShaderStage::Compute, true );
 
-void VulkanEngine::createTextureImageView() {
+		try {
 
-	if ( createImageView( _textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, &_textureImageView ) != VK_SUCCESS ) {
+			pending.clusterPipeline = createClusterPipeline( clusterShader );
 
-		throw std::runtime_error( "Failed to create texture image view" );
-	}
+		} catch ( ... ) {
 
-}
+			vkDestroyShaderModule( _device, clusterShader, nullptr );
+			throw;
+		}
 
-VkResult VulkanEngine::createImageView( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageView* pView ) {
+		vkDestroyShaderModule( _device, clusterShader, nullptr );
 
-	VkImageViewCreateInfo viewInfo {
-		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-		.image = image,
-		.viewType = VK_IMAGE_VIEW_TYPE_2D,
-		.format = format,
-		.components {
-			.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.a = VK_COMPONENT_SWIZZLE_IDENTITY,
-		},
-		.subresourceRange = {
-			.aspectMask = aspectFlags,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
+		if ( _canCullOcclusion ) {
 
-	};
+			VkShaderModule cullShader = loadShaderModule( cullCompShaderPath, cullCompShaderSource, ShaderStage::Compute, true );
 
-	return vkCreateImageView( _device, &viewInfo, nullptr, pView );
-}
+			try {
 
-void VulkanEngine::transitionImageLayout( VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout ) {
+				pending.cullPipeline = createCullPipeline( cullShader );
 
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+			} catch ( ... ) {
 
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-	VkAccessFlags sourceAccessMask;
-	VkAccessFlags destinationAccessMask;
+				vkDestroyShaderModule( _device, cullShader, nullptr );
+				throw;
+			}
 
-	bool hasDepthAttachment = newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			vkDestroyShaderModule( _device, cullShader, nullptr );
+		}
 
-	if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ) {
+		pending.postPipelines = createPostPipelines( true );
 
-		sourceAccessMask = 0;
-		destinationAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	} catch ( ... ) {
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	
-	} else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ) {
+		destroyPendingShaders( pending );
+		throw;
+	}
 
-		sourceAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		destinationAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	std::lock_guard<std::mutex> lock( _reloadMutex );
 
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	// Newer version replaces one which wasn't picked up yet
+	if ( _pendingShaders.has_value() ) {
 
-	} else if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && hasDepthAttachment ) {
+		destroyPendingShaders( _pendingShaders.value() );
+	}
 
-		sourceAccessMask = 0;
-		destinationAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	_pendingShaders = pending;
+}
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+void VulkanEngine::destroyPendingShaders( PendingShaders& shaders ) {
 
-	} else {
+	if ( shaders.mainPipeline != VK_NULL_HANDLE ) {
 
-		throw std::runtime_error("Unsupported layout transition.");
+		vkDestroyPipeline( _device, shaders.mainPipeline, nullptr );
 	}
 
-	VkImageMemoryBarrier barrier {
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.srcAccessMask = sourceAccessMask,
-		.dstAccessMask = destinationAccessMask,
-		.oldLayout = oldLayout,
-		.newLayout = newLayout,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = image,
-		.subresourceRange = {
-			.aspectMask = hasDepthAttachment ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1
-		},
-	};
+	if ( shaders.depthPrepassPipeline != VK_NULL_HANDLE ) {
 
-	vkCmdPipelineBarrier( commandBuffer, sourceStage, destinationStage, 0, 
-							0, nullptr, 
-							0, nullptr, 
-							1, &barrier );
+		vkDestroyPipeline( _device, shaders.depthPrepassPipeline, nullptr );
+	}
 
-	endSingleTimeCommands( commandBuffer );
-}
+	if ( shaders.shadowPipeline != VK_NULL_HANDLE ) {
 
-void VulkanEngine::createTextureSampler() {
+		vkDestroyPipeline( _device, shaders.shadowPipeline, nullptr );
+	}
 
-	VkPhysicalDeviceProperties properties {};
-	vkGetPhysicalDeviceProperties( _physicalDevice, &properties );
+	if ( shaders.clusterPipeline != VK_NULL_HANDLE ) {
 
-	VkSamplerCreateInfo samplerInfo {
-		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-		.magFilter = VK_FILTER_LINEAR,
-		.minFilter = VK_FILTER_LINEAR,
-		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, // TODO: organize properly, rearrange with address mode
-		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-		.mipLodBias = 0.0f,
-		.anisotropyEnable = VK_TRUE,
-		.maxAnisotropy = properties.limits.maxSamplerAnisotropy,
-		.compareEnable = VK_FALSE,
-		.compareOp = VK_COMPARE_OP_ALWAYS,
-		.minLod = 0.0f,
-		.maxLod = 0.0f,
-		.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
-		.unnormalizedCoordinates = VK_FALSE,
-	};
+		vkDestroyPipeline( _device, shaders.clusterPipeline, nullptr );
+	}
 
-	if ( vkCreateSampler( _device, &samplerInfo, nullptr, &_textureSampler ) != VK_SUCCESS ) {
+	if ( shaders.cullPipeline != VK_NULL_HANDLE ) {
 
-		throw std::runtime_error("Failed to create texture sampler!");
+		vkDestroyPipeline( _device, shaders.cullPipeline, nullptr );
 	}
+
+	destroyPostPipelines( shaders.postPipelines );
+
+	shaders.shader.release();
 }
 
-void VulkanEngine::copyBufferToImage( VkBuffer buffer, VkImage image, uint width, uint height) {
+void VulkanEngine::reloadTexture() {
 
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	auto image = Image::openFile( _texturePath.c_str() );
+	vector<unsigned char> pixels( image.getSize() );
 
-	VkBufferImageCopy region {
-		.bufferOffset = 0,
-		.bufferRowLength = 0,
-		.bufferImageHeight = 0,
-		.imageSubresource = {
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.mipLevel = 0,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
-		.imageOffset = { 0,0,0 },
-		.imageExtent = {
-			width, height, 1
-		}
+	image.readPixels( pixels.data() );
+
+	PendingTexture texture {
+		.mips = buildMipChain( std::move( pixels ), image.getWidth(), image.getHeight() ),
 	};
 
-	vkCmdCopyBufferToImage( commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+	std::lock_guard<std::mutex> lock( _reloadMutex );
 
-	endSingleTimeCommands( commandBuffer );
+	// Newer version replaces one which wasn't picked up yet
+	_pendingTexture = std::move( texture );
 }
 
-void VulkanEngine::createDepthResources() {
+// Called right after the flight frame's previous use was waited for, so its descriptor set isn't used by GPU anymore
+void VulkanEngine::applyReloads( int frame, int flightFrame ) {
 
-	VkFormat depthFormat = findDepthFormat();
-	const auto imageParameters = samplerImageParams.Overriden( {
-		.optFormat = depthFormat,
-		.optUsageFlags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
-	});
+	{
+		std::lock_guard<std::mutex> lock( _reloadMutex );
 
-	createImage( _swapchainExtent.width, _swapchainExtent.height, imageParameters, _depthImage, _depthImageMemory );
-	createImageView( _depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, &_depthImageView );
+		if ( _pendingShaders.has_value() ) {
 
-	transitionImageLayout( _depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL );
-}
+			auto& pending = _pendingShaders.value();
 
-VkFormat VulkanEngine::findDepthFormat() {
+			// Pre-pass was toggled while the reload was compiling
+			if ( pending.isDepthPrepassVariant != _depthPrepass ) {
 
-	auto candidateFormats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+				vkDestroyPipeline( _device, pending.mainPipeline, nullptr );
+				pending.mainPipeline = createMainPipeline( pending.shader, _depthPrepass );
+			}
 
-	return findSupportedFormat( candidateFormats, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT );
-}
+			// Shader is kept, so toggling the pre-pass rebuilds pipelines from the latest version
+			Shader oldShader = _mainShader;
+			VkPipeline oldPipeline = _mainGraphicsPipeline;
+			VkPipeline oldDepthPrepassPipeline = pending.depthPrepassPipeline != VK_NULL_HANDLE ? _depthPrepassPipeline : VK_NULL_HANDLE;
+			VkPipeline oldShadowPipeline = _shadowPipeline;
+			VkPipeline oldClusterPipeline = _clusterPipeline;
+			VkPipeline oldCullPipeline = _cullPipeline;
+			PostPipelines oldPostPipelines = _postPipelines;
 
-VkFormat VulkanEngine::findSupportedFormat(
-	const vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+			_deletionQueue.push( getFrameEnd( frame - 1 ), [this, oldShader, oldPipeline, oldDepthPrepassPipeline, oldShadowPipeline, oldClusterPipeline,
+															 oldCullPipeline, oldPostPipelines] () mutable {
+				vkDestroyPipeline( _device, oldPipeline, nullptr );
+				vkDestroyPipeline( _device, oldShadowPipeline, nullptr );
+				vkDestroyPipeline( _device, oldClusterPipeline, nullptr );
+				destroyPostPipelines( oldPostPipelines );
 
-	for ( VkFormat format : candidates ) {
+				if ( oldDepthPrepassPipeline != VK_NULL_HANDLE ) {
 
-		VkFormatProperties props;
-		vkGetPhysicalDeviceFormatProperties( _physicalDevice, format, &props );
+					vkDestroyPipeline( _device, oldDepthPrepassPipeline, nullptr );
+				}
 
-		if ( tiling == VK_IMAGE_TILING_LINEAR && 
-				( props.linearTilingFeatures & features ) == features ) {
+				if ( oldCullPipeline != VK_NULL_HANDLE ) {
 
-			return format;
-		} else if ( tiling == VK_IMAGE_TILING_OPTIMAL && 
-				(props.optimalTilingFeatures & features) == features ) {
+					vkDestroyPipeline( _device, oldCullPipeline, nullptr );
+				}
 
-			return format;
+				oldShader.release();
+			});
+
+			_mainShader = pending.shader;
+			_mainGraphicsPipeline = pending.mainPipeline;
+			_shadowPipeline = pending.shadowPipeline;
+			_clusterPipeline = pending.clusterPipeline;
+			_cullPipeline = pending.cullPipeline;
+			_postPipelines = pending.postPipelines;
+
+			if ( pending.depthPrepassPipeline != VK_NULL_HANDLE ) {
+
+				_depthPrepassPipeline = pending.depthPrepassPipeline;
+			}
+
+			_pendingShaders.reset();
+		}
+
+		// New version streams in from its mip tail, starting with this frame's command buffer
+		if ( _pendingTexture.has_value() ) {
+
+			_textureStreamer.replaceTexture( _texture, std::move( _pendingTexture->mips ) );
+			_pendingTexture.reset();
 		}
 	}
 
-	throw std::runtime_error("Failed to find supported format!");
+	// Frames up to (frame - MAX_FRAMES_IN_FLIGHT) have completed on GPU, later ones may have too
+	_deletionQueue.collect({
+		.graphics = _graphicsTimeline.getCompleted(),
+		.compute = _hasAsyncCompute ? _computeTimeline.getCompleted() : 0,
+	});
+}
+
+// Camera and settings at the given scene time. Settings are the ones the last frame rendered with, so
+// this is only called while no frame is being drawn
+FrameState VulkanEngine::getFrameState( float time ) {
+
+	FrameState state {
+		.time = time,
+		.flags = ( _depthPrepass ? FRAME_DEPTH_PREPASS : 0u ) |
+				 ( isPostEffectEnabled( PostEffect::Bloom ) ? 0u : FRAME_BLOOM_OFF ) |
+				 ( isPostEffectEnabled( PostEffect::Tonemap ) ? 0u : FRAME_TONEMAP_OFF ) |
+				 ( isPostEffectEnabled( PostEffect::Fxaa ) ? 0u : FRAME_FXAA_OFF ) |
+				 ( _occlusionCulling ? 0u : FRAME_OCCLUSION_CULLING_OFF ),
+		.maxAnisotropy = _maxAnisotropy,
+	};
+
+	animateCamera( state );
+
+	return state;
+}
+
+// Depends on the scene time only, so it's safe to call while another thread draws
+void VulkanEngine::animateCamera( FrameState& state ) const {
+
+	state.eyePos = glm::vec3(1.0f, 1.0f, 1.0f) * (24 + abs(sin(state.time)) * 4);
+	state.targetPos = glm::vec3(0.0f, 0.0f, 12.0f);
 }
 
-void VulkanEngine::drawFrame() {
+void VulkanEngine::drawFrame( const FrameState& state ) {
+
+	// Settings are part of the state, so replays render with the captured ones
+	setDepthPrepass( state.flags & FRAME_DEPTH_PREPASS );
+	setPostEffect( PostEffect::Bloom, !( state.flags & FRAME_BLOOM_OFF ) );
+	setPostEffect( PostEffect::Tonemap, !( state.flags & FRAME_TONEMAP_OFF ) );
+	setPostEffect( PostEffect::Fxaa, !( state.flags & FRAME_FXAA_OFF ) );
+	setOcclusionCulling( !( state.flags & FRAME_OCCLUSION_CULLING_OFF ) );
+	setMaxAnisotropy( state.maxAnisotropy );
+
+	// Wait for the frame which used this flight frame before
+	int frame = _currentFrame++;
+	int flightFrame = frame % MAX_FRAMES_IN_FLIGHT;
 
-	// Wait for previous frame to be rendered
-	int flightFrame = _currentFrame++ % MAX_FRAMES_IN_FLIGHT;
+	waitForFrame( frame - MAX_FRAMES_IN_FLIGHT );
 
-	vkWaitForFences( _device, 1, &_inFlightFences[flightFrame], VK_TRUE, UINT64_MAX );
-	vkResetFences( _device, 1, &_inFlightFences[flightFrame] );
+	if ( _hasAsyncCompute ) {
+
+		_computeTimeline.beginFrame( flightFrame );
+	}
+
+	_graphicsTimeline.beginFrame( flightFrame );
+
+	// Sets this flight frame used last time are done with
+	_frameDescriptors[flightFrame].reset();
+
+	finishFrameStats( flightFrame );
+
+	// Swap in hot reloaded resources at the frame boundary
+	applyReloads( frame, flightFrame );
 
 	uint imageIndex;
 
@@ -1493,36 +4393,29 @@ void VulkanEngine::drawFrame() {
 							_imageAvailableSemaphores[flightFrame], VK_NULL_HANDLE, &imageIndex );
 
 	// Record new commands
-	updateUniformBuffer( flightFrame );
-	vkResetCommandBuffer( _commandBuffers[flightFrame], 0 );
-	recordCommandBuffer( _commandBuffers[flightFrame], imageIndex, flightFrame );
+	auto cpuStart = std::chrono::high_resolution_clock::now();
 
-	// Submit command buffer to queue
-	VkSemaphore waitSemaphore[] = { _imageAvailableSemaphores[flightFrame] };
-	VkSemaphore signalSemaphores[] { _renderFinishedSemaphores[flightFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	updateUniformBuffer( frame, state );
+	updateLights( flightFrame, state.time );
+	updateAnimation( flightFrame, state.time );
+	recordFrame( imageIndex, frame );
 
-	VkSubmitInfo submitInfo { 
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = waitSemaphore,
-		.pWaitDstStageMask = waitStages,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &_commandBuffers[flightFrame],
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = signalSemaphores,
-	};
+	// GPU time and image hash are added once the frame has completed
+	if ( _collectFrameStats ) {
 
-	if ( vkQueueSubmit( _graphicsQueue, 1, &submitInfo, _inFlightFences[flightFrame] ) != VK_SUCCESS ) {
+		auto cpuTime = std::chrono::high_resolution_clock::now() - cpuStart;
 
-		throw std::runtime_error("Failed to submit draw command buffer");
+		_pendingStats[flightFrame] = FrameStats {
+			.frame = frame,
+			.cpuTime = std::chrono::duration<double, std::milli>( cpuTime ).count(),
+		};
 	}
 
 	VkSwapchainKHR swapChains[] = { _swapchain };
 	VkPresentInfoKHR presentInfo { 
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = signalSemaphores,
+		.pWaitSemaphores = &_renderFinishedSemaphores[flightFrame],
 		.swapchainCount = 1,
 		.pSwapchains = swapChains,
 		.pImageIndices = &imageIndex,
@@ -1537,28 +4430,113 @@ void VulkanEngine::deviceWaitIdle() {
 	vkDeviceWaitIdle( _device );
 }
 
+// Frame has completed once both queues reached the values its submissions signal
+bool VulkanEngine::isFrameComplete( int frame ) {
+
+	if ( frame < 0 ) {
+		return true;
+	}
+
+	const auto& values = _frameValues[frame % MAX_FRAMES_IN_FLIGHT];
+
+	// Slot only moves on to a later frame once this one was waited for
+	if ( values.frame != frame ) {
+		return values.frame > frame;
+	}
+
+	return _graphicsTimeline.isComplete( values.graphics ) && ( !_hasAsyncCompute || _computeTimeline.isComplete( values.compute ) );
+}
+
+// Point after which a submitted frame's resources are unused, zero once the frame's slot moved on
+TimelinePoint VulkanEngine::getFrameEnd( int frame ) {
+
+	const auto& values = _frameValues[( frame + MAX_FRAMES_IN_FLIGHT ) % MAX_FRAMES_IN_FLIGHT];
+
+	if ( frame < 0 || values.frame != frame ) {
+		return {};
+	}
+
+	return { .graphics = values.graphics, .compute = values.compute };
+}
+
+// Frame must have been submitted already
+void VulkanEngine::waitForFrame( int frame ) {
+
+	if ( isFrameComplete( frame ) ) {
+		return;
+	}
+
+	const auto& values = _frameValues[frame % MAX_FRAMES_IN_FLIGHT];
+
+	_graphicsTimeline.wait( values.graphics );
+
+	if ( _hasAsyncCompute ) {
+
+		_computeTimeline.wait( values.compute );
+	}
+}
+
 void VulkanEngine::release() {
 
-	vkDestroyImageView( _device, _depthImageView, nullptr );
-	vkDestroyImage( _device, _depthImage, nullptr );
-	vkFreeMemory( _device, _depthImageMemory, nullptr );
+	// Reload thread creates Vulkan objects, stop it before anything is destroyed
+	_watcher.stop();
+
+	if ( _pendingShaders.has_value() ) {
+
+		destroyPendingShaders( _pendingShaders.value() );
+		_pendingShaders.reset();
+	}
 
-	vkDestroySampler( _device, _textureSampler, nullptr );
+	_pendingTexture.reset();
 
-	vkDestroyImageView( _device, _textureImageView, nullptr );
+	_deletionQueue.flush();
 
-	vkDestroyImage( _device, _textureImage, nullptr );
-	vkFreeMemory( _device, _textureImageMemory, nullptr );
+	_renderGraph.release();
 
-	for( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+	for ( size_t i = 0; i < _readbackBuffers.size(); i++ ) {
 
-		vkFreeDescriptorSets( _device, _descriptorPool, 1, &_descriptorSets[i] );
+		vkDestroyBuffer( _device, _readbackBuffers[i], nullptr );
+		vkFreeMemory( _device, _readbackMemory[i], nullptr );
 	}
 
-	_descriptorSets.clear();
+	_readbackBuffers.clear();
+	_readbackMemory.clear();
+	_readbackMapped.clear();
+
+	vkDestroyImageView( _device, _shadowImageView, nullptr );
+	vkDestroyImage( _device, _shadowImage, nullptr );
+	vkFreeMemory( _device, _shadowImageMemory, nullptr );
+
+	if ( _shadowFramebuffer != VK_NULL_HANDLE ) {
+
+		vkDestroyFramebuffer( _device, _shadowFramebuffer, nullptr );
+		_shadowFramebuffer = VK_NULL_HANDLE;
+	}
+
+	if ( _hizImage != VK_NULL_HANDLE ) {
+
+		for ( auto view : _hizMipViews ) {
+
+			vkDestroyImageView( _device, view, nullptr );
+		}
+
+		vkDestroyImageView( _device, _hizView, nullptr );
+		vkDestroyImage( _device, _hizImage, nullptr );
+		vkFreeMemory( _device, _hizMemory, nullptr );
+		_hizMipViews.clear();
+		_hizImage = VK_NULL_HANDLE;
+	}
+
+	_samplerCache.release();
+	_textureStreamer.release();
 
-	vkDestroyDescriptorPool( _device, _descriptorPool, nullptr );
-	_descriptorPool = nullptr;
+	for ( auto& allocator : _frameDescriptors ) {
+
+		allocator.release();
+	}
+
+	_frameDescriptors.clear();
+	_descriptorSets.clear();
 
 	for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
 
@@ -1571,7 +4549,54 @@ void VulkanEngine::release() {
 	_uniformBufferMemory.clear();
 	_uniformBufferMapped.clear();
 
-	vkDestroyDescriptorSetLayout( _device, _descriptorSetLayout, nullptr);
+	for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+
+		vkDestroyBuffer( _device, _jointPaletteBuffers[i], nullptr );
+		vkFreeMemory( _device, _jointPaletteMemory[i], nullptr );
+	}
+
+	_jointPaletteBuffers.clear();
+	_jointPaletteMemory.clear();
+	_jointPaletteMapped.clear();
+
+	for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+
+		vkDestroyBuffer( _device, _lightBuffers[i], nullptr );
+		vkFreeMemory( _device, _lightBufferMemory[i], nullptr );
+		vkDestroyBuffer( _device, _lightGridBuffers[i], nullptr );
+		vkFreeMemory( _device, _lightGridMemory[i], nullptr );
+	}
+
+	_lightBuffers.clear();
+	_lightBufferMemory.clear();
+	_lightBufferMapped.clear();
+	_lightGridBuffers.clear();
+	_lightGridMemory.clear();
+
+	if ( _chunkBuffer != VK_NULL_HANDLE ) {
+
+		vkDestroyBuffer( _device, _chunkBuffer, nullptr );
+		vkFreeMemory( _device, _chunkMemory, nullptr );
+		vkDestroyBuffer( _device, _visibilityBuffer, nullptr );
+		vkFreeMemory( _device, _visibilityMemory, nullptr );
+		_chunkBuffer = VK_NULL_HANDLE;
+		_visibilityBuffer = VK_NULL_HANDLE;
+	}
+
+	for ( size_t i = 0; i < _earlyDrawBuffers.size(); i++ ) {
+
+		vkDestroyBuffer( _device, _earlyDrawBuffers[i], nullptr );
+		vkFreeMemory( _device, _earlyDrawMemory[i], nullptr );
+		vkDestroyBuffer( _device, _lateDrawBuffers[i], nullptr );
+		vkFreeMemory( _device, _lateDrawMemory[i], nullptr );
+	}
+
+	_earlyDrawBuffers.clear();
+	_earlyDrawMemory.clear();
+	_lateDrawBuffers.clear();
+	_lateDrawMemory.clear();
+
+	_layoutCache.release();
 	_descriptorSetLayout = nullptr;
 
 	vkDestroyBuffer( _device, _indexBuffer, nullptr );
@@ -1583,6 +4608,12 @@ void VulkanEngine::release() {
 	vkDestroyBuffer( _device, _vertexBuffer, nullptr );
 	_vertexBuffer = nullptr;
 
+	vkDestroyBuffer( _device, _depthVertexBuffer, nullptr );
+	_depthVertexBuffer = nullptr;
+
+	vkFreeMemory( _device, _depthVertexBufferMemory, nullptr );
+	_depthVertexBufferMemory = nullptr;
+
 	vkFreeMemory( _device, _vertexBufferMemory, nullptr );
 	_vertexBufferMemory = nullptr;
 
@@ -1590,31 +4621,79 @@ void VulkanEngine::release() {
 
 		vkDestroySemaphore( _device, _imageAvailableSemaphores[i], nullptr );
 		vkDestroySemaphore( _device, _renderFinishedSemaphores[i], nullptr );
-		vkDestroyFence( _device, _inFlightFences[i], nullptr );
 	}
 
 	_imageAvailableSemaphores.clear();
 	_renderFinishedSemaphores.clear();
-	_inFlightFences.clear();
+
+	_graphicsTimeline.release();
+
+	if ( _hasAsyncCompute ) {
+
+		_computeTimeline.release();
+	}
 
 	vkDestroyCommandPool( _device, _commandPool, nullptr );
 	_commandPool = nullptr;
 
-	for(auto framebuffer : _swapchainFramebuffers) {
+	if ( _mainFramebuffer != VK_NULL_HANDLE ) {
 
-		vkDestroyFramebuffer( _device, framebuffer, nullptr );
+		vkDestroyFramebuffer( _device, _mainFramebuffer, nullptr );
+		_mainFramebuffer = VK_NULL_HANDLE;
 	}
 
-	_swapchainFramebuffers.clear();
-
 	vkDestroyPipeline( _device, _mainGraphicsPipeline, nullptr );
 	_mainGraphicsPipeline = nullptr;
 
+	if ( _depthPrepassPipeline != VK_NULL_HANDLE ) {
+
+		vkDestroyPipeline( _device, _depthPrepassPipeline, nullptr );
+		_depthPrepassPipeline = VK_NULL_HANDLE;
+	}
+
+	vkDestroyPipeline( _device, _shadowPipeline, nullptr );
+	_shadowPipeline = VK_NULL_HANDLE;
+
+	vkDestroyPipeline( _device, _clusterPipeline, nullptr );
+	_clusterPipeline = VK_NULL_HANDLE;
+
+	if ( _cullPipeline != VK_NULL_HANDLE ) {
+
+		vkDestroyPipeline( _device, _cullPipeline, nullptr );
+		vkDestroyPipelineLayout( _device, _cullPipelineLayout, nullptr );
+		_cullPipeline = VK_NULL_HANDLE;
+		_cullPipelineLayout = VK_NULL_HANDLE;
+	}
+
+	destroyPostPipelines( _postPipelines );
+
+	vkDestroyPipelineLayout( _device, _postPipelineLayout, nullptr );
+	_postPipelineLayout = nullptr;
+
+	if ( _postTimestampPool != _timestampPool ) {
+
+		vkDestroyQueryPool( _device, _postTimestampPool, nullptr );
+	}
+
+	_postTimestampPool = nullptr;
+
+	vkDestroyQueryPool( _device, _timestampPool, nullptr );
+	_timestampPool = nullptr;
+
 	vkDestroyPipelineLayout( _device, _pipelineLayout, nullptr );
 	_pipelineLayout = nullptr;
 
-	vkDestroyRenderPass( _device, _renderPass, nullptr );
-	_renderPass = nullptr;
+	if ( _renderPass != VK_NULL_HANDLE ) {
+
+		vkDestroyRenderPass( _device, _renderPass, nullptr );
+		_renderPass = nullptr;
+	}
+
+	if ( _shadowRenderPass != VK_NULL_HANDLE ) {
+
+		vkDestroyRenderPass( _device, _shadowRenderPass, nullptr );
+		_shadowRenderPass = VK_NULL_HANDLE;
+	}
 
 	_mainShader.release();
 
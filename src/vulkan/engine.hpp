@@ -7,25 +7,85 @@
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
+#include <glm/ext/vector_float4.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <vector>
 
+#include "types/post_effects.hpp"
 #include "types/qfamily_indices.hpp"
+#include "types/reload.hpp"
 #include "types/swap_chain_support.hpp"
 #include "types/image_params.hpp"
+#include "types/light.hpp"
+#include "../assets.hpp"
+#include "../bvh.hpp"
+#include "../capture.hpp"
+#include "../file_watcher.hpp"
+#include "../media/compressed_animation.hpp"
 #include "../media/image.hpp"
+#include "cascaded_shadows.hpp"
+#include "deletion_queue.hpp"
+#include "descriptors.hpp"
+#include "mesh_chunks.hpp"
+#include "../media/model.hpp"
+#include "render_graph.hpp"
+#include "sampler_cache.hpp"
 #include "shader.hpp"
+#include "shader_compiler.hpp"
+#include "texture_streamer.hpp"
+#include "timeline_queue.hpp"
 
-using std::vector;
+using std::vector, std::optional, std::string;
 
 extern const bool enableValidationLayers;
 
+// Per-frame measurements, completed once the frame has finished on the GPU
+struct FrameStats {
+	int frame;
+	double cpuTime = 0.0; // update and recording, milliseconds
+	double gpuTime = 0.0;
+	uint64_t imageHash = 0; // zero without readback
+};
+
+// Timeline values a frame's submissions signal on each queue
+struct FrameValues {
+	int frame = -1;
+	uint64_t graphics = 0;
+	uint64_t compute = 0;
+};
+
 class VulkanEngine {
 
 public:
 
+	void setMsaaSamples( VkSampleCountFlagBits samples );
 	void setup(SDL_Window* window);
-	void drawFrame();
+	FrameState getFrameState( float time );
+	void animateCamera( FrameState& state ) const;
+	void drawFrame( const FrameState& state );
+	float getElapsedTime();
+	void setDepthPrepass( bool enabled );
+	bool isDepthPrepassEnabled();
+	bool canDepthPrepass() const;
+	void setMaxAnisotropy( float anisotropy );
+	float getMaxAnisotropy();
+	void setPostEffect( PostEffect effect, bool enabled );
+	bool isPostEffectEnabled( PostEffect effect );
+	void setOcclusionCulling( bool enabled );
+	bool isOcclusionCullingEnabled();
+	bool canCullOcclusion() const;
+	void enableFrameStats( bool withReadback );
+	vector<FrameStats> takeFrameStats();
 	void deviceWaitIdle();
+	bool isFrameComplete( int frame );
+	void waitForFrame( int frame );
+	TimelinePoint getFrameEnd( int frame );
 	bool isSafe();
 	void release();
 
@@ -35,6 +95,11 @@ private:
 	bool checkValidationLayerSupport();
 	void createWindowSurface( SDL_Window* window );
 	void pickPhysicalDevice();
+	void detectDynamicRendering();
+	void detectMemoryBudget();
+	void detectAsyncCompute();
+	void detectOcclusionCulling();
+	void chooseMsaaSamples();
 	bool isSuitableDevice( VkPhysicalDevice device );
 	bool checkDeviceExtensionsSupported( VkPhysicalDevice device );
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat( const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -44,36 +109,98 @@ private:
 	void createSwapChain();
 	void createSwapChainImageViews();
 	void createRenderPass();
+	void createShadowRenderPass();
 	void createRenderPipeline();
+	Shader loadMainShader( bool fromLooseFiles );
+	VkPipeline createMainPipeline( Shader& shader, bool afterDepthPrepass );
+	VkShaderModule loadShaderModule( const char *binaryPath, const char *sourcePath, ShaderStage stage, bool fromLooseFiles );
+	VkPipeline createDepthOnlyPipeline( VkShaderModule vertShader, bool isShadowCaster );
+	VkPipeline createClusterPipeline( VkShaderModule compShader );
+	void createCullPipelineLayout();
+	VkPipeline createCullPipeline( VkShaderModule compShader );
+	void createPostPipelineLayout();
+	PostPipelines createPostPipelines( bool fromLooseFiles );
+	void destroyPostPipelines( PostPipelines& pipelines );
 	void createFramebuffers();
 	void createCommandPool();
-	void createCommandBuffers();
-	void recordCommandBuffer( VkCommandBuffer commandBuffer, uint imageIndex, int flightFrame );
+	void createQueues();
+	void recordFrame( uint imageIndex, int frame );
+	void submitBatch( size_t batchIndex, VkCommandBuffer commandBuffer, bool isLastGraphicsBatch );
+	void recordDepthPrepass( VkCommandBuffer commandBuffer, bool isLatePhase );
+	void recordCulledDraws( VkCommandBuffer commandBuffer, bool isLatePhase );
+	bool isOcclusionCullingActive();
+	void createCullBuffers( VkCommandBuffer commandBuffer, const vector<MeshChunk>& chunks );
+	void createHizResources();
+	void recordOcclusionCull( VkCommandBuffer commandBuffer, bool isLatePhase );
+	void recordHizBuild( VkCommandBuffer commandBuffer );
+	void createShadowResources();
+	void recordShadowPass( VkCommandBuffer commandBuffer );
+	void recordLightClustering( VkCommandBuffer commandBuffer );
+	void recordMainPass( VkCommandBuffer commandBuffer );
+	void beginDynamicRendering( VkCommandBuffer commandBuffer, VkClearValue colorClear, VkClearValue depthClear );
+	void createRenderGraph();
+	void buildRenderGraph();
+	void rebuildRenderGraph();
+	void buildPostChain();
+	VkExtent2D getBloomExtent( int level );
+	void recordPostDispatch( VkCommandBuffer commandBuffer, PostShader shader, RenderGraphImage input,
+							 RenderGraphImage secondInput, RenderGraphImage output, VkExtent2D extent, glm::vec4 params );
+	void recordPostDispatch( VkCommandBuffer commandBuffer, PostShader shader, VkImageView input, VkImageView secondInput,
+							 VkImageLayout inputLayout, VkSampler sampler, VkImageView output, VkExtent2D extent, glm::vec4 params );
+	void writePostTimestamp( VkCommandBuffer commandBuffer, PostEffect effect, bool isEnd );
+	void recordBloomDownsample( VkCommandBuffer commandBuffer, int level );
+	void recordBloomUpsample( VkCommandBuffer commandBuffer, int level );
+	void recordTonemap( VkCommandBuffer commandBuffer );
+	void recordFxaa( VkCommandBuffer commandBuffer );
+	void recordPresentBlit( VkCommandBuffer commandBuffer, RenderGraphImage source );
 	void createSyncObjects();
-	void createBuffer( VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memProps, VkBuffer &buffer, VkDeviceMemory &bufferMemory );
-	void copyBuffer( VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size );
+	void createTimestampQueries();
+	double readGpuTimings( int flightFrame );
+	void finishFrameStats( int flightFrame );
+	VkDeviceSize getReadbackSize();
+	void recordReadback( VkCommandBuffer commandBuffer );
+	void resetGpuTimings();
+	void createBuffer( VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memProps, VkBuffer &buffer, VkDeviceMemory &bufferMemory,
+					   bool isSharedByQueues = false );
+	void recordCopyBuffer( VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size );
 	void createDescriptorSetlayout();
 	void createUniformBuffer();
-	void updateUniformBuffer( int flightFrame );
-	void createDescriptorPool();
-	void allocDescriptorSets();
-	void createTextureImage( Image image );
-	void createTextureImageView();
+	void updateUniformBuffer( int frame, const FrameState& state );
+	void createJointPaletteBuffers();
+	void updateAnimation( int flightFrame, float time );
+	void createLightBuffers();
+	void updateLights( int flightFrame, float time );
+	void createDescriptorAllocators();
+	void writeFrameDescriptors( int flightFrame );
 	void copyBufferToImage( VkBuffer buffer, VkImage image, uint width, uint height);
+	void recordCopyBufferToImage( VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint width, uint height );
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands( VkCommandBuffer commandBuffer );
 	uint findMemoryType(uint typeFilter, VkMemoryPropertyFlags props);
-	void createImage( uint width, uint height, ImageParams parameters, VkImage& image, VkDeviceMemory& imageMemory );
+	void createImage( uint width, uint height, ImageParams parameters, VkImage& image, VkDeviceMemory& imageMemory, uint mipLevels = 1 );
 	void transitionImageLayout( VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout );
-	VkResult createImageView( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageView* pView );
+	void recordLayoutTransition( VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout );
+	void recordBarriers( VkCommandBuffer commandBuffer, const vector<VkImageMemoryBarrier2KHR>& barriers,
+						 const vector<VkBufferMemoryBarrier2KHR>& bufferBarriers );
+	VkResult createImageView( VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageView* pView,
+							  uint baseMip = 0, uint mipCount = 1 );
+	void createSamplerCache();
 	void createTextureSampler();
-	void createDepthResources();
 	VkFormat findSupportedFormat(const vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat findDepthFormat();
+	VkFormat findShadowFormat();
 	void loadModel();
+	void startHotReload();
+	void onAssetChanged( const string& path );
+	void reloadShaders();
+	void destroyPendingShaders( PendingShaders& shaders );
+	void reloadTexture();
+	void applyReloads( int frame, int flightFrame );
 
 private:
 
+	Assets _assets;
+	std::unique_ptr<ShaderCompiler> _shaderCompiler;
 	Shader _mainShader;
 	VkInstance _instance = VK_NULL_HANDLE;
 	VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
@@ -86,34 +213,152 @@ private:
 	vector<VkImage> _swapchainImages;
 	vector<VkImageView> _swapchainImageViews;
 	VkFormat _swapchainImageFormat;
+	bool _isSwapchainSrgb = false; // post chain then leaves encoding to the swapchain
 	VkExtent2D _swapchainExtent;
 	VkPipelineLayout _pipelineLayout;
-	VkRenderPass _renderPass;
+	VkRenderPass _renderPass = VK_NULL_HANDLE;
+	bool _hasDynamicRendering = false;
+	bool _hasSynchronization2 = false;
+	bool _hasMemoryBudget = false;
+	PFN_vkCmdBeginRenderingKHR _cmdBeginRendering = nullptr;
+	PFN_vkCmdEndRenderingKHR _cmdEndRendering = nullptr;
+	PFN_vkCmdPipelineBarrier2KHR _cmdPipelineBarrier2 = nullptr;
 	VkPipeline _mainGraphicsPipeline;
-	vector<VkFramebuffer> _swapchainFramebuffers;
+	VkPipeline _depthPrepassPipeline = VK_NULL_HANDLE;
+	std::atomic<bool> _depthPrepass = false; // read by the reload thread to tag the pipelines it builds
+	VkPipeline _shadowPipeline = VK_NULL_HANDLE;
+	VkRenderPass _shadowRenderPass = VK_NULL_HANDLE;
+	VkFramebuffer _shadowFramebuffer = VK_NULL_HANDLE;
+	VkPipeline _clusterPipeline = VK_NULL_HANDLE;
+	bool _canCullOcclusion = false; // needs the depth pre-pass, a sampleable depth format without stencil and, with MSAA, a max depth resolve
+	bool _occlusionCulling = true;
+	uint _maxDrawIndirectCount = 1;
+	VkDescriptorSetLayout _cullSetLayout;
+	VkPipelineLayout _cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline _cullPipeline = VK_NULL_HANDLE;
+	VkFramebuffer _mainFramebuffer = VK_NULL_HANDLE;
+	VkDescriptorSetLayout _postSetLayout;
+	VkPipelineLayout _postPipelineLayout = VK_NULL_HANDLE;
+	PostPipelines _postPipelines {};
+	VkSampler _postSampler;
+	bool _postEffects[POST_EFFECT_COUNT] = { true, true, true };
 	VkCommandPool _commandPool;
-	vector<VkCommandBuffer> _commandBuffers;
+	VkQueue _computeQueue = VK_NULL_HANDLE;
+	optional<uint> _computeFamily;
+	bool _hasAsyncCompute = false; // separate compute family, otherwise async passes run on the graphics queue
+	TimelineQueue _graphicsTimeline;
+	TimelineQueue _computeTimeline;
+	vector<uint64_t> _batchValues;			// timeline value each render graph batch signals this frame
+	vector<uint64_t> _previousBatchValues;
+	vector<FrameValues> _frameValues;		// per frame in flight
 	vector<VkSemaphore> _imageAvailableSemaphores;
 	vector<VkSemaphore> _renderFinishedSemaphores;
-	vector<VkFence> _inFlightFences;
+	VkQueryPool _timestampPool;
+	VkQueryPool _postTimestampPool = VK_NULL_HANDLE; // the timestamp pool, or one of the compute queue
+	vector<bool> _timestampsWritten;
+	float _timestampPeriod;
+	double _gpuTimeSum = 0.0;
+	int _gpuTimeSamples = 0;
+	vector<uint> _postTimestampsWritten; // bit per post effect
+	double _postTimeSums[POST_EFFECT_COUNT] = {};
+	int _postTimeSamples[POST_EFFECT_COUNT] = {};
+	bool _collectFrameStats = false;
+	vector<optional<FrameStats>> _pendingStats;
+	vector<FrameStats> _frameStats;
+	bool _canReadback = false;
+	bool _frameReadback = false;
+	vector<bool> _readbackWritten;
+	vector<VkBuffer> _readbackBuffers;
+	vector<VkDeviceMemory> _readbackMemory;
+	vector<void*> _readbackMapped;
 	VkBuffer _vertexBuffer;
 	VkDeviceMemory _vertexBufferMemory;
+	VkBuffer _depthVertexBuffer;
+	VkDeviceMemory _depthVertexBufferMemory;
 	VkBuffer _indexBuffer;
 	VkDeviceMemory _indexBufferMemory;
+	uint _chunkCount = 0;
+	VkBuffer _chunkBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory _chunkMemory;
+	VkBuffer _visibilityBuffer = VK_NULL_HANDLE; // chunk visible last frame, written by the late cull
+	VkDeviceMemory _visibilityMemory;
+	vector<VkBuffer> _earlyDrawBuffers;		 // indirect commands per chunk, per frame in flight
+	vector<VkDeviceMemory> _earlyDrawMemory;
+	vector<VkBuffer> _lateDrawBuffers;
+	vector<VkDeviceMemory> _lateDrawMemory;
 	VkDescriptorSetLayout _descriptorSetLayout;
 	vector<VkBuffer> _uniformBuffers; // TODO: create buffer for each flight frame
 	vector<VkDeviceMemory> _uniformBufferMemory;
 	vector<void*> _uniformBufferMapped;
-	VkDescriptorPool _descriptorPool;
-	vector<VkDescriptorSet> _descriptorSets;
-	VkImage _textureImage;
-	VkImageView _textureImageView;
-	VkDeviceMemory _textureImageMemory;
+	vector<VkBuffer> _jointPaletteBuffers;
+	vector<VkDeviceMemory> _jointPaletteMemory;
+	vector<void*> _jointPaletteMapped;
+	vector<VkBuffer> _lightBuffers;
+	vector<VkDeviceMemory> _lightBufferMemory;
+	vector<void*> _lightBufferMapped;
+	vector<Light> _sceneLights;	// every light, the buffer only gets those in view
+	vector<Aabb> _lightBounds;
+	Bvh _lightBvh;
+	float _lightBvhBuildCost = 0.f;
+	glm::mat4 _cameraViewProj;
+	vector<VkBuffer> _lightGridBuffers;
+	vector<VkDeviceMemory> _lightGridMemory;
+	DescriptorLayoutCache _layoutCache;
+	vector<DescriptorAllocator> _frameDescriptors;
+	DescriptorWriter _descriptorWriter;
+	vector<VkDescriptorSet> _descriptorSets; // allocated every frame from its flight frame's allocator
+	TextureStreamer _textureStreamer;
+	StreamedTexture _texture;
+	SamplerCache _samplerCache;
+	TextureSampling _textureSampling;
+	float _maxAnisotropy = 1.f;
+	float _deviceMaxAnisotropy = 1.f;
 	VkSampler _textureSampler;
-	VkImage _depthImage;
-	VkImageView _depthImageView;
-	VkDeviceMemory _depthImageMemory;
+	VkFormat _depthFormat;
+	VkFormat _shadowFormat;
+	VkImage _shadowImage;
+	VkImageView _shadowImageView;
+	VkDeviceMemory _shadowImageMemory;
+	VkSampler _shadowSampler;
+	CascadedShadows _shadows;
+	VkImage _hizImage = VK_NULL_HANDLE;
+	VkDeviceMemory _hizMemory;
+	VkImageView _hizView;			// all levels, sampled by the late cull
+	vector<VkImageView> _hizMipViews; // one per level, written by the reduction
+	VkExtent2D _hizExtent;
+	VkSampler _hizSampler;
+	BoundingSphere _modelBounds;
+	BoundingSphere _modelWorldBounds;
+	VkSampleCountFlagBits _requestedMsaaSamples = VK_SAMPLE_COUNT_4_BIT; // clamped to what color and depth both support
+	VkSampleCountFlagBits _msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	RenderGraph _renderGraph;
+	RenderGraphImage _swapchainTarget;
+	RenderGraphImage _depthTarget;
+	RenderGraphImage _msaaColorTarget;
+	RenderGraphImage _hdrTarget;
+	vector<RenderGraphImage> _bloomTargets; // finest first
+	RenderGraphImage _tonemapTarget;
+	RenderGraphImage _fxaaTarget;
+	RenderGraphImage _shadowTarget;
+	RenderGraphBuffer _lightGridTarget;
+	RenderGraphImage _hizDepthTarget;	// single sample depth the pyramid is built from
+	RenderGraphBuffer _visibilityTarget;
+	RenderGraphBuffer _earlyDrawTarget;
+	RenderGraphBuffer _lateDrawTarget;
+	uint _imageIndex;  // frame being recorded, read by render graph passes
+	int _flightFrame;
 	int _numberOfIndices;
 	bool _safe = false;
 	int _currentFrame = 0;
+	std::chrono::high_resolution_clock::time_point _startTime;
+	Skeleton _skeleton;
+	vector<CompressedClip> _animationClips;
+	vector<AnimationInstance> _animationInstances;
+	string _texturePath;
+	FileWatcher _watcher;
+	std::mutex _reloadMutex;
+	optional<PendingShaders> _pendingShaders;
+	optional<PendingTexture> _pendingTexture;
+	DeletionQueue _deletionQueue;
+	uint64_t _uploadValue = 0; // graphics timeline value of the model uploads, until the first frame waited for it
 };
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "mesh_chunks.hpp"
+
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+
+#include "../parallel.hpp"
+
+// Sphere is centered on the chunk's box, which is close enough to the minimal one for index order chunks
+vector<MeshChunk> buildMeshChunks( const vector<glm::vec3>& positions, const vector<int>& indices, const vector<float>& displacements ) {
+
+	vector<MeshChunk> chunks;
+	uint chunkIndices = CHUNK_TRIANGLES * 3;
+
+	for ( size_t first = 0; first < indices.size(); first += chunkIndices ) {
+
+		uint count = std::min<size_t>( chunkIndices, indices.size() - first );
+
+		glm::vec3 min = positions[indices[first]];
+		glm::vec3 max = min;
+
+		for ( size_t i = first; i < first + count; i++ ) {
+
+			min = glm::min( min, positions[indices[i]] );
+			max = glm::max( max, positions[indices[i]] );
+		}
+
+		glm::vec3 center = ( min + max ) * 0.5f;
+		float radius = 0.f;
+
+		for ( size_t i = first; i < first + count; i++ ) {
+
+			float displacement = displacements.empty() ? 0.f : displacements[indices[i]];
+
+			radius = std::max( radius, glm::distance( center, positions[indices[i]] ) + displacement );
+		}
+
+		chunks.push_back( MeshChunk {
+			.sphere = glm::vec4( center, radius ),
+			.firstIndex = static_cast<uint>( first ),
+			.indexCount = count,
+		});
+	}
+
+	return chunks;
+}
+
+// Vertices are skinned on the CPU the way the vertex shaders do, against every sampled palette
+vector<float> measureSkinnedDisplacements( const vector<glm::vec3>& positions, const vector<glm::u8vec4>& jointIndices,
+										   const vector<glm::u8vec4>& jointWeights, const Skeleton& skeleton,
+										   const vector<CompressedClip>& clips ) {
+
+	size_t jointCount = skeleton.size();
+
+	if ( jointCount == 0 ) {
+		return vector<float>( positions.size(), 0.f );
+	}
+
+	vector<glm::mat4> palettes( jointCount );
+	vector<glm::mat4> globalTransforms;
+
+	computeSkinningPalette( skeleton, skeleton.bindPose, globalTransforms, palettes.data() );
+
+	for ( const auto& clip : clips ) {
+
+		ClipSampler sampler;
+		Pose pose = skeleton.bindPose;
+
+		// Clips loop, so the end pose is the first one again
+		for ( uint i = 0; i < SKINNED_BOUNDS_SAMPLES; i++ ) {
+
+			sampler.sample( clip, skeleton, clip.duration * i / SKINNED_BOUNDS_SAMPLES, pose );
+
+			palettes.resize( palettes.size() + jointCount );
+			computeSkinningPalette( skeleton, pose, globalTransforms, palettes.data() + palettes.size() - jointCount );
+		}
+	}
+
+	size_t paletteCount = palettes.size() / jointCount;
+	vector<float> displacements( positions.size(), 0.f );
+
+	parallelFor( positions.size(), 256, [&] ( size_t begin, size_t end ) {
+
+		for ( size_t i = begin; i < end; i++ ) {
+
+			glm::vec4 weights = glm::vec4( jointWeights[i] ) / 255.f;
+
+			// Unweighted vertices aren't skinned
+			if ( weights.x + weights.y + weights.z + weights.w <= 0.f ) {
+				continue;
+			}
+
+			glm::vec4 position = glm::vec4( positions[i], 1.f );
+
+			for ( size_t palette = 0; palette < paletteCount; palette++ ) {
+
+				const glm::mat4* joints = palettes.data() + palette * jointCount;
+				glm::mat4 skin = weights.x * joints[jointIndices[i].x] + weights.y * joints[jointIndices[i].y] +
+								 weights.z * joints[jointIndices[i].z] + weights.w * joints[jointIndices[i].w];
+
+				displacements[i] = std::max( displacements[i], glm::distance( glm::vec3( skin * position ), positions[i] ) );
+			}
+		}
+	});
+
+	return displacements;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
+
+#include <sys/types.h>
+#include <vector>
+
+#include "../media/animation.hpp"
+#include "../media/compressed_animation.hpp"
+
+using std::vector;
+
+// Triangles per chunk, the unit occlusion culling draws or skips
+const uint CHUNK_TRIANGLES = 64;
+
+// std430 layout, matches the Chunk struct in occlusion_cull.comp
+struct MeshChunk {
+	glm::vec4 sphere;	// model space center, w is the radius
+	uint firstIndex;
+	uint indexCount;
+	uint padding[2];
+};
+
+// Poses sampled per clip when measuring how far skinned vertices move
+const uint SKINNED_BOUNDS_SAMPLES = 64;
+
+// Splits the index list into runs of CHUNK_TRIANGLES triangles, each bounded by a sphere around its vertices.
+// Every vertex grows the sphere by its displacement, so skinned vertices may leave their bind pose by that
+// much. Displacements may be empty for static meshes
+vector<MeshChunk> buildMeshChunks( const vector<glm::vec3>& positions, const vector<int>& indices, const vector<float>& displacements );
+
+// Farthest each vertex gets from its bind position in the bind pose and in SKINNED_BOUNDS_SAMPLES poses evenly
+// spread over every clip. Poses between samples are assumed to stay within the sampled ones
+vector<float> measureSkinnedDisplacements( const vector<glm::vec3>& positions, const vector<glm::u8vec4>& jointIndices,
+										   const vector<glm::u8vec4>& jointWeights, const Skeleton& skeleton,
+										   const vector<CompressedClip>& clips );
@@ -0,0 +1,978 @@
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+static bool isWrite( ImageUsage usage ) {
+
+	return usage == ImageUsage::ColorAttachment ||
+		   usage == ImageUsage::DepthAttachment ||
+		   usage == ImageUsage::DepthResolve ||
+		   usage == ImageUsage::ComputeStorageWrite ||
+		   usage == ImageUsage::TransferDst;
+}
+
+static bool isWrite( BufferUsage usage ) {
+
+	return usage == BufferUsage::ComputeStorageWrite;
+}
+
+static ImageState getUsageState( ImageUsage usage ) {
+
+	switch ( usage ) {
+
+		case ImageUsage::ColorAttachment:
+			return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+					 VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR };
+
+		case ImageUsage::DepthAttachment:
+			return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+					 VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR };
+
+		// Depth resolves run with the color attachment writes at the end of rendering
+		case ImageUsage::DepthResolve:
+			return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+					 VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR };
+
+		case ImageUsage::DepthRead:
+			return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+					 VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR };
+
+		case ImageUsage::FragmentSampled:
+			return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR };
+
+		case ImageUsage::ComputeSampled:
+			return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR };
+
+		case ImageUsage::ComputeStorageRead:
+			return { VK_IMAGE_LAYOUT_GENERAL,
+					 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR };
+
+		case ImageUsage::ComputeStorageWrite:
+			return { VK_IMAGE_LAYOUT_GENERAL,
+					 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR };
+
+		case ImageUsage::TransferSrc:
+			return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+					 VK_ACCESS_2_TRANSFER_READ_BIT_KHR };
+
+		case ImageUsage::TransferDst:
+			return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					 VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+					 VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR };
+	}
+
+	throw std::runtime_error("Render graph: unknown image usage");
+}
+
+static ImageState getUsageState( BufferUsage usage ) {
+
+	switch ( usage ) {
+
+		case BufferUsage::ComputeStorageRead:
+			return { VK_IMAGE_LAYOUT_UNDEFINED,
+					 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR };
+
+		case BufferUsage::ComputeStorageWrite:
+			return { VK_IMAGE_LAYOUT_UNDEFINED,
+					 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR };
+
+		case BufferUsage::FragmentStorageRead:
+			return { VK_IMAGE_LAYOUT_UNDEFINED,
+					 VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+					 VK_ACCESS_2_SHADER_READ_BIT_KHR };
+
+		case BufferUsage::IndirectRead:
+			return { VK_IMAGE_LAYOUT_UNDEFINED,
+					 VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+					 VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR };
+	}
+
+	throw std::runtime_error("Render graph: unknown buffer usage");
+}
+
+
+static bool isLazy( const TransientImageDesc& desc ) {
+
+	return desc.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+}
+
+static bool operator==( const TransientImageDesc& a, const TransientImageDesc& b ) {
+
+	return a.format == b.format &&
+		   a.extent.width == b.extent.width &&
+		   a.extent.height == b.extent.height &&
+		   a.samples == b.samples &&
+		   a.usage == b.usage &&
+		   a.aspect == b.aspect;
+}
+
+static VkImageMemoryBarrier2KHR makeBarrier( VkImageAspectFlags aspect,
+		VkPipelineStageFlags2KHR srcStages, VkAccessFlags2KHR srcAccess, VkImageLayout oldLayout, const ImageState& dst ) {
+
+	return VkImageMemoryBarrier2KHR {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+		.srcStageMask = srcStages,
+		.srcAccessMask = srcAccess,
+		.dstStageMask = dst.stages,
+		.dstAccessMask = dst.access,
+		.oldLayout = oldLayout,
+		.newLayout = dst.layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = VK_NULL_HANDLE,
+		.subresourceRange = { aspect, 0, 1, 0, 1 },
+	};
+}
+
+static VkBufferMemoryBarrier2KHR makeBufferBarrier( VkPipelineStageFlags2KHR srcStages, VkAccessFlags2KHR srcAccess, const ImageState& dst ) {
+
+	return VkBufferMemoryBarrier2KHR {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR,
+		.srcStageMask = srcStages,
+		.srcAccessMask = srcAccess,
+		.dstStageMask = dst.stages,
+		.dstAccessMask = dst.access,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = VK_NULL_HANDLE,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+}
+
+bool RenderGraph::isWriteAccess( const Access& access ) {
+
+	return access.isBuffer ? isWrite( access.bufferUsage ) : isWrite( access.usage );
+}
+
+ImageState RenderGraph::getAccessState( const Access& access ) {
+
+	return access.isBuffer ? getUsageState( access.bufferUsage ) : getUsageState( access.usage );
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read( RenderGraphImage image, ImageUsage usage ) {
+
+	if ( isWrite( usage ) ) {
+
+		throw std::runtime_error("Render graph: write usage declared as read");
+	}
+
+	_graph->_passes[_pass].accesses.push_back({ image, usage, {}, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write( RenderGraphImage image, ImageUsage usage ) {
+
+	if ( !isWrite( usage ) ) {
+
+		throw std::runtime_error("Render graph: read usage declared as write");
+	}
+
+	_graph->_passes[_pass].accesses.push_back({ image, usage, {}, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read( RenderGraphBuffer buffer, BufferUsage usage ) {
+
+	if ( isWrite( usage ) ) {
+
+		throw std::runtime_error("Render graph: write usage declared as read");
+	}
+
+	_graph->_passes[_pass].accesses.push_back({ buffer, {}, usage, true });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write( RenderGraphBuffer buffer, BufferUsage usage ) {
+
+	if ( !isWrite( usage ) ) {
+
+		throw std::runtime_error("Render graph: read usage declared as write");
+	}
+
+	_graph->_passes[_pass].accesses.push_back({ buffer, {}, usage, true });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffects() {
+
+	_graph->_passes[_pass].hasSideEffects = true;
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::asyncCompute() {
+
+	_graph->_passes[_pass].isAsyncCompute = true;
+	return *this;
+}
+
+void RenderGraph::init( VkDevice device, VkPhysicalDevice physicalDevice, BarrierRecorder recordBarriers ) {
+
+	_device = device;
+	_recordBarriers = recordBarriers;
+
+	vkGetPhysicalDeviceMemoryProperties( physicalDevice, &_memoryProperties );
+}
+
+void RenderGraph::setQueueFamilies( uint graphicsFamily, uint computeFamily ) {
+
+	_graphicsFamily = graphicsFamily;
+	_computeFamily = computeFamily;
+}
+
+void RenderGraph::clear() {
+
+	_passes.clear();
+	_resources.clear();
+	_slots.clear();
+	_batches.clear();
+}
+
+RenderGraphImage RenderGraph::importImage( const string& name, VkImageAspectFlags aspect, ImageState initial, ImageState final ) {
+
+	_resources.push_back( Resource {
+		.name = name,
+		.isImported = true,
+		.aspect = aspect,
+		.desc = {},
+		.initial = initial,
+		.final = final,
+	});
+
+	return _resources.size() - 1;
+}
+
+RenderGraphImage RenderGraph::createImage( const string& name, const TransientImageDesc& desc ) {
+
+	_resources.push_back( Resource {
+		.name = name,
+		.isImported = false,
+		.aspect = desc.aspect,
+		.desc = desc,
+		.initial = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR },
+		.final = {},
+	});
+
+	return _resources.size() - 1;
+}
+
+RenderGraphBuffer RenderGraph::importBuffer( const string& name ) {
+
+	_resources.push_back( Resource {
+		.name = name,
+		.isImported = true,
+		.isBuffer = true,
+		.aspect = 0,
+		.desc = {},
+		.initial = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR },
+		.final = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR },
+	});
+
+	return _resources.size() - 1;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass( const string& name, PassRecorder record ) {
+
+	_passes.push_back( Pass { .name = name, .record = record } );
+
+	return PassBuilder( this, _passes.size() - 1 );
+}
+
+void RenderGraph::compile() {
+
+	cullPasses();
+	assignQueues();
+	computeLifetimes();
+	assignMemorySlots();
+	realizeTransients();
+	computeBarriers();
+}
+
+// Walks passes backwards from the graph outputs (imported images and side effects),
+// a pass stays only if a later active pass or an output consumes something it writes
+void RenderGraph::cullPasses() {
+
+	vector<bool> isNeeded( _resources.size(), false );
+
+	for ( size_t i = 0; i < _resources.size(); i++ ) {
+
+		isNeeded[i] = _resources[i].isImported;
+	}
+
+	for ( auto pass = _passes.rbegin(); pass != _passes.rend(); pass++ ) {
+
+		pass->isActive = pass->hasSideEffects || std::any_of( pass->accesses.begin(), pass->accesses.end(),
+			[&isNeeded] ( const Access& access ) { return isWriteAccess( access ) && isNeeded[access.resource]; } );
+
+		if ( !pass->isActive ) {
+			continue;
+		}
+
+		for ( const auto& access : pass->accesses ) {
+
+			if ( !isWriteAccess( access ) ) {
+
+				isNeeded[access.resource] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::assignQueues() {
+
+	for ( auto& pass : _passes ) {
+
+		pass.queue = pass.isAsyncCompute && hasAsyncCompute() ? PassQueue::AsyncCompute : PassQueue::Graphics;
+	}
+}
+
+void RenderGraph::computeLifetimes() {
+
+	for ( size_t pass = 0; pass < _passes.size(); pass++ ) {
+
+		if ( !_passes[pass].isActive ) {
+			continue;
+		}
+
+		for ( const auto& access : _passes[pass].accesses ) {
+
+			auto& resource = _resources[access.resource];
+
+			if ( resource.firstPass < 0 ) {
+
+				resource.firstPass = pass;
+			}
+
+			if ( _passes[resource.firstPass].queue != _passes[pass].queue ) {
+
+				resource.isCrossQueue = true;
+			}
+
+			resource.lastPass = pass;
+		}
+	}
+}
+
+// Interval coloring: a transient reuses the first slot whose previous owner is dead by its first use.
+// Lazily allocated attachments only share slots among themselves, and so do images of one queue.
+// Images used by both queues keep a slot of their own
+void RenderGraph::assignMemorySlots() {
+
+	vector<RenderGraphImage> transients;
+
+	for ( size_t i = 0; i < _resources.size(); i++ ) {
+
+		if ( !_resources[i].isImported && !_resources[i].isBuffer && _resources[i].firstPass >= 0 ) {
+
+			transients.push_back( i );
+		}
+	}
+
+	std::stable_sort( transients.begin(), transients.end(), [this] ( RenderGraphImage a, RenderGraphImage b ) {
+		return _resources[a].firstPass < _resources[b].firstPass;
+	});
+
+	for ( RenderGraphImage image : transients ) {
+
+		auto& resource = _resources[image];
+
+		bool isLazyImage = isLazy( resource.desc );
+		PassQueue queue = _passes[resource.firstPass].queue;
+
+		auto slot = std::find_if( _slots.begin(), _slots.end(), [this, &resource, isLazyImage, queue] ( const MemorySlot& slot ) {
+			return !resource.isCrossQueue && !slot.isExclusive && slot.isLazy == isLazyImage &&
+				   _passes[_resources[slot.images[0]].firstPass].queue == queue && slot.lastPass < resource.firstPass;
+		});
+
+		if ( slot == _slots.end() ) {
+
+			_slots.push_back( MemorySlot { .isLazy = isLazyImage, .isExclusive = resource.isCrossQueue } );
+			slot = _slots.end() - 1;
+		}
+
+		slot->lastPass = resource.lastPass;
+		slot->images.push_back( image );
+		resource.slot = slot - _slots.begin();
+	}
+}
+
+void RenderGraph::realizeTransients() {
+
+	vector<RealizedImage> layout;
+
+	for ( const auto& slot : _slots ) {
+
+		for ( RenderGraphImage image : slot.images ) {
+
+			layout.push_back({ _resources[image].desc, _resources[image].slot, VK_NULL_HANDLE, VK_NULL_HANDLE });
+		}
+	}
+
+	bool isSameLayout = layout.size() == _realized.size() && std::equal( layout.begin(), layout.end(), _realized.begin(),
+		[] ( const RealizedImage& a, const RealizedImage& b ) { return a.desc == b.desc && a.slot == b.slot; } );
+
+	if ( !isSameLayout ) {
+
+		// Only happens when the graph's shape changes, previous frames may still use the old images
+		if ( !_realized.empty() ) {
+
+			vkDeviceWaitIdle( _device );
+		}
+
+		releaseTransients();
+
+		vector<VkMemoryRequirements> requirements;
+
+		for ( auto& realized : layout ) {
+
+			VkImageCreateInfo imageInfo {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+				.flags = 0,
+				.imageType = VK_IMAGE_TYPE_2D,
+				.format = realized.desc.format,
+				.extent = { realized.desc.extent.width, realized.desc.extent.height, 1 },
+				.mipLevels = 1,
+				.arrayLayers = 1,
+				.samples = realized.desc.samples,
+				.tiling = VK_IMAGE_TILING_OPTIMAL,
+				.usage = realized.desc.usage,
+				.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			};
+
+			if ( vkCreateImage( _device, &imageInfo, nullptr, &realized.image ) != VK_SUCCESS ) {
+
+				throw std::runtime_error("Render graph: failed to create transient image");
+			}
+
+			_realized.push_back( realized );
+
+			VkMemoryRequirements memRequirements;
+			vkGetImageMemoryRequirements( _device, realized.image, &memRequirements );
+
+			requirements.push_back( memRequirements );
+		}
+
+		_transientMemory = allocateSlots( false, requirements );
+		_lazyMemory = allocateSlots( true, requirements );
+
+		for ( auto& realized : _realized ) {
+
+			VkDeviceMemory memory = _slots[realized.slot].isLazy ? _lazyMemory : _transientMemory;
+
+			vkBindImageMemory( _device, realized.image, memory, _slots[realized.slot].offset );
+
+			VkImageViewCreateInfo viewInfo {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.image = realized.image,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = realized.desc.format,
+				.subresourceRange = { realized.desc.aspect, 0, 1, 0, 1 },
+			};
+
+			if ( vkCreateImageView( _device, &viewInfo, nullptr, &realized.view ) != VK_SUCCESS ) {
+
+				throw std::runtime_error("Render graph: failed to create transient image view");
+			}
+		}
+	}
+
+	// Realized images are stored in slot order, same as the layout built above
+	size_t index = 0;
+
+	for ( const auto& slot : _slots ) {
+
+		for ( RenderGraphImage image : slot.images ) {
+
+			_resources[image].image = _realized[index].image;
+			_resources[image].view = _realized[index].view;
+			index++;
+		}
+	}
+}
+
+// Slots of one kind are packed one after another in a single allocation. Lazy slots prefer memory
+// which tile-based GPUs never back, the attachment then lives in tile memory only
+VkDeviceMemory RenderGraph::allocateSlots( bool isLazy, const vector<VkMemoryRequirements>& requirements ) {
+
+	uint memoryTypeBits = ~0u;
+	VkDeviceSize allocationSize = 0;
+
+	for ( size_t slot = 0; slot < _slots.size(); slot++ ) {
+
+		if ( _slots[slot].isLazy != isLazy ) {
+			continue;
+		}
+
+		VkDeviceSize size = 0;
+		VkDeviceSize alignment = 1;
+
+		for ( size_t i = 0; i < _realized.size(); i++ ) {
+
+			if ( _realized[i].slot == static_cast<int>( slot ) ) {
+
+				size = std::max( size, requirements[i].size );
+				alignment = std::max( alignment, requirements[i].alignment );
+				memoryTypeBits &= requirements[i].memoryTypeBits;
+			}
+		}
+
+		_slots[slot].offset = ( allocationSize + alignment - 1 ) / alignment * alignment;
+		_slots[slot].size = size;
+		allocationSize = _slots[slot].offset + size;
+	}
+
+	if ( allocationSize == 0 ) {
+
+		return VK_NULL_HANDLE;
+	}
+
+	uint memoryType = _memoryProperties.memoryTypeCount;
+
+	for ( uint i = 0; i < _memoryProperties.memoryTypeCount; i++ ) {
+
+		auto flags = _memoryProperties.memoryTypes[i].propertyFlags;
+
+		if ( !( memoryTypeBits & ( 1 << i ) ) || !( flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ) ) {
+			continue;
+		}
+
+		if ( memoryType == _memoryProperties.memoryTypeCount ) {
+
+			memoryType = i;
+		}
+
+		// Desktop GPUs don't expose lazy memory, the first device local type is used there
+		if ( isLazy && ( flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT ) ) {
+
+			memoryType = i;
+			break;
+		}
+	}
+
+	if ( memoryType == _memoryProperties.memoryTypeCount ) {
+
+		throw std::runtime_error("Render graph: transient images have no common memory type");
+	}
+
+	VkMemoryAllocateInfo allocInfo {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = allocationSize,
+		.memoryTypeIndex = memoryType,
+	};
+
+	VkDeviceMemory memory;
+
+	if ( vkAllocateMemory( _device, &allocInfo, nullptr, &memory ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Render graph: failed to allocate transient memory");
+	}
+
+	return memory;
+}
+
+// Simulates the frame tracking last writer and readers since then for each resource:
+// - writes and layout changes wait for the last writer and all readers since
+// - reads wait only for the last writer, and only when their stages weren't synchronized yet
+// - using a resource last used on the other queue releases it at the end of that queue's batch and
+//   acquires it before the pass, the pass's batch waits for the releasing one
+// Passes join the open batch unless they're on the other queue or need a wait the batch doesn't have,
+// so work before the first dependency on the other queue isn't held back
+void RenderGraph::computeBarriers() {
+
+	struct Tracking {
+		VkImageLayout layout;
+		VkPipelineStageFlags2KHR writeStages;
+		VkAccessFlags2KHR writeAccess;
+		VkPipelineStageFlags2KHR readStages;
+		VkAccessFlags2KHR readAccess;
+		int batch; // last batch using the resource, -1 before its first use in the frame
+	};
+
+	vector<Tracking> tracking;
+
+	for ( const auto& resource : _resources ) {
+
+		tracking.push_back({ resource.initial.layout, resource.initial.stages, resource.initial.access, 0, 0, -1 });
+	}
+
+	// Barrier which starts each transient's lifetime, its source is patched below
+	vector<std::pair<int, int>> firstBarrier( _resources.size(), { -1, -1 } );
+
+	// Previous frame waits are found by pass, batches are only known once the walk is done
+	vector<int> passBatch( _passes.size(), -1 );
+	vector<vector<int>> previousFramePasses;
+
+	auto getFamily = [this] ( PassQueue queue ) { return queue == PassQueue::Graphics ? _graphicsFamily : _computeFamily; };
+
+	for ( size_t passIndex = 0; passIndex < _passes.size(); passIndex++ ) {
+
+		auto& pass = _passes[passIndex];
+
+		pass.barriers.clear();
+		pass.barrierImages.clear();
+		pass.bufferBarriers.clear();
+		pass.barrierBuffers.clear();
+
+		if ( !pass.isActive ) {
+			continue;
+		}
+
+		vector<size_t> waits;
+		vector<int> previousWaits;
+		VkPipelineStageFlags2KHR waitStages = 0;
+
+		for ( const auto& access : pass.accesses ) {
+
+			const auto& state = tracking[access.resource];
+			const auto& resource = _resources[access.resource];
+
+			if ( state.batch >= 0 && _batches[state.batch].queue != pass.queue ) {
+
+				waits.push_back( state.batch );
+				waitStages |= getAccessState( access ).stages;
+
+			} else if ( state.batch < 0 && resource.isCrossQueue && !resource.isBuffer && _passes[resource.lastPass].queue != pass.queue ) {
+
+				previousWaits.push_back( resource.lastPass );
+				waitStages |= getAccessState( access ).stages;
+			}
+		}
+
+		bool canJoin = !_batches.empty() && _batches.back().queue == pass.queue &&
+			std::all_of( waits.begin(), waits.end(), [this] ( size_t wait ) {
+				const auto& batchWaits = _batches.back().waits;
+				return std::find( batchWaits.begin(), batchWaits.end(), wait ) != batchWaits.end();
+			}) &&
+			std::all_of( previousWaits.begin(), previousWaits.end(), [&previousFramePasses] ( int wait ) {
+				const auto& batchWaits = previousFramePasses.back();
+				return std::find( batchWaits.begin(), batchWaits.end(), wait ) != batchWaits.end();
+			});
+
+		if ( !canJoin ) {
+
+			_batches.push_back( Batch { .queue = pass.queue } );
+			previousFramePasses.emplace_back();
+		}
+
+		auto& batch = _batches.back();
+		int batchIndex = _batches.size() - 1;
+
+		for ( size_t wait : waits ) {
+
+			if ( std::find( batch.waits.begin(), batch.waits.end(), wait ) == batch.waits.end() ) {
+
+				batch.waits.push_back( wait );
+			}
+		}
+
+		previousFramePasses.back().insert( previousFramePasses.back().end(), previousWaits.begin(), previousWaits.end() );
+		batch.waitStages |= waitStages;
+		batch.passes.push_back( passIndex );
+		passBatch[passIndex] = batchIndex;
+
+		for ( const auto& access : pass.accesses ) {
+
+			auto& state = tracking[access.resource];
+			auto desired = getAccessState( access );
+			const auto& resource = _resources[access.resource];
+
+			bool isQueueChange = state.batch >= 0 && _batches[state.batch].queue != pass.queue;
+			bool isLayoutChange = state.layout != desired.layout;
+
+			// Semaphore orders the previous frame's use on the other queue, stages of that queue can't be named here
+			if ( state.batch < 0 && resource.isCrossQueue && _passes[resource.lastPass].queue != pass.queue ) {
+
+				state.writeStages = VK_PIPELINE_STAGE_2_NONE_KHR;
+				state.writeAccess = VK_ACCESS_2_NONE_KHR;
+			}
+
+			if ( isQueueChange ) {
+
+				// Release makes writes available on the old queue, acquire makes them visible on the new one
+				auto& oldBatch = _batches[state.batch];
+				uint srcFamily = getFamily( oldBatch.queue );
+				uint dstFamily = getFamily( pass.queue );
+
+				if ( resource.isBuffer ) {
+
+					auto release = makeBufferBarrier( state.writeStages | state.readStages, state.writeAccess,
+													  { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR } );
+					auto acquire = makeBufferBarrier( VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, desired );
+
+					release.srcQueueFamilyIndex = acquire.srcQueueFamilyIndex = srcFamily;
+					release.dstQueueFamilyIndex = acquire.dstQueueFamilyIndex = dstFamily;
+
+					oldBatch.endBufferBarriers.push_back( release );
+					oldBatch.endBarrierBuffers.push_back( access.resource );
+					pass.bufferBarriers.push_back( acquire );
+					pass.barrierBuffers.push_back( access.resource );
+				} else {
+
+					auto release = makeBarrier( resource.aspect, state.writeStages | state.readStages, state.writeAccess, state.layout,
+												{ desired.layout, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR } );
+					auto acquire = makeBarrier( resource.aspect, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, state.layout, desired );
+
+					release.srcQueueFamilyIndex = acquire.srcQueueFamilyIndex = srcFamily;
+					release.dstQueueFamilyIndex = acquire.dstQueueFamilyIndex = dstFamily;
+
+					oldBatch.endBarriers.push_back( release );
+					oldBatch.endBarrierImages.push_back( access.resource );
+					pass.barriers.push_back( acquire );
+					pass.barrierImages.push_back( access.resource );
+				}
+
+				// Later readers in other stages chain on the acquire
+				if ( isWriteAccess( access ) ) {
+
+					state = { desired.layout, desired.stages, desired.access, 0, 0, batchIndex };
+				} else {
+
+					state = { desired.layout, desired.stages, VK_ACCESS_2_NONE_KHR, desired.stages, desired.access, batchIndex };
+				}
+
+				continue;
+			}
+
+			state.batch = batchIndex;
+
+			if ( resource.isBuffer ) {
+
+				// Buffers start every frame unused, the first access needs no barrier
+				bool isSynchronized = !( desired.stages & ~state.readStages ) && !( desired.access & ~state.readAccess );
+
+				if ( ( state.writeStages | state.readStages ) != 0 && ( isWriteAccess( access ) || !isSynchronized ) ) {
+
+					auto srcStages = isWriteAccess( access ) ? state.writeStages | state.readStages : state.writeStages;
+
+					pass.bufferBarriers.push_back( makeBufferBarrier( srcStages, state.writeAccess, desired ) );
+					pass.barrierBuffers.push_back( access.resource );
+				}
+
+				if ( isWriteAccess( access ) ) {
+
+					state = { VK_IMAGE_LAYOUT_UNDEFINED, desired.stages, desired.access, 0, 0, batchIndex };
+				} else {
+
+					state.readStages |= desired.stages;
+					state.readAccess |= desired.access;
+				}
+
+				continue;
+			}
+
+			if ( isWriteAccess( access ) || isLayoutChange ) {
+
+				pass.barriers.push_back( makeBarrier( resource.aspect, state.writeStages | state.readStages, state.writeAccess, state.layout, desired ) );
+				pass.barrierImages.push_back( access.resource );
+
+				if ( isWriteAccess( access ) ) {
+
+					state = { desired.layout, desired.stages, desired.access, 0, 0, batchIndex };
+				} else {
+
+					// Readers in other stages chain on this barrier's destination
+					state = { desired.layout, desired.stages, state.writeAccess, desired.stages, desired.access, batchIndex };
+				}
+
+			} else if ( ( desired.stages & ~state.readStages ) || ( desired.access & ~state.readAccess ) ) {
+
+				pass.barriers.push_back( makeBarrier( resource.aspect, state.writeStages, state.writeAccess, state.layout, desired ) );
+				pass.barrierImages.push_back( access.resource );
+
+				state.readStages |= desired.stages;
+				state.readAccess |= desired.access;
+			} else {
+
+				continue;
+			}
+
+			if ( firstBarrier[access.resource].first < 0 ) {
+
+				firstBarrier[access.resource] = { static_cast<int>( passIndex ), static_cast<int>( pass.barriers.size() ) - 1 };
+			}
+		}
+	}
+
+	for ( size_t i = 0; i < _batches.size(); i++ ) {
+
+		for ( int pass : previousFramePasses[i] ) {
+
+			size_t wait = passBatch[pass];
+
+			if ( std::find( _batches[i].previousFrameWaits.begin(), _batches[i].previousFrameWaits.end(), wait ) == _batches[i].previousFrameWaits.end() ) {
+
+				_batches[i].previousFrameWaits.push_back( wait );
+			}
+		}
+	}
+
+	// Previous owner of a slot is the image before in the slot, the first one waits for the last one of previous frame.
+	// Exclusive slots hold one image, when it was last used on the other queue the batch's semaphore wait orders it
+	for ( const auto& slot : _slots ) {
+
+		for ( size_t i = 0; i < slot.images.size(); i++ ) {
+
+			RenderGraphImage image = slot.images[i];
+			RenderGraphImage previous = slot.images[( i + slot.images.size() - 1 ) % slot.images.size()];
+
+			auto [passIndex, barrierIndex] = firstBarrier[image];
+
+			if ( passIndex < 0 ) {
+				continue;
+			}
+
+			auto& barrier = _passes[passIndex].barriers[barrierIndex];
+
+			bool isFromOtherQueue = _passes[_resources[previous].lastPass].queue != _passes[passIndex].queue;
+
+			barrier.srcStageMask = isFromOtherQueue ? VK_PIPELINE_STAGE_2_NONE_KHR : tracking[previous].writeStages | tracking[previous].readStages;
+			barrier.srcAccessMask = isFromOtherQueue ? VK_ACCESS_2_NONE_KHR : tracking[previous].writeAccess;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+	}
+
+	// Final states are reached in the batch which used the image last
+	for ( size_t i = 0; i < _resources.size(); i++ ) {
+
+		const auto& resource = _resources[i];
+		const auto& state = tracking[i];
+
+		if ( resource.isImported && !resource.isBuffer && state.layout != resource.final.layout && state.batch >= 0 ) {
+
+			_batches[state.batch].endBarriers.push_back( makeBarrier( resource.aspect, state.writeStages | state.readStages, state.writeAccess, state.layout, resource.final ) );
+			_batches[state.batch].endBarrierImages.push_back( i );
+		}
+	}
+}
+
+void RenderGraph::bindImage( RenderGraphImage image, VkImage handle, VkImageView view ) {
+
+	_resources[image].image = handle;
+	_resources[image].view = view;
+}
+
+void RenderGraph::bindBuffer( RenderGraphBuffer buffer, VkBuffer handle ) {
+
+	_resources[buffer].buffer = handle;
+}
+
+void RenderGraph::recordBarriers( VkCommandBuffer commandBuffer,
+		vector<VkImageMemoryBarrier2KHR>& barriers, const vector<RenderGraphImage>& images,
+		vector<VkBufferMemoryBarrier2KHR>& bufferBarriers, const vector<RenderGraphBuffer>& buffers ) {
+
+	if ( barriers.empty() && bufferBarriers.empty() ) {
+		return;
+	}
+
+	for ( size_t i = 0; i < barriers.size(); i++ ) {
+
+		barriers[i].image = _resources[images[i]].image;
+	}
+
+	for ( size_t i = 0; i < bufferBarriers.size(); i++ ) {
+
+		bufferBarriers[i].buffer = _resources[buffers[i]].buffer;
+	}
+
+	_recordBarriers( commandBuffer, barriers, bufferBarriers );
+}
+
+// Batches are recorded and submitted in order, so every batch waited for is already submitted
+void RenderGraph::execute( const BatchBegin& begin, const BatchEnd& end ) {
+
+	for ( size_t batchIndex = 0; batchIndex < _batches.size(); batchIndex++ ) {
+
+		auto& batch = _batches[batchIndex];
+
+		VkCommandBuffer commandBuffer = begin( batchIndex );
+
+		for ( size_t passIndex : batch.passes ) {
+
+			auto& pass = _passes[passIndex];
+
+			recordBarriers( commandBuffer, pass.barriers, pass.barrierImages, pass.bufferBarriers, pass.barrierBuffers );
+
+			pass.record( commandBuffer );
+		}
+
+		recordBarriers( commandBuffer, batch.endBarriers, batch.endBarrierImages, batch.endBufferBarriers, batch.endBarrierBuffers );
+
+		end( batchIndex, commandBuffer );
+	}
+}
+
+VkImage RenderGraph::getImage( RenderGraphImage image ) const {
+
+	return _resources[image].image;
+}
+
+VkImageView RenderGraph::getImageView( RenderGraphImage image ) const {
+
+	return _resources[image].view;
+}
+
+VkBuffer RenderGraph::getBuffer( RenderGraphBuffer buffer ) const {
+
+	return _resources[buffer].buffer;
+}
+
+bool RenderGraph::isPassActive( const string& name ) const {
+
+	return std::any_of( _passes.begin(), _passes.end(),
+		[&name] ( const Pass& pass ) { return pass.name == name && pass.isActive; } );
+}
+
+bool RenderGraph::hasAsyncCompute() const {
+
+	return _computeFamily != _graphicsFamily;
+}
+
+const vector<RenderGraph::Batch>& RenderGraph::getBatches() const {
+
+	return _batches;
+}
+
+void RenderGraph::releaseTransients() {
+
+	for ( const auto& realized : _realized ) {
+
+		vkDestroyImageView( _device, realized.view, nullptr );
+		vkDestroyImage( _device, realized.image, nullptr );
+	}
+
+	_realized.clear();
+
+	if ( _transientMemory != VK_NULL_HANDLE ) {
+
+		vkFreeMemory( _device, _transientMemory, nullptr );
+		_transientMemory = VK_NULL_HANDLE;
+	}
+
+	if ( _lazyMemory != VK_NULL_HANDLE ) {
+
+		vkFreeMemory( _device, _lazyMemory, nullptr );
+		_lazyMemory = VK_NULL_HANDLE;
+	}
+}
+
+void RenderGraph::release() {
+
+	releaseTransients();
+	clear();
+}
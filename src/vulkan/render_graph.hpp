@@ -0,0 +1,231 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::vector, std::string;
+
+// How a pass touches an image, each usage maps to a fixed layout, stages and access
+enum class ImageUsage {
+	ColorAttachment,
+	DepthAttachment,
+	DepthResolve,
+	DepthRead,
+	FragmentSampled,
+	ComputeSampled,
+	ComputeStorageRead,
+	ComputeStorageWrite,
+	TransferSrc,
+	TransferDst,
+};
+
+// Buffers have no layout, usages only decide stages and access
+enum class BufferUsage {
+	ComputeStorageRead,
+	ComputeStorageWrite,
+	FragmentStorageRead,
+	IndirectRead,
+};
+
+// Async compute passes are submitted to the compute queue when the device has a separate one
+enum class PassQueue {
+	Graphics,
+	AsyncCompute,
+};
+
+struct ImageState {
+	VkImageLayout layout;
+	VkPipelineStageFlags2KHR stages;
+	VkAccessFlags2KHR access;
+};
+
+// Images with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT are placed in lazily allocated memory when the
+// device has it, their contents must not outlive the pass (store op DONT_CARE)
+struct TransientImageDesc {
+	VkFormat format;
+	VkExtent2D extent;
+	VkSampleCountFlagBits samples;
+	VkImageUsageFlags usage;
+	VkImageAspectFlags aspect;
+};
+
+using RenderGraphImage = int;
+using RenderGraphBuffer = int;
+using BarrierRecorder = std::function<void( VkCommandBuffer, const vector<VkImageMemoryBarrier2KHR>&, const vector<VkBufferMemoryBarrier2KHR>& )>;
+using PassRecorder = std::function<void( VkCommandBuffer )>;
+
+// Frame graph built once and executed every frame. Passes declare image and buffer reads and writes,
+// compile() culls passes whose results are never used, precomputes batched barriers between passes and
+// places transient images with disjoint lifetimes into the same memory.
+// Passes execute in declaration order, a resource may be used at most once per pass.
+// With async compute the frame is split into batches, runs of passes submitted to one queue. A batch
+// waits for the other queue's batches it depends on, and resources moving between queue families
+// get release and acquire barriers
+class RenderGraph {
+
+	struct Access {
+		int resource;
+		ImageUsage usage;
+		BufferUsage bufferUsage;
+		bool isBuffer;
+	};
+
+	struct Pass {
+		string name;
+		PassRecorder record;
+		vector<Access> accesses;
+		bool hasSideEffects = false;
+		bool isAsyncCompute = false;
+		bool isActive = false;
+		PassQueue queue = PassQueue::Graphics;
+		vector<VkImageMemoryBarrier2KHR> barriers; // handles are filled at execution
+		vector<RenderGraphImage> barrierImages;
+		vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+		vector<RenderGraphBuffer> barrierBuffers;
+	};
+
+public:
+
+	// Batches waited for are earlier in the frame, or the previous frame's when resources cross queues
+	// between frames. Timeline values of both frames' batches are kept by the caller
+	struct Batch {
+		PassQueue queue;
+		vector<size_t> passes;
+		vector<size_t> waits;
+		vector<size_t> previousFrameWaits;
+		VkPipelineStageFlags2KHR waitStages = 0;
+		vector<VkImageMemoryBarrier2KHR> endBarriers; // queue releases and final states
+		vector<RenderGraphImage> endBarrierImages;
+		vector<VkBufferMemoryBarrier2KHR> endBufferBarriers;
+		vector<RenderGraphBuffer> endBarrierBuffers;
+	};
+
+	// Returns the started command buffer a batch is recorded into
+	using BatchBegin = std::function<VkCommandBuffer( size_t batch )>;
+	// Ends and submits a recorded batch
+	using BatchEnd = std::function<void( size_t batch, VkCommandBuffer commandBuffer )>;
+
+	class PassBuilder {
+
+	public:
+
+		PassBuilder( RenderGraph *graph, size_t pass ) : _graph(graph), _pass(pass) {}
+
+		PassBuilder& read( RenderGraphImage image, ImageUsage usage );
+		PassBuilder& write( RenderGraphImage image, ImageUsage usage );
+		PassBuilder& read( RenderGraphBuffer buffer, BufferUsage usage );
+		PassBuilder& write( RenderGraphBuffer buffer, BufferUsage usage );
+
+		// Pass is kept even if nothing reads its results, e.g. it writes untracked buffers
+		PassBuilder& sideEffects();
+
+		// Compute only pass which may overlap graphics work on the async compute queue
+		PassBuilder& asyncCompute();
+
+	private:
+
+		RenderGraph *_graph;
+		size_t _pass;
+	};
+
+	void init( VkDevice device, VkPhysicalDevice physicalDevice, BarrierRecorder recordBarriers );
+
+	// Without a separate compute family, async compute passes run on the graphics queue
+	void setQueueFamilies( uint graphicsFamily, uint computeFamily );
+
+	// Drops passes and resources, realized transient memory is kept for the next compile()
+	void clear();
+
+	// External image, its handle is bound every frame. Graph moves it from initial to final state
+	RenderGraphImage importImage( const string& name, VkImageAspectFlags aspect, ImageState initial, ImageState final );
+	RenderGraphImage createImage( const string& name, const TransientImageDesc& desc );
+
+	// External buffer bound every frame, its contents don't carry over between frames
+	RenderGraphBuffer importBuffer( const string& name );
+	PassBuilder addPass( const string& name, PassRecorder record );
+
+	void compile();
+
+	void bindImage( RenderGraphImage image, VkImage handle, VkImageView view );
+	void bindBuffer( RenderGraphBuffer buffer, VkBuffer handle );
+	void execute( const BatchBegin& begin, const BatchEnd& end );
+
+	VkImage getImage( RenderGraphImage image ) const;
+	VkImageView getImageView( RenderGraphImage image ) const;
+	VkBuffer getBuffer( RenderGraphBuffer buffer ) const;
+	bool isPassActive( const string& name ) const;
+	bool hasAsyncCompute() const;
+	const vector<Batch>& getBatches() const;
+
+	void release();
+
+private:
+
+	struct Resource {
+		string name;
+		bool isImported;
+		bool isBuffer = false;
+		VkImageAspectFlags aspect;
+		TransientImageDesc desc;
+		ImageState initial;
+		ImageState final;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		int firstPass = -1;
+		int lastPass = -1;
+		bool isCrossQueue = false; // used by passes on both queues
+		int slot = -1;
+	};
+
+	struct MemorySlot {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		int lastPass;
+		bool isLazy;
+		bool isExclusive; // holds a cross queue image, aliasing it would need waits between queues
+		vector<RenderGraphImage> images; // in order of first use
+	};
+
+	static bool isWriteAccess( const Access& access );
+	static ImageState getAccessState( const Access& access );
+
+	void cullPasses();
+	void assignQueues();
+	void computeLifetimes();
+	void assignMemorySlots();
+	void realizeTransients();
+	VkDeviceMemory allocateSlots( bool isLazy, const vector<VkMemoryRequirements>& requirements );
+	void computeBarriers();
+	void recordBarriers( VkCommandBuffer commandBuffer,
+						 vector<VkImageMemoryBarrier2KHR>& barriers, const vector<RenderGraphImage>& images,
+						 vector<VkBufferMemoryBarrier2KHR>& bufferBarriers, const vector<RenderGraphBuffer>& buffers );
+	void releaseTransients();
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties _memoryProperties;
+	BarrierRecorder _recordBarriers;
+	uint _graphicsFamily = 0;
+	uint _computeFamily = 0;
+
+	vector<Pass> _passes;
+	vector<Resource> _resources;
+	vector<MemorySlot> _slots;
+	vector<Batch> _batches;
+
+	// Realized transients, reused by compile() when the graph's transient layout didn't change
+	struct RealizedImage {
+		TransientImageDesc desc;
+		int slot;
+		VkImage image;
+		VkImageView view;
+	};
+
+	vector<RealizedImage> _realized;
+	VkDeviceMemory _transientMemory = VK_NULL_HANDLE;
+	VkDeviceMemory _lazyMemory = VK_NULL_HANDLE;
+};
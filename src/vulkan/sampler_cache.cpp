@@ -0,0 +1,104 @@
+#include "sampler_cache.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+bool SamplerState::operator==( const SamplerState& other ) const {
+
+	return filter == other.filter &&
+		   mipmapMode == other.mipmapMode &&
+		   addressModeU == other.addressModeU &&
+		   addressModeV == other.addressModeV &&
+		   borderColor == other.borderColor &&
+		   maxAnisotropy == other.maxAnisotropy &&
+		   maxLod == other.maxLod &&
+		   compareEnable == other.compareEnable &&
+		   compareOp == other.compareOp;
+}
+
+template<typename T>
+static void hashCombine( size_t& seed, const T& value ) {
+
+	seed ^= std::hash<T>{}( value ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 );
+}
+
+size_t SamplerStateHash::operator()( const SamplerState& state ) const {
+
+	size_t seed = 0;
+
+	hashCombine( seed, static_cast<int>( state.filter ) );
+	hashCombine( seed, static_cast<int>( state.mipmapMode ) );
+	hashCombine( seed, static_cast<int>( state.addressModeU ) );
+	hashCombine( seed, static_cast<int>( state.addressModeV ) );
+	hashCombine( seed, static_cast<int>( state.borderColor ) );
+	hashCombine( seed, state.maxAnisotropy );
+	hashCombine( seed, state.maxLod );
+	hashCombine( seed, state.compareEnable );
+	hashCombine( seed, static_cast<int>( state.compareOp ) );
+
+	return seed;
+}
+
+void SamplerCache::init( VkDevice device, float deviceMaxAnisotropy ) {
+
+	_device = device;
+	_deviceMaxAnisotropy = deviceMaxAnisotropy;
+}
+
+VkSampler SamplerCache::get( SamplerState state ) {
+
+	state.maxAnisotropy = std::clamp( state.maxAnisotropy, 1.f, _deviceMaxAnisotropy );
+
+	auto found = _samplers.find( state );
+
+	if ( found != _samplers.end() ) {
+
+		return found->second;
+	}
+
+	VkSamplerCreateInfo samplerInfo {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = state.filter,
+		.minFilter = state.filter,
+		.mipmapMode = state.mipmapMode,
+		.addressModeU = state.addressModeU,
+		.addressModeV = state.addressModeV,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.mipLodBias = 0.0f,
+		.anisotropyEnable = state.maxAnisotropy > 1.f ? VK_TRUE : VK_FALSE,
+		.maxAnisotropy = state.maxAnisotropy,
+		.compareEnable = state.compareEnable,
+		.compareOp = state.compareOp,
+		.minLod = 0.0f,
+		.maxLod = state.maxLod,
+		.borderColor = state.borderColor,
+		.unnormalizedCoordinates = VK_FALSE,
+	};
+
+	VkSampler sampler;
+
+	if ( vkCreateSampler( _device, &samplerInfo, nullptr, &sampler ) != VK_SUCCESS ) {
+
+		throw std::runtime_error( "Failed to create sampler" );
+	}
+
+	_samplers.emplace( state, sampler );
+
+	return sampler;
+}
+
+size_t SamplerCache::getSize() const {
+
+	return _samplers.size();
+}
+
+void SamplerCache::release() {
+
+	for ( auto& [state, sampler] : _samplers ) {
+
+		vkDestroySampler( _device, sampler, nullptr );
+	}
+
+	_samplers.clear();
+}
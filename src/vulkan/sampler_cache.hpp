@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <unordered_map>
+
+// Everything a sampler is created from, equal states share one VkSampler
+struct SamplerState {
+
+	VkFilter filter = VK_FILTER_LINEAR; // used for both magnification and minification
+	VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	VkBorderColor borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	float maxAnisotropy = 1.f;	// 1 disables anisotropic filtering
+	float maxLod = VK_LOD_CLAMP_NONE;
+	VkBool32 compareEnable = VK_FALSE;
+	VkCompareOp compareOp = VK_COMPARE_OP_ALWAYS;
+
+	bool operator==( const SamplerState& other ) const;
+};
+
+struct SamplerStateHash {
+
+	size_t operator()( const SamplerState& state ) const;
+};
+
+// Deduplicates samplers by their state. Samplers live until release, so handles stay valid for
+// descriptors of frames in flight even after the engine switched to a different state
+class SamplerCache {
+
+public:
+
+	void init( VkDevice device, float deviceMaxAnisotropy );
+
+	// Anisotropy is clamped to the device limit before lookup
+	VkSampler get( SamplerState state );
+	size_t getSize() const;
+
+	void release();
+
+private:
+
+	VkDevice _device = VK_NULL_HANDLE;
+	float _deviceMaxAnisotropy = 1.f;
+	std::unordered_map<SamplerState, VkSampler, SamplerStateHash> _samplers;
+};
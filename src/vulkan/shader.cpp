@@ -1,26 +1,23 @@
 #include "shader.hpp"
-#include "../file.hpp"
 #include <cstdint>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
 
-Shader Shader::loadShader( VkDevice device, const char *vertPath, const char *fragPath ) {
+Shader Shader::loadShader( VkDevice device, const Asset& vertShaderCode, const Asset& fragShaderCode ) {
 
-	auto vertShaderCode = readFile( vertPath );
-	auto fragShaderCode = readFile( fragPath );
-
-	auto vertShaderModule = createShaderModule( device, vertShaderCode );
-	auto fragShaderModule = createShaderModule( device, fragShaderCode );
+	// SPIR-V is consumed in place, both mappings and pak entries are aligned as vkCreateShaderModule requires
+	auto vertShaderModule = createShaderModule( device, vertShaderCode.getData(), vertShaderCode.getSize() );
+	auto fragShaderModule = createShaderModule( device, fragShaderCode.getData(), fragShaderCode.getSize() );
 
 	return Shader( device, vertShaderModule, fragShaderModule );
 };
 
-VkShaderModule Shader::createShaderModule( VkDevice device, const std::vector<char>& code ) {
+VkShaderModule Shader::createShaderModule( VkDevice device, const char *code, size_t size ) {
 
 	VkShaderModuleCreateInfo createInfo {
 		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = code.size(),
-		.pCode = reinterpret_cast<const uint32_t*>(code.data())
+		.codeSize = size,
+		.pCode = reinterpret_cast<const uint32_t*>(code)
 	};
 
 	VkShaderModule shaderModule;
@@ -33,19 +30,6 @@ VkShaderModule Shader::createShaderModule( VkDevice device, const std::vector<ch
 	return shaderModule;
 };
 
-std::vector<char> Shader::readFile(const char *filepath) {
-
-	File file = File::openBinary( string(filepath) );
-	int size = file.getSize();
-
-	std::vector<char> chars(size);
-
-	file.readBinary( size, chars.data() );
-	file.close();
-
-	return chars;
-};    
-
 VkShaderModule Shader::getVertexShaderModule() { return _vertShaderModule; }
 	
 VkShaderModule Shader::getFragmentShaderModule() { return _fragShaderModule; }
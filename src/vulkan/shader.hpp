@@ -1,7 +1,11 @@
+#pragma once
+
 #include <vulkan/vulkan_core.h>
 #include <vulkan/vulkan.h>
 
-#include <vector>
+#include <cstddef>
+
+#include "../assets.hpp"
 
 // should be released after use
 class Shader {
@@ -20,13 +24,12 @@ public:
 	VkShaderModule getVertexShaderModule();
 	VkShaderModule getFragmentShaderModule();
 
-	static Shader loadShader( VkDevice device, const char *vertPath, const char *fragPath );
-	static VkShaderModule createShaderModule( VkDevice device, const std::vector<char>& code );
+	static Shader loadShader( VkDevice device, const Asset& vertShaderCode, const Asset& fragShaderCode );
+	static VkShaderModule createShaderModule( VkDevice device, const char *code, size_t size );
 
 private:
 
 	VkDevice _device;
 	VkShaderModule _vertShaderModule;
 	VkShaderModule _fragShaderModule;
-	static std::vector<char> readFile(const char *filepath);
 };
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef WITH_SHADERC
+#include <shaderc/shaderc.h>
+#endif
+
+#include "shader_compiler.hpp"
+#include "../hash.hpp"
+
+// Bump to invalidate caches when compile options change
+const uint32_t shaderCacheVersion = 1;
+
+static uint64_t hashString( const string& str, uint64_t seed ) {
+
+	// Length is mixed in so that e.g. ("AB", "C") and ("A", "BC") hash differently
+	uint64_t length = str.size();
+	seed = fnv1a( &length, sizeof( length ), seed );
+
+	return fnv1a( str.data(), str.size(), seed );
+}
+
+static string toHex( uint64_t value ) {
+
+	char buffer[17];
+	snprintf( buffer, sizeof( buffer ), "%016llx", static_cast<unsigned long long>( value ) );
+
+	return string( buffer );
+}
+
+static uint64_t compilerVersionHash() {
+
+	uint64_t hash = fnv1a( &shaderCacheVersion, sizeof( shaderCacheVersion ) );
+
+#ifdef WITH_SHADERC
+	unsigned int version, revision;
+	shaderc_get_spv_version( &version, &revision );
+
+	hash = fnv1a( &version, sizeof( version ), hash );
+	hash = fnv1a( &revision, sizeof( revision ), hash );
+#endif
+
+	return hash;
+}
+
+ShaderCompiler::ShaderCompiler( const string& cacheDirectory ) : _cacheDirectory(cacheDirectory) {
+
+	mkdir( _cacheDirectory.c_str(), 0755 );
+
+#ifdef WITH_SHADERC
+	_compiler = shaderc_compiler_initialize();
+#endif
+}
+
+ShaderCompiler::~ShaderCompiler() {
+
+	// Wait for workers before compiler goes away
+	for ( auto& [key, future] : _inFlight ) {
+
+		future.wait();
+	}
+
+#ifdef WITH_SHADERC
+	if ( _compiler ) {
+
+		shaderc_compiler_release( static_cast<shaderc_compiler_t>( _compiler ) );
+	}
+#endif
+}
+
+bool ShaderCompiler::isAvailable() {
+
+#ifdef WITH_SHADERC
+	return true;
+#else
+	return false;
+#endif
+}
+
+Asset ShaderCompiler::compile( const string& sourcePath, ShaderStage stage, const vector<ShaderDefine>& defines ) {
+
+	File source = File::openBinary( sourcePath );
+
+	uint64_t hash = fnv1a( source.getData(), source.getSize(), compilerVersionHash() );
+	hash = fnv1a( &stage, sizeof( stage ), hash );
+
+	for ( const auto& define : defines ) {
+
+		hash = hashString( define.name, hash );
+		hash = hashString( define.value, hash );
+	}
+
+	string cachePath = _cacheDirectory + "/" + toHex( hash ) + ".spv";
+
+	if ( access( cachePath.c_str(), R_OK ) == 0 ) {
+
+		return Asset::mapped( File::openBinary( cachePath, File::Access::WillNeed ) );
+	}
+
+	auto code = compileSource( source, sourcePath, stage, defines );
+	writeCache( cachePath, code );
+
+	return Asset::owned( std::move( code ) );
+}
+
+std::shared_future<Asset> ShaderCompiler::compileAsync( const string& sourcePath, ShaderStage stage, const vector<ShaderDefine>& defines ) {
+
+	string key = sourcePath + "|" + std::to_string( static_cast<int>( stage ) );
+
+	for ( const auto& define : defines ) {
+
+		key += "|" + define.name + "=" + define.value;
+	}
+
+	std::lock_guard<std::mutex> lock( _inFlightMutex );
+
+	auto it = _inFlight.find( key );
+
+	// Only running compilations are shared, finished ones go through the disk cache again to pick up edited sources
+	if ( it != _inFlight.end() ) {
+
+		bool isReady = it->second.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+
+		if ( !isReady ) {
+
+			return it->second;
+		}
+	}
+
+	auto future = std::async( std::launch::async, [this, sourcePath, stage, defines] {
+
+		return compile( sourcePath, stage, defines );
+	}).share();
+
+	_inFlight[key] = future;
+
+	return future;
+}
+
+vector<char> ShaderCompiler::compileSource( const File& source, const string& sourcePath, ShaderStage stage, const vector<ShaderDefine>& defines ) {
+
+#ifdef WITH_SHADERC
+	shaderc_shader_kind kind = shaderc_glsl_infer_from_source;
+
+	switch ( stage ) {
+		case ShaderStage::Vertex:
+			kind = shaderc_glsl_vertex_shader;
+			break;
+		case ShaderStage::Fragment:
+			kind = shaderc_glsl_fragment_shader;
+			break;
+		case ShaderStage::Compute:
+			kind = shaderc_glsl_compute_shader;
+			break;
+	}
+
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_optimization_level( options, shaderc_optimization_level_performance );
+
+	for ( const auto& define : defines ) {
+
+		shaderc_compile_options_add_macro_definition( options, 
+			define.name.data(), define.name.size(), 
+			define.value.data(), define.value.size() );
+	}
+
+	// Compiler object is thread safe, options and results are per call
+	shaderc_compilation_result_t result = shaderc_compile_into_spv( 
+		static_cast<shaderc_compiler_t>( _compiler ), 
+		source.getData(), source.getSize(), kind, sourcePath.c_str(), "main", options );
+
+	shaderc_compile_options_release( options );
+
+	if ( shaderc_result_get_compilation_status( result ) != shaderc_compilation_status_success ) {
+
+		string message = shaderc_result_get_error_message( result );
+		shaderc_result_release( result );
+
+		throw std::runtime_error( "Failed to compile " + sourcePath + ": " + message );
+	}
+
+	const char *bytes = shaderc_result_get_bytes( result );
+	vector<char> code( bytes, bytes + shaderc_result_get_length( result ) );
+
+	shaderc_result_release( result );
+
+	return code;
+#else
+	throw std::runtime_error( "Failed to compile " + sourcePath + ": built without runtime shader compiler" );
+#endif
+}
+
+void ShaderCompiler::writeCache( const string& cachePath, const vector<char>& code ) {
+
+	// Rename is atomic, so concurrent processes never map a partially written file
+	auto threadId = std::hash<std::thread::id>()( std::this_thread::get_id() );
+	string tempPath = cachePath + ".tmp" + std::to_string( getpid() ) + "-" + std::to_string( threadId );
+
+	std::ofstream stream( tempPath, std::ios::binary | std::ios::trunc );
+
+	if ( !stream.is_open() ) {
+
+		// Cache is an optimization, compiled code is still usable
+		return;
+	}
+
+	stream.write( code.data(), code.size() );
+	stream.close();
+
+	if ( !stream || rename( tempPath.c_str(), cachePath.c_str() ) != 0 ) {
+
+		remove( tempPath.c_str() );
+	}
+}
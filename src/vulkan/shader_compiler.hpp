@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../assets.hpp"
+
+using std::string, std::vector;
+
+enum class ShaderStage {
+	Vertex,
+	Fragment,
+	Compute,
+};
+
+struct ShaderDefine {
+	string name;
+	string value;
+};
+
+// Compiles GLSL into SPIR-V at runtime (requires build with SHADERC=1).
+// Results are cached on disk under a hash of source, stage, defines and compiler version,
+// so each permutation is compiled only once per machine. Safe to use from multiple threads.
+class ShaderCompiler {
+
+public:
+
+	ShaderCompiler( const string& cacheDirectory );
+	ShaderCompiler( const ShaderCompiler& ) = delete;
+	~ShaderCompiler();
+
+	Asset compile( const string& sourcePath, ShaderStage stage, const vector<ShaderDefine>& defines = {} );
+
+	// Runs on a worker thread, the same permutation requested twice is compiled once
+	std::shared_future<Asset> compileAsync( const string& sourcePath, ShaderStage stage, const vector<ShaderDefine>& defines = {} );
+
+	static bool isAvailable();
+
+private:
+
+	vector<char> compileSource( const File& source, const string& sourcePath, ShaderStage stage, const vector<ShaderDefine>& defines );
+	void writeCache( const string& cachePath, const vector<char>& code );
+
+	string _cacheDirectory;
+	void *_compiler = nullptr;
+	std::mutex _inFlightMutex;
+	std::map<string, std::shared_future<Asset>> _inFlight;
+};
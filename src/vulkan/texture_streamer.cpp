@@ -0,0 +1,512 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+// Levels up to this size are always resident, a texture is never sampled without them
+const uint MIP_TAIL_SIZE = 64;
+
+// Upload limit per frame, a single level larger than this still goes through on its own
+const VkDeviceSize UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+const VkFormat STREAMED_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+void TextureStreamer::init( VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize budget, bool hasMemoryBudget ) {
+
+	_device = device;
+	_physicalDevice = physicalDevice;
+	_budget = budget;
+	_currentBudget = budget;
+	_hasMemoryBudget = hasMemoryBudget;
+
+	vkGetPhysicalDeviceMemoryProperties( physicalDevice, &_memoryProperties );
+
+	for ( uint i = 0; i < _memoryProperties.memoryHeapCount; i++ ) {
+
+		if ( _memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ) {
+
+			_heapIndex = i;
+			break;
+		}
+	}
+}
+
+StreamedTexture TextureStreamer::addTexture( vector<MipLevel> mips ) {
+
+	if ( mips.empty() ) {
+
+		throw std::runtime_error("Texture streamer: texture has no mips");
+	}
+
+	Texture texture {
+		.mips = std::move( mips ),
+	};
+
+	texture.residentMip = texture.mips.size();
+	texture.wantedMip = getTailMip( texture );
+
+	_textures.push_back( std::move( texture ) );
+
+	return _textures.size() - 1;
+}
+
+void TextureStreamer::replaceTexture( StreamedTexture texture, vector<MipLevel> mips ) {
+
+	if ( mips.empty() ) {
+
+		throw std::runtime_error("Texture streamer: texture has no mips");
+	}
+
+	// Old image is retired by the next update
+	_textures[texture].mips = std::move( mips );
+	_textures[texture].residentMip = _textures[texture].mips.size();
+}
+
+void TextureStreamer::requestMip( StreamedTexture texture, uint mip, int frame ) {
+
+	_textures[texture].wantedMip = std::min<uint>( mip, _textures[texture].mips.size() - 1 );
+	_textures[texture].lastUsedFrame = frame;
+}
+
+bool TextureStreamer::update( VkCommandBuffer commandBuffer, int frame, const RetireCallback& retire ) {
+
+	_currentBudget = queryBudget();
+
+	// Least recently used first
+	vector<int> order( _textures.size() );
+	std::iota( order.begin(), order.end(), 0 );
+	std::stable_sort( order.begin(), order.end(), [this] ( int a, int b ) { return _textures[a].lastUsedFrame < _textures[b].lastUsedFrame; } );
+
+	// New and replaced textures start from their mip tail
+	vector<uint> targets( _textures.size() );
+	VkDeviceSize estimate = _residentSize;
+
+	for ( size_t i = 0; i < _textures.size(); i++ ) {
+
+		targets[i] = std::min<uint>( _textures[i].residentMip, getTailMip( _textures[i] ) );
+
+		if ( targets[i] != _textures[i].residentMip ) {
+
+			estimate += getMipChainSize( _textures[i].mips, targets[i] );
+		}
+	}
+
+	// Levels finer than requested go first, then textures not used this frame. Levels already
+	// streamed in this frame and the requesting texture itself are never evicted
+	auto evictLevel = [&] ( int requesting ) {
+
+		for ( bool isUnwantedOnly : { true, false } ) {
+
+			for ( int i : order ) {
+
+				const auto& texture = _textures[i];
+
+				if ( i == requesting || targets[i] >= getTailMip( texture ) || targets[i] < texture.residentMip ) {
+					continue;
+				}
+
+				bool isUnwanted = targets[i] < texture.wantedMip;
+
+				if ( isUnwantedOnly ? !isUnwanted : texture.lastUsedFrame == frame ) {
+					continue;
+				}
+
+				estimate -= texture.mips[targets[i]].pixels.size();
+				targets[i]++;
+
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	while ( estimate > _currentBudget && evictLevel( -1 ) ) {}
+
+	// Most recently used first, one level per texture and frame
+	VkDeviceSize uploadSize = 0;
+
+	for ( auto it = order.rbegin(); it != order.rend(); it++ ) {
+
+		int i = *it;
+		const auto& texture = _textures[i];
+
+		if ( targets[i] != texture.residentMip || texture.wantedMip >= targets[i] ) {
+			continue;
+		}
+
+		VkDeviceSize levelSize = texture.mips[targets[i] - 1].pixels.size();
+
+		if ( uploadSize > 0 && uploadSize + levelSize > UPLOAD_BYTES_PER_FRAME ) {
+			break;
+		}
+
+		bool fits = true;
+
+		while ( estimate + levelSize > _currentBudget && ( fits = evictLevel( i ) ) ) {}
+
+		if ( !fits ) {
+			continue;
+		}
+
+		targets[i]--;
+		estimate += levelSize;
+		uploadSize += levelSize;
+	}
+
+	bool isViewChanged = false;
+
+	for ( size_t i = 0; i < _textures.size(); i++ ) {
+
+		if ( targets[i] != _textures[i].residentMip ) {
+
+			moveToMip( _textures[i], targets[i], commandBuffer, retire );
+			isViewChanged = true;
+		}
+	}
+
+	return isViewChanged;
+}
+
+VkDeviceSize TextureStreamer::queryBudget() {
+
+	if ( !_hasMemoryBudget ) {
+
+		return _budget;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+
+	VkPhysicalDeviceMemoryProperties2 properties {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &budgetProperties,
+	};
+
+	vkGetPhysicalDeviceMemoryProperties2( _physicalDevice, &properties );
+
+	// Heap usage includes resident textures, everything else in the heap (and other processes) is left alone
+	VkDeviceSize heapBudget = budgetProperties.heapBudget[_heapIndex];
+	VkDeviceSize heapUsage = budgetProperties.heapUsage[_heapIndex];
+	VkDeviceSize otherUsage = heapUsage - std::min( heapUsage, _residentSize );
+	VkDeviceSize available = heapBudget > otherUsage ? heapBudget - otherUsage : 0;
+
+	return std::min( _budget, available );
+}
+
+uint TextureStreamer::getTailMip( const Texture& texture ) const {
+
+	uint mip = 0;
+
+	while ( mip + 1 < texture.mips.size() && std::max( texture.mips[mip].width, texture.mips[mip].height ) > MIP_TAIL_SIZE ) {
+
+		mip++;
+	}
+
+	return mip;
+}
+
+// Texture moves into a new image holding levels from mip down, resident levels are copied and missing ones uploaded
+void TextureStreamer::moveToMip( Texture& texture, uint mip, VkCommandBuffer commandBuffer, const RetireCallback& retire ) {
+
+	uint mipCount = texture.mips.size();
+	uint levelCount = mipCount - mip;
+	const auto& base = texture.mips[mip];
+
+	VkImageCreateInfo imageInfo {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = STREAMED_FORMAT,
+		.extent = { base.width, base.height, 1 },
+		.mipLevels = levelCount,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	VkImage image;
+
+	if ( vkCreateImage( _device, &imageInfo, nullptr, &image ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Texture streamer: failed to create image");
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements( _device, image, &requirements );
+
+	VkMemoryAllocateInfo allocInfo {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = findMemoryType( requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ),
+	};
+
+	VkDeviceMemory memory;
+
+	if ( vkAllocateMemory( _device, &allocInfo, nullptr, &memory ) != VK_SUCCESS ) {
+
+		vkDestroyImage( _device, image, nullptr );
+		throw std::runtime_error("Texture streamer: failed to allocate image memory");
+	}
+
+	vkBindImageMemory( _device, image, memory, 0 );
+
+	// Budget is read from the heap textures actually live in
+	_heapIndex = _memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+
+	VkImageViewCreateInfo viewInfo {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = STREAMED_FORMAT,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = levelCount,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+	};
+
+	VkImageView view;
+
+	if ( vkCreateImageView( _device, &viewInfo, nullptr, &view ) != VK_SUCCESS ) {
+
+		vkDestroyImage( _device, image, nullptr );
+		vkFreeMemory( _device, memory, nullptr );
+		throw std::runtime_error("Texture streamer: failed to create image view");
+	}
+
+	bool hasResidentLevels = texture.image != VK_NULL_HANDLE && texture.residentMip < mipCount;
+	uint firstCopied = hasResidentLevels ? std::max( mip, texture.residentMip ) : mipCount;
+
+	VkImageSubresourceRange allLevels = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+	vector<VkImageMemoryBarrier> barriers = {
+		VkImageMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = allLevels,
+		},
+	};
+
+	// Previous frame may still be sampling the old image
+	if ( hasResidentLevels ) {
+
+		barriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = texture.image,
+			.subresourceRange = allLevels,
+		});
+	}
+
+	vkCmdPipelineBarrier( commandBuffer,
+						hasResidentLevels ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+						0, nullptr,
+						0, nullptr,
+						static_cast<uint>( barriers.size() ), barriers.data() );
+
+	if ( hasResidentLevels ) {
+
+		vector<VkImageCopy> copies;
+
+		for ( uint level = firstCopied; level < mipCount; level++ ) {
+
+			copies.push_back({
+				.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - texture.residentMip, 0, 1 },
+				.srcOffset = { 0, 0, 0 },
+				.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - mip, 0, 1 },
+				.dstOffset = { 0, 0, 0 },
+				.extent = { texture.mips[level].width, texture.mips[level].height, 1 },
+			});
+		}
+
+		vkCmdCopyImage( commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies.size(), copies.data() );
+	}
+
+	// Levels which weren't resident come from system memory
+	if ( mip < firstCopied ) {
+
+		VkDeviceSize uploadSize = 0;
+
+		for ( uint level = mip; level < firstCopied; level++ ) {
+
+			uploadSize += texture.mips[level].pixels.size();
+		}
+
+		VkBufferCreateInfo bufferInfo {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = uploadSize,
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		};
+
+		VkBuffer stagingBuffer;
+
+		if ( vkCreateBuffer( _device, &bufferInfo, nullptr, &stagingBuffer ) != VK_SUCCESS ) {
+
+			throw std::runtime_error("Texture streamer: failed to create staging buffer");
+		}
+
+		VkMemoryRequirements bufferRequirements;
+		vkGetBufferMemoryRequirements( _device, stagingBuffer, &bufferRequirements );
+
+		VkMemoryAllocateInfo bufferAllocInfo {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = bufferRequirements.size,
+			.memoryTypeIndex = findMemoryType( bufferRequirements.memoryTypeBits,
+								VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ),
+		};
+
+		VkDeviceMemory stagingMemory;
+
+		if ( vkAllocateMemory( _device, &bufferAllocInfo, nullptr, &stagingMemory ) != VK_SUCCESS ) {
+
+			vkDestroyBuffer( _device, stagingBuffer, nullptr );
+			throw std::runtime_error("Texture streamer: failed to allocate staging memory");
+		}
+
+		vkBindBufferMemory( _device, stagingBuffer, stagingMemory, 0 );
+
+		void *data;
+		vkMapMemory( _device, stagingMemory, 0, uploadSize, 0, &data );
+
+		vector<VkBufferImageCopy> regions;
+		VkDeviceSize offset = 0;
+
+		for ( uint level = mip; level < firstCopied; level++ ) {
+
+			const auto& source = texture.mips[level];
+
+			memcpy( static_cast<unsigned char*>( data ) + offset, source.pixels.data(), source.pixels.size() );
+
+			regions.push_back({
+				.bufferOffset = offset,
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - mip, 0, 1 },
+				.imageOffset = { 0, 0, 0 },
+				.imageExtent = { source.width, source.height, 1 },
+			});
+
+			offset += source.pixels.size();
+		}
+
+		vkUnmapMemory( _device, stagingMemory );
+
+		vkCmdCopyBufferToImage( commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+								regions.size(), regions.data() );
+
+		retire( [device = _device, stagingBuffer, stagingMemory] {
+			vkDestroyBuffer( device, stagingBuffer, nullptr );
+			vkFreeMemory( device, stagingMemory, nullptr );
+		});
+	}
+
+	VkImageMemoryBarrier readBarrier {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = allLevels,
+	};
+
+	vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+						0, nullptr,
+						0, nullptr,
+						1, &readBarrier );
+
+	if ( texture.image != VK_NULL_HANDLE ) {
+
+		retire( [device = _device, oldImage = texture.image, oldView = texture.view, oldMemory = texture.memory] {
+			vkDestroyImageView( device, oldView, nullptr );
+			vkDestroyImage( device, oldImage, nullptr );
+			vkFreeMemory( device, oldMemory, nullptr );
+		});
+	}
+
+	_residentSize = _residentSize - texture.memorySize + requirements.size;
+
+	texture.image = image;
+	texture.memory = memory;
+	texture.view = view;
+	texture.memorySize = requirements.size;
+	texture.residentMip = mip;
+}
+
+uint TextureStreamer::findMemoryType( uint typeFilter, VkMemoryPropertyFlags properties ) {
+
+	for ( uint i = 0; i < _memoryProperties.memoryTypeCount; i++ ) {
+
+		if ( ( typeFilter & ( 1 << i ) ) && ( _memoryProperties.memoryTypes[i].propertyFlags & properties ) == properties ) {
+
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Texture streamer: no suitable memory type");
+}
+
+VkImageView TextureStreamer::getImageView( StreamedTexture texture ) const {
+
+	return _textures[texture].view;
+}
+
+uint TextureStreamer::getMipCount( StreamedTexture texture ) const {
+
+	return _textures[texture].mips.size();
+}
+
+uint TextureStreamer::getBaseSize( StreamedTexture texture ) const {
+
+	return std::max( _textures[texture].mips[0].width, _textures[texture].mips[0].height );
+}
+
+VkDeviceSize TextureStreamer::getResidentSize() const {
+
+	return _residentSize;
+}
+
+VkDeviceSize TextureStreamer::getBudget() const {
+
+	return _currentBudget;
+}
+
+void TextureStreamer::release() {
+
+	for ( auto& texture : _textures ) {
+
+		if ( texture.image != VK_NULL_HANDLE ) {
+
+			vkDestroyImageView( _device, texture.view, nullptr );
+			vkDestroyImage( _device, texture.image, nullptr );
+			vkFreeMemory( _device, texture.memory, nullptr );
+		}
+	}
+
+	_textures.clear();
+	_residentSize = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <functional>
+#include <vector>
+
+#include "../media/mip_chain.hpp"
+
+using std::vector;
+
+using StreamedTexture = int;
+
+// Destroys a replaced resource once the frames using it have retired
+using RetireCallback = std::function<void( std::function<void()> )>;
+
+// Keeps mip chains in system memory and only the levels a texture needs on screen in VRAM.
+// Textures start with their small mip tail resident, finer levels are streamed in a few at a time as
+// they are requested. When resident mips exceed the budget, the least recently used textures drop
+// their finest levels first. A texture changes resolution by moving into a new image: resident levels
+// are copied on the GPU, only the new level is uploaded. The image view changes on every move
+class TextureStreamer {
+
+	struct Texture {
+		vector<MipLevel> mips;
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkDeviceSize memorySize = 0;
+		uint residentMip;	// finest level in VRAM, mips.size() when the image holds nothing valid
+		uint wantedMip;
+		int lastUsedFrame = 0;
+	};
+
+public:
+
+	// Budget caps VRAM taken by textures, with VK_EXT_memory_budget it's also kept within what the heap has left
+	void init( VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize budget, bool hasMemoryBudget );
+
+	StreamedTexture addTexture( vector<MipLevel> mips );
+
+	// Drops resident levels, the new version streams in from its mip tail
+	void replaceTexture( StreamedTexture texture, vector<MipLevel> mips );
+
+	// Marks the texture as used this frame, finer levels than mip are streamed in
+	void requestMip( StreamedTexture texture, uint mip, int frame );
+
+	// Records this frame's uploads and evictions, returns whether any image view changed
+	bool update( VkCommandBuffer commandBuffer, int frame, const RetireCallback& retire );
+
+	VkImageView getImageView( StreamedTexture texture ) const;
+	uint getMipCount( StreamedTexture texture ) const;
+	uint getBaseSize( StreamedTexture texture ) const; // larger side of level 0
+	VkDeviceSize getResidentSize() const;
+	VkDeviceSize getBudget() const;
+
+	void release();
+
+private:
+
+	VkDeviceSize queryBudget();
+	uint getTailMip( const Texture& texture ) const;
+	void moveToMip( Texture& texture, uint mip, VkCommandBuffer commandBuffer, const RetireCallback& retire );
+	uint findMemoryType( uint typeFilter, VkMemoryPropertyFlags properties );
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties _memoryProperties;
+	VkDeviceSize _budget = 0;
+	VkDeviceSize _currentBudget = 0;
+	bool _hasMemoryBudget = false;
+	uint _heapIndex = 0;
+	vector<Texture> _textures;
+	VkDeviceSize _residentSize = 0;
+};
@@ -0,0 +1,213 @@
+#include "timeline_queue.hpp"
+
+#include <stdexcept>
+
+void TimelineQueue::init( VkDevice device, VkQueue queue, uint family, int framesInFlight ) {
+
+	_device = device;
+	_queue = queue;
+	_family = family;
+
+	VkSemaphoreTypeCreateInfoKHR typeInfo {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+		.initialValue = 0,
+	};
+
+	VkSemaphoreCreateInfo createInfo {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &typeInfo,
+	};
+
+	if ( vkCreateSemaphore( _device, &createInfo, nullptr, &_timeline ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to create timeline semaphore");
+	}
+
+	// Extension commands aren't exported by the loader
+	_waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>( vkGetDeviceProcAddr( _device, "vkWaitSemaphoresKHR" ) );
+	_getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>( vkGetDeviceProcAddr( _device, "vkGetSemaphoreCounterValueKHR" ) );
+
+	_framePools.resize( framesInFlight );
+
+	for ( auto& framePool : _framePools ) {
+
+		// Buffers are reset with their pool, so they can't be reset one by one
+		VkCommandPoolCreateInfo poolInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = _family,
+		};
+
+		if ( vkCreateCommandPool( _device, &poolInfo, nullptr, &framePool.pool ) != VK_SUCCESS ) {
+
+			throw std::runtime_error("Failed to create command pool");
+		}
+	}
+}
+
+void TimelineQueue::beginFrame( int flightFrame ) {
+
+	_flightFrame = flightFrame;
+
+	auto& framePool = _framePools[flightFrame];
+
+	vkResetCommandPool( _device, framePool.pool, 0 );
+	framePool.used = 0;
+}
+
+// Buffers allocated in earlier frames are reused, the pool only grows when a frame needs more
+VkCommandBuffer TimelineQueue::beginCommandBuffer() {
+
+	auto& framePool = _framePools[_flightFrame];
+
+	if ( framePool.used == framePool.commandBuffers.size() ) {
+
+		VkCommandBufferAllocateInfo allocInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = framePool.pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+
+		VkCommandBuffer commandBuffer;
+
+		if ( vkAllocateCommandBuffers( _device, &allocInfo, &commandBuffer ) != VK_SUCCESS ) {
+
+			throw std::runtime_error("Failed to allocate command buffers");
+		}
+
+		framePool.commandBuffers.push_back( commandBuffer );
+	}
+
+	VkCommandBuffer commandBuffer = framePool.commandBuffers[framePool.used++];
+
+	VkCommandBufferBeginInfo beginInfo {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	if ( vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to begin recording command buffer");
+	}
+
+	return commandBuffer;
+}
+
+uint64_t TimelineQueue::submit( VkCommandBuffer commandBuffer, const vector<QueueWait>& waits, const vector<VkSemaphore>& signals ) {
+
+	if ( vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to record command buffer");
+	}
+
+	vector<VkSemaphore> waitSemaphores;
+	vector<uint64_t> waitValues;
+	vector<VkPipelineStageFlags> waitStages;
+
+	for ( const auto& wait : waits ) {
+
+		waitSemaphores.push_back( wait.semaphore );
+		waitValues.push_back( wait.value );
+		waitStages.push_back( wait.stages );
+	}
+
+	// Timeline goes last, binary semaphores take a dummy value
+	vector<VkSemaphore> signalSemaphores = signals;
+	vector<uint64_t> signalValues( signals.size(), 0 );
+
+	_lastSubmitted++;
+
+	signalSemaphores.push_back( _timeline );
+	signalValues.push_back( _lastSubmitted );
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+		.waitSemaphoreValueCount = static_cast<uint>( waitValues.size() ),
+		.pWaitSemaphoreValues = waitValues.data(),
+		.signalSemaphoreValueCount = static_cast<uint>( signalValues.size() ),
+		.pSignalSemaphoreValues = signalValues.data(),
+	};
+
+	VkSubmitInfo submitInfo {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timelineInfo,
+		.waitSemaphoreCount = static_cast<uint>( waitSemaphores.size() ),
+		.pWaitSemaphores = waitSemaphores.data(),
+		.pWaitDstStageMask = waitStages.data(),
+		.commandBufferCount = 1,
+		.pCommandBuffers = &commandBuffer,
+		.signalSemaphoreCount = static_cast<uint>( signalSemaphores.size() ),
+		.pSignalSemaphores = signalSemaphores.data(),
+	};
+
+	if ( vkQueueSubmit( _queue, 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to submit command buffer");
+	}
+
+	return _lastSubmitted;
+}
+
+uint64_t TimelineQueue::getCompleted() const {
+
+	uint64_t completed = 0;
+
+	if ( _getSemaphoreCounterValue( _device, _timeline, &completed ) != VK_SUCCESS ) {
+
+		throw std::runtime_error("Failed to read timeline semaphore");
+	}
+
+	return completed;
+}
+
+bool TimelineQueue::isComplete( uint64_t value ) const {
+
+	return getCompleted() >= value;
+}
+
+void TimelineQueue::wait( uint64_t value ) const {
+
+	VkSemaphoreWaitInfoKHR waitInfo {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+		.semaphoreCount = 1,
+		.pSemaphores = &_timeline,
+		.pValues = &value,
+	};
+
+	_waitSemaphores( _device, &waitInfo, UINT64_MAX );
+}
+
+VkQueue TimelineQueue::getQueue() const {
+
+	return _queue;
+}
+
+uint TimelineQueue::getFamily() const {
+
+	return _family;
+}
+
+VkSemaphore TimelineQueue::getTimeline() const {
+
+	return _timeline;
+}
+
+uint64_t TimelineQueue::getLastSubmitted() const {
+
+	return _lastSubmitted;
+}
+
+void TimelineQueue::release() {
+
+	for ( auto& framePool : _framePools ) {
+
+		vkDestroyCommandPool( _device, framePool.pool, nullptr );
+	}
+
+	_framePools.clear();
+
+	vkDestroySemaphore( _device, _timeline, nullptr );
+	_timeline = VK_NULL_HANDLE;
+}
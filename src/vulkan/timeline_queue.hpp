@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+// Semaphore a submission waits for, the value is ignored for binary semaphores
+struct QueueWait {
+	VkSemaphore semaphore;
+	uint64_t value;
+	VkPipelineStageFlags stages;
+};
+
+// Queue paired with a timeline semaphore which every submission advances, so other queues and the CPU
+// can wait for any earlier submission by its value.
+// Command buffers come from one pool per frame in flight, reset as a whole once the frame completed
+class TimelineQueue {
+
+	struct FramePool {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		vector<VkCommandBuffer> commandBuffers;
+		size_t used = 0;
+	};
+
+public:
+
+	void init( VkDevice device, VkQueue queue, uint family, int framesInFlight );
+
+	// Reclaims the frame's command buffers, its previous submissions must have completed
+	void beginFrame( int flightFrame );
+
+	// Started command buffer from the current frame's pool
+	VkCommandBuffer beginCommandBuffer();
+
+	// Ends and submits the command buffer, returns the value the timeline reaches once it completed
+	uint64_t submit( VkCommandBuffer commandBuffer, const vector<QueueWait>& waits, const vector<VkSemaphore>& signals = {} );
+
+	uint64_t getCompleted() const;
+	bool isComplete( uint64_t value ) const;
+	void wait( uint64_t value ) const;
+
+	VkQueue getQueue() const;
+	uint getFamily() const;
+	VkSemaphore getTimeline() const;
+	uint64_t getLastSubmitted() const;
+
+	void release();
+
+private:
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkQueue _queue = VK_NULL_HANDLE;
+	uint _family = 0;
+	VkSemaphore _timeline = VK_NULL_HANDLE;
+	uint64_t _lastSubmitted = 0;
+	vector<FramePool> _framePools;
+	int _flightFrame = 0;
+	PFN_vkWaitSemaphoresKHR _waitSemaphores = nullptr;
+	PFN_vkGetSemaphoreCounterValueKHR _getSemaphoreCounterValue = nullptr;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/ext/vector_float4.hpp>
+
+// Must match the defines in cluster_lights.comp and main.frag
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const int MAX_LIGHTS_PER_CLUSTER = 64;
+
+// Light buffer capacity
+const int MAX_LIGHTS = 256;
+
+// std430 layout, matches the Light struct in the shaders
+struct Light {
+
+	glm::vec4 positionRange; // world space position, w is the distance where the light fades out
+	glm::vec4 color;		 // rgb scaled by intensity
+	glm::vec4 direction;	 // spot lights only, points away from the light
+	glm::vec4 spotCone;		 // cosines of the outer and inner cone angles, point lights have x = -1
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+
+// Effects of the compute post chain, each can be toggled and is timed separately.
+// Tonemapping can't be skipped since it brings HDR down to display range, turning it off only clamps
+enum class PostEffect {
+	Bloom,
+	Tonemap,
+	Fxaa,
+};
+
+const int POST_EFFECT_COUNT = 3;
+
+enum PostShader {
+	POST_BLOOM_DOWNSAMPLE,
+	POST_BLOOM_UPSAMPLE,
+	POST_TONEMAP,
+	POST_FXAA,
+	POST_HIZ_REDUCE, // not an effect, builds the occlusion culling pyramid with the post layout
+	POST_SHADER_COUNT,
+};
+
+using PostPipelines = std::array<VkPipeline, POST_SHADER_COUNT>;
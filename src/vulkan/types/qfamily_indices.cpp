@@ -22,6 +22,13 @@ QueueFamilyIndices findQueueFamilies( VkPhysicalDevice device, VkSurfaceKHR surf
 			indices.graphicsFamily = index;
 		}
 
+		bool isComputeOnly = ( queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT ) && !( queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT );
+
+		if ( isComputeOnly && !indices.computeFamily.has_value() ) {
+
+			indices.computeFamily = index;
+		}
+
 		VkBool32 presentSupport = false;
 
 		vkGetPhysicalDeviceSurfaceSupportKHR( device, index, surface, &presentSupport);
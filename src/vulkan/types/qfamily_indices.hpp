@@ -12,6 +12,7 @@ using std::optional;
 struct QueueFamilyIndices {
 	optional<uint> graphicsFamily;
 	optional<uint> presentFamily;
+	optional<uint> computeFamily; // compute without graphics, runs alongside the graphics queue
 
 	bool isComplete();
 };
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <sys/types.h>
+
+#include "post_effects.hpp"
+#include "../shader.hpp"
+#include "../../media/mip_chain.hpp"
+
+// Texture decoded by the reload thread, handed to the texture streamer at a frame boundary
+struct PendingTexture {
+	vector<MipLevel> mips;
+};
+
+// Pipelines built by the reload thread from a new shader version, swapped in at a frame boundary
+struct PendingShaders {
+	Shader shader;
+	VkPipeline mainPipeline = VK_NULL_HANDLE;
+	VkPipeline depthPrepassPipeline = VK_NULL_HANDLE;
+	VkPipeline shadowPipeline = VK_NULL_HANDLE;
+	VkPipeline clusterPipeline = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	PostPipelines postPipelines {};
+	bool isDepthPrepassVariant; // main pipeline tests EQUAL against the pre-pass depth
+};
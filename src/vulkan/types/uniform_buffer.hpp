@@ -1,8 +1,22 @@
 #include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float2.hpp>
+#include <glm/ext/vector_float4.hpp>
 
+#include <cstdint>
+
+#include "../cascaded_shadows.hpp"
+
+// std140 layout, matches the block in the shaders
 struct UniformBufferObject {
 
 	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
-};
\ No newline at end of file
+	glm::mat4 shadowViewProj[SHADOW_CASCADES];
+	glm::vec4 cascadeSplits; // view space depth where each cascade ends
+	glm::vec4 sunDirection;
+	glm::vec4 clusterDepth;  // near and far of the depth slicing, slices per log depth unit, camera far plane
+	glm::vec2 screenSize;
+	uint32_t lightCount;
+	uint32_t padding;
+};
@@ -11,7 +11,7 @@ VkVertexInputBindingDescription Vertex::getBindingDescription() {
 	};
 }
 
-std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription() {
+std::array<VkVertexInputAttributeDescription, 6> Vertex::getAttributeDescription() {
 
 	return {
 		VkVertexInputAttributeDescription{
@@ -31,6 +31,57 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription
 			.binding = 0,
 			.format = VK_FORMAT_R32G32_SFLOAT,
 			.offset = offsetof( Vertex, uv0 )
+		},
+		{
+			.location = 3,
+			.binding = 0,
+			.format = VK_FORMAT_R8G8B8A8_UINT,
+			.offset = offsetof( Vertex, joints )
+		},
+		{
+			.location = 4,
+			.binding = 0,
+			.format = VK_FORMAT_R8G8B8A8_UNORM,
+			.offset = offsetof( Vertex, weights )
+		},
+		{
+			.location = 5,
+			.binding = 0,
+			.format = VK_FORMAT_R32G32B32_SFLOAT,
+			.offset = offsetof( Vertex, normal )
+		}
+	};
+}
+
+VkVertexInputBindingDescription DepthVertex::getBindingDescription() {
+
+	return {
+		.binding = 0,
+		.stride = sizeof(DepthVertex),
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+	};
+}
+
+std::array<VkVertexInputAttributeDescription, 3> DepthVertex::getAttributeDescription() {
+
+	return {
+		VkVertexInputAttributeDescription{
+			.location = 0,
+			.binding = 0,
+			.format = VK_FORMAT_R32G32B32_SFLOAT,
+			.offset = offsetof( DepthVertex, pos )
+		},
+		{
+			.location = 3,
+			.binding = 0,
+			.format = VK_FORMAT_R8G8B8A8_UINT,
+			.offset = offsetof( DepthVertex, joints )
+		},
+		{
+			.location = 4,
+			.binding = 0,
+			.format = VK_FORMAT_R8G8B8A8_UNORM,
+			.offset = offsetof( DepthVertex, weights )
 		}
 	};
 }
\ No newline at end of file
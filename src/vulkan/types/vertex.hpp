@@ -9,6 +9,19 @@ struct Vertex {
 	glm::vec3 pos;
 	glm::u8vec3 color;
 	glm::vec2 uv0;
+	glm::u8vec4 joints;
+	glm::u8vec4 weights;
+	glm::vec3 normal;
+
+	static VkVertexInputBindingDescription getBindingDescription();
+	static std::array<VkVertexInputAttributeDescription, 6> getAttributeDescription();
+};
+
+// Position-only stream for the depth pre-pass, skinning inputs keep the main shader's locations
+struct DepthVertex {
+	glm::vec3 pos;
+	glm::u8vec4 joints;
+	glm::u8vec4 weights;
 
 	static VkVertexInputBindingDescription getBindingDescription();
 	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescription();
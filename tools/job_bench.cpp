@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/jobs.hpp"
+#include "../src/parallel.hpp"
+
+// Measures job system overhead and scaling over thread counts
+//   job_bench [-r <repeats>] [-t <max threads>]
+// Every case runs repeats times per thread count, the fastest run is reported
+
+using std::string;
+using std::vector;
+
+const size_t EMPTY_JOBS = 100000;
+const size_t CHAIN_LENGTH = 10000;
+const size_t LOOP_ITEMS = 1 << 24;
+const size_t LOOP_BATCH = 4096;
+const size_t SPLIT_ITEMS = 1 << 22;
+const size_t SPLIT_LEAF = 2048;
+
+struct Case {
+	string name;
+	string unit;
+	double scale; // converts seconds into unit
+	std::function<void( JobSystem& )> run;
+};
+
+// Keeps the optimizer from dropping the work
+static std::atomic<double> sink = 0.;
+
+static double work( size_t begin, size_t end ) {
+
+	double sum = 0.;
+
+	for ( size_t i = begin; i < end; i++ ) {
+
+		sum += std::sqrt( static_cast<double>( i ) );
+	}
+
+	return sum;
+}
+
+static void runEmptyJobs( JobSystem& jobs ) {
+
+	JobCounter counter;
+
+	for ( size_t i = 0; i < EMPTY_JOBS; i++ ) {
+
+		jobs.run( [] {}, &counter );
+	}
+
+	jobs.wait( counter );
+}
+
+// Every job waits for the previous one, measures the latency of releasing a dependent job
+static void runChain( JobSystem& jobs ) {
+
+	std::unique_ptr<JobCounter[]> counters( new JobCounter[CHAIN_LENGTH] );
+
+	jobs.run( [] {}, &counters[0] );
+
+	for ( size_t i = 1; i < CHAIN_LENGTH; i++ ) {
+
+		jobs.runAfter( counters[i - 1], [] {}, &counters[i] );
+	}
+
+	jobs.wait( counters[CHAIN_LENGTH - 1] );
+}
+
+static void runLoop( JobSystem& jobs ) {
+
+	vector<double> sums( LOOP_ITEMS / LOOP_BATCH + 1 );
+
+	parallelFor( jobs, LOOP_ITEMS, LOOP_BATCH, [&sums] ( size_t begin, size_t end ) {
+
+		sums[begin / LOOP_BATCH] = work( begin, end );
+	});
+
+	double sum = 0.;
+
+	for ( double value : sums ) {
+
+		sum += value;
+	}
+
+	sink = sink + sum;
+}
+
+// Recursive fork and join, jobs wait on the halves they spawned so workers end up stealing subtrees
+static double split( JobSystem& jobs, size_t begin, size_t end ) {
+
+	if ( end - begin <= SPLIT_LEAF ) {
+
+		return work( begin, end );
+	}
+
+	size_t middle = begin + ( end - begin ) / 2;
+	double left = 0.;
+	JobCounter counter;
+
+	jobs.run( [&] { left = split( jobs, begin, middle ); }, &counter );
+
+	double right = split( jobs, middle, end );
+
+	jobs.wait( counter );
+
+	return left + right;
+}
+
+static void runSplit( JobSystem& jobs ) {
+
+	sink = sink + split( jobs, 0, SPLIT_ITEMS );
+}
+
+static void printUsage() {
+
+	std::cerr << "Usage: job_bench [-r <repeats>] [-t <max threads>]" << std::endl;
+}
+
+int main( int argc, char **argv ) {
+
+	int repeats = 5;
+	size_t maxThreads = std::max( std::thread::hardware_concurrency(), 1u );
+
+	for ( int i = 1; i < argc; i++ ) {
+
+		if ( strcmp( argv[i], "-r" ) == 0 && i + 1 < argc ) {
+
+			repeats = std::max( std::stoi( argv[++i] ), 1 );
+
+		} else if ( strcmp( argv[i], "-t" ) == 0 && i + 1 < argc ) {
+
+			maxThreads = std::max( std::stoi( argv[++i] ), 1 );
+
+		} else {
+
+			printUsage();
+			return 1;
+		}
+	}
+
+	vector<Case> cases = {
+		{ "empty jobs", "ns/job", 1e9 / EMPTY_JOBS, runEmptyJobs },
+		{ "dependency chain", "ns/link", 1e9 / CHAIN_LENGTH, runChain },
+		{ "parallel for", "ms", 1e3, runLoop },
+		{ "fork join", "ms", 1e3, runSplit },
+	};
+
+	vector<size_t> threadCounts;
+
+	for ( size_t threads = 1; threads < maxThreads; threads *= 2 ) {
+
+		threadCounts.push_back( threads );
+	}
+
+	threadCounts.push_back( maxThreads );
+
+	std::cout << std::left << std::setw( 18 ) << "case" << std::setw( 10 ) << "threads"
+			  << std::setw( 16 ) << "time" << "speedup" << std::endl;
+
+	for ( const auto& benchCase : cases ) {
+
+		double baseline = 0.;
+
+		for ( size_t threads : threadCounts ) {
+
+			// Calling thread is one of the threads
+			JobSystem jobs( threads - 1 );
+			double best = std::numeric_limits<double>::max();
+
+			for ( int i = 0; i < repeats; i++ ) {
+
+				auto start = std::chrono::steady_clock::now();
+
+				benchCase.run( jobs );
+
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				best = std::min( best, elapsed.count() );
+			}
+
+			if ( baseline == 0. ) {
+
+				baseline = best;
+			}
+
+			std::ostringstream time;
+			time << std::fixed << std::setprecision( 1 ) << best * benchCase.scale << " " << benchCase.unit;
+
+			std::cout << std::setw( 18 ) << benchCase.name << std::setw( 10 ) << threads << std::setw( 16 ) << time.str()
+					  << std::fixed << std::setprecision( 2 ) << baseline / best << "x" << std::endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef PAK_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../src/file.hpp"
+#include "../src/pak.hpp"
+
+// Packs loose asset files into a single archive
+//   packer [-z] -o <output.pak> <name>[=<path>] ...
+// Name is the key used at runtime, path defaults to the name
+
+struct Input {
+	string name;
+	string path;
+};
+
+static void printUsage() {
+
+	std::cerr << "Usage: packer [-z] -o <output.pak> <name>[=<path>] ..." << std::endl;
+}
+
+static uint64_t alignUp( uint64_t value, uint64_t alignment ) {
+
+	return ( value + alignment - 1 ) & ~( alignment - 1 );
+}
+
+static void writePadding( std::ofstream& stream, uint64_t size ) {
+
+	static const char zeros[pakAlignment] = {};
+
+	uint64_t pos = stream.tellp();
+	stream.write( zeros, alignUp( pos, size ) - pos );
+}
+
+int main( int argc, char **argv ) {
+
+	bool compress = false;
+	string outputPath;
+	vector<Input> inputs;
+
+	for ( int i = 1; i < argc; i++ ) {
+
+		if ( strcmp( argv[i], "-z" ) == 0 ) {
+
+			compress = true;
+
+		} else if ( strcmp( argv[i], "-o" ) == 0 && i + 1 < argc ) {
+
+			outputPath = argv[++i];
+
+		} else {
+
+			string arg = argv[i];
+			auto separator = arg.find( '=' );
+
+			if ( separator == string::npos ) {
+
+				inputs.push_back({ arg, arg });
+			} else {
+
+				inputs.push_back({ arg.substr( 0, separator ), arg.substr( separator + 1 ) });
+			}
+		}
+	}
+
+	if ( outputPath.empty() || inputs.empty() ) {
+
+		printUsage();
+		return 1;
+	}
+
+	// Empty name marks an empty bucket, such an entry could never be found
+	for ( const auto& input : inputs ) {
+
+		if ( input.name.empty() ) {
+
+			std::cerr << "packer: entry for " << input.path << " has an empty name" << std::endl;
+			return 1;
+		}
+	}
+
+#ifndef PAK_ZSTD
+	if ( compress ) {
+
+		std::cerr << "packer: built without zstd support, entries are stored uncompressed" << std::endl;
+		compress = false;
+	}
+#endif
+
+	std::ofstream stream( outputPath, std::ios::binary | std::ios::trunc );
+
+	if ( !stream.is_open() ) {
+
+		std::cerr << "packer: couldn't create " << outputPath << std::endl;
+		return 1;
+	}
+
+	// Header is rewritten once offsets are known
+	PakHeader header {};
+	stream.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+	vector<PakEntry> entries;
+	string names;
+
+	try {
+
+		for ( const auto& input : inputs ) {
+
+			File file = File::openBinary( input.path );
+
+			writePadding( stream, pakAlignment );
+
+			PakEntry entry {
+				.nameHash = hashPakName( input.name ),
+				.nameOffset = static_cast<uint32_t>( names.size() ),
+				.nameLength = static_cast<uint32_t>( input.name.size() ),
+				.offset = static_cast<uint64_t>( stream.tellp() ),
+				.size = file.getSize(),
+				.rawSize = file.getSize(),
+				.compression = PakCompression::Stored,
+			};
+
+			const char *data = file.getData();
+
+#ifdef PAK_ZSTD
+			vector<char> compressed;
+
+			if ( compress ) {
+
+				compressed.resize( ZSTD_compressBound( file.getSize() ) );
+				size_t compressedSize = ZSTD_compress( compressed.data(), compressed.size(), data, file.getSize(), 19 );
+
+				// Keep entries which don't benefit from compression readable in place
+				if ( !ZSTD_isError( compressedSize ) && compressedSize < file.getSize() ) {
+
+					entry.size = compressedSize;
+					entry.compression = PakCompression::Zstd;
+					data = compressed.data();
+				}
+			}
+#endif
+
+			stream.write( data, entry.size );
+
+			names += input.name;
+			entries.push_back( entry );
+		}
+
+	} catch ( const std::exception& e ) {
+
+		std::cerr << "packer: " << e.what() << std::endl;
+		return 1;
+	}
+
+	header.namesOffset = stream.tellp();
+	stream.write( names.data(), names.size() );
+
+	// Keep load factor at or below one half so probe sequences stay short
+	uint32_t bucketCount = 1;
+
+	while ( bucketCount < entries.size() * 2 ) {
+
+		bucketCount *= 2;
+	}
+
+	vector<PakEntry> toc( bucketCount, PakEntry {} );
+
+	for ( const auto& entry : entries ) {
+
+		uint32_t i = entry.nameHash & ( bucketCount - 1 );
+
+		while ( toc[i].nameLength != 0 ) {
+
+			if ( toc[i].nameHash == entry.nameHash &&
+				 names.compare( toc[i].nameOffset, toc[i].nameLength, names, entry.nameOffset, entry.nameLength ) == 0 ) {
+
+				std::cerr << "packer: duplicate entry " << names.substr( entry.nameOffset, entry.nameLength ) << std::endl;
+				return 1;
+			}
+
+			i = ( i + 1 ) & ( bucketCount - 1 );
+		}
+
+		toc[i] = entry;
+	}
+
+	writePadding( stream, alignof( PakEntry ) );
+	header.tocOffset = stream.tellp();
+	stream.write( reinterpret_cast<const char*>( toc.data() ), toc.size() * sizeof( PakEntry ) );
+
+	memcpy( header.magic, pakMagic, sizeof( pakMagic ) );
+	header.version = pakVersion;
+	header.entryCount = entries.size();
+	header.bucketCount = bucketCount;
+
+	stream.seekp( 0 );
+	stream.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+	stream.close();
+
+	// Stream state sticks after the first failed write, so checking once covers the whole archive
+	if ( !stream ) {
+
+		std::cerr << "packer: failed to write " << outputPath << std::endl;
+		return 1;
+	}
+
+	std::cout << "Packed " << entries.size() << " entries into " << outputPath << std::endl;
+
+	return 0;
+}